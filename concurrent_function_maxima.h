@@ -0,0 +1,380 @@
+#ifndef MAXIMA_CONCURRENT_FUNCTION_MAXIMA_H
+#define MAXIMA_CONCURRENT_FUNCTION_MAXIMA_H
+
+#include "function_maxima.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*********************************MAXIMA_UPDATE_QUEUE*********************************/
+
+/**
+ * Lock-free multi-producer single-consumer queue of intrusive nodes (anything with a Node *next field).
+ * Producers push onto a stack with one compare-and-swap; the consumer takes the whole stack
+ * at once and reverses it, so it gets the nodes in the order of their pushes and there is no ABA problem
+ * (single nodes are never popped).
+ *
+ * @tparam Node - type of the nodes
+ */
+template<typename Node>
+class MaximaUpdateQueue {
+public:
+    /**
+     * Function is nothrow and lock-free. Sequentially consistent, so a producer that checks
+     * afterwards whether the consumer sleeps can not miss it (see ConcurrentFunctionMaxima).
+     */
+    void push(Node *node) noexcept {
+        Node *head = top.load(std::memory_order_relaxed);
+
+        do {
+            node->next = head;
+        } while (!top.compare_exchange_weak(head, node, std::memory_order_seq_cst, std::memory_order_relaxed));
+    }
+
+    /**
+     * @return all pushed nodes in the order of their pushes, linked by next, or nullptr.
+     */
+    Node *takeAll() noexcept {
+        Node *stack = top.exchange(nullptr, std::memory_order_acquire);
+        Node *reversed = nullptr;
+
+        while (stack != nullptr) {
+            Node *next = stack->next;
+            stack->next = reversed;
+            reversed = stack;
+            stack = next;
+        }
+
+        return reversed;
+    }
+
+    bool empty() const noexcept {
+        return top.load(std::memory_order_seq_cst) == nullptr;
+    }
+
+private:
+    std::atomic<Node *> top{nullptr};
+};
+
+/*********************************CONCURRENT_FUNCTION_MAXIMA*********************************/
+
+/**
+ * Front end of FunctionMaxima for many writer threads. set_value() and erase() only push the update
+ * to a MaximaUpdateQueue (one allocation and one compare-and-swap, no lock), a single applier thread
+ * drains the queue in batches, keeps only the last update of each argument in a batch (last writer wins,
+ * in the order of the pushes) and applies the rest in ascending order of arguments: one by one, so that
+ * the finger of FunctionMaxima keeps the searches short, or, when they are many compared to the function,
+ * set values are built into a separate function with assign() and merged in one walk with merge().
+ *
+ * Updates are applied asynchronously: flush() waits until all updates pushed before it are applied.
+ * Readers get a consistent view through read(), which excludes only the applier, not other readers.
+ * An exception thrown while applying (e.g. by a comparison or an allocation) can not reach the writer,
+ * it is kept and rethrown by the next flush(); the other updates of the batch are still applied.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ */
+template<typename A, typename V>
+class ConcurrentFunctionMaxima {
+public:
+    using function_type = FunctionMaxima<A, V>;
+    using size_type = typename function_type::size_type;
+
+    explicit ConcurrentFunctionMaxima(function_type initial = function_type())
+            : function(std::move(initial)), applier([this]() {
+        applierLoop();
+    }) {}
+
+    ConcurrentFunctionMaxima(const ConcurrentFunctionMaxima &) = delete;
+
+    ConcurrentFunctionMaxima &operator=(const ConcurrentFunctionMaxima &) = delete;
+
+    /**
+     * Applies all pushed updates and stops the applier. No writer may run concurrently.
+     */
+    ~ConcurrentFunctionMaxima() {
+        stopping.store(true);
+        wake(true);
+        applier.join();
+    }
+
+    /**
+     * Thread-safe. Function has strong guarantee: if copying a or v or the allocation of the update throws,
+     * nothing is pushed.
+     */
+    void set_value(A const &a, V const &v) {
+        publish(new Update(a, v));
+    }
+
+    /**
+     * Thread-safe, see set_value().
+     */
+    void erase(A const &a) {
+        publish(new Update(a));
+    }
+
+    /**
+     * Waits until every update pushed (by any thread) before the call is applied,
+     * then rethrows the first exception thrown while applying since the previous flush(), if any.
+     */
+    void flush() {
+        std::unique_ptr<Barrier> barrier(new Barrier);
+        std::future<void> applied = barrier->done.get_future();
+        publish(barrier.release());
+        applied.wait();
+
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> guard(failureLock);
+            std::swap(error, failure);
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    /**
+     * Calls reader(const FunctionMaxima &) while the applier is held off and returns its result.
+     * Readers do not exclude each other.
+     */
+    template<typename Reader>
+    decltype(auto) read(Reader reader) const {
+        std::shared_lock<std::shared_mutex> guard(lock);
+
+        return reader(static_cast<const function_type &>(function));
+    }
+
+    /**
+     * @return number of updates dropped so far because a later update of the same argument was in the same batch.
+     */
+    std::uint64_t coalesced() const noexcept {
+        return coalescedUpdates.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Node {
+        enum Kind {
+            update,
+            barrier
+        };
+
+        explicit Node(Kind kind) noexcept : kind(kind) {}
+
+        Node *next = nullptr;
+        Kind kind;
+    };
+
+    /**
+     * set_value() if value is present, otherwise erase().
+     */
+    struct Update : Node {
+        Update(const A &argument, const V &value) : Node(Node::update), argument(argument), value(value) {}
+
+        explicit Update(const A &argument) : Node(Node::update), argument(argument) {}
+
+        A argument;
+        std::optional<V> value;
+    };
+
+    /**
+     * Node of flush(), owned by the applier once published: it is deleted only after done is set,
+     * because the flushing thread may return while set_value() is still running.
+     */
+    struct Barrier : Node {
+        Barrier() : Node(Node::barrier) {}
+
+        std::promise<void> done;
+    };
+
+    /**
+     * Batches with at least size() / mergeRatio set values are merged instead of applied one by one.
+     */
+    static constexpr size_type mergeRatio = 8;
+
+    /**
+     * Longest sleep of an idle applier before it looks at the queue again.
+     */
+    static constexpr std::chrono::milliseconds idleWait{100};
+
+    void publish(Node *node) noexcept {
+        queue.push(node);
+        wake(false);
+    }
+
+    /**
+     * Wakes the applier if it sleeps (or is about to, see applierLoop()).
+     * Function is nothrow: if sleepLock can not be taken, the applier is notified without it
+     * and in the worst case finds the update after idleWait.
+     */
+    void wake(bool always) noexcept {
+        if (always || sleeping.load(std::memory_order_seq_cst)) {
+            try {
+                std::lock_guard<std::mutex> guard(sleepLock);
+                wakeUp.notify_one();
+            }
+            catch (...) {
+                wakeUp.notify_one();
+            }
+        }
+    }
+
+    /**
+     * The applier announces that it goes to sleep before it checks the queue for the last time,
+     * and producers check the announcement after their push (both sequentially consistent),
+     * so either the applier sees the update or the producer sees the announcement and notifies it.
+     */
+    void applierLoop() noexcept {
+        while (true) {
+            if (Node *batch = queue.takeAll()) {
+                applyBatch(batch);
+
+                continue;
+            }
+
+            if (stopping.load()) {
+                return;
+            }
+
+            std::unique_lock<std::mutex> guard(sleepLock);
+            sleeping.store(true, std::memory_order_seq_cst);
+            wakeUp.wait_for(guard, idleWait, [this]() {
+                return !queue.empty() || stopping.load();
+            });
+            sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    void applyBatch(Node *first) noexcept {
+        std::vector<Update *> updates;
+
+        try {
+            for (Node *node = first; node != nullptr; node = node->next) {
+                if (node->kind == Node::update) {
+                    updates.push_back(static_cast<Update *>(node));
+                }
+            }
+
+            std::stable_sort(updates.begin(), updates.end(), [](const Update *u1, const Update *u2) {
+                return u1->argument < u2->argument;
+            });
+
+            std::unique_lock<std::shared_mutex> guard(lock);
+            apply(updates);
+        }
+        catch (...) {
+            fail(std::current_exception());
+        }
+
+        while (first != nullptr) {
+            Node *next = first->next;
+
+            if (first->kind == Node::update) {
+                delete static_cast<Update *>(first);
+            } else {
+                Barrier *barrier = static_cast<Barrier *>(first);
+                barrier->done.set_value();
+                delete barrier;
+            }
+
+            first = next;
+        }
+    }
+
+    /**
+     * Applies the last update of each argument of updates (sorted stably by arguments).
+     */
+    void apply(const std::vector<Update *> &updates) {
+        std::vector<Update *> kept;
+        kept.reserve(updates.size());
+
+        for (size_t i = 0; i < updates.size(); i++) {
+            if (i + 1 < updates.size() && !(updates[i]->argument < updates[i + 1]->argument)) {
+                continue;
+            }
+
+            kept.push_back(updates[i]);
+        }
+
+        coalescedUpdates.fetch_add(updates.size() - kept.size(), std::memory_order_relaxed);
+
+        size_type sets = static_cast<size_type>(std::count_if(kept.begin(), kept.end(), [](const Update *u) {
+            return u->value.has_value();
+        }));
+
+        bool merge = sets > 0 && sets >= function.size() / mergeRatio;
+
+        if (merge) {
+            // assign() and merge() have strong guarantee, so if they throw the function is untouched
+            // and the set values are applied one by one below: only the updates that throw again are lost
+            // and their exception is the one reported.
+            try {
+                std::vector<std::pair<A, V>> points;
+                points.reserve(sets);
+
+                for (const Update *u : kept) {
+                    if (u->value) {
+                        points.emplace_back(u->argument, *u->value);
+                    }
+                }
+
+                function_type batch;
+                batch.assign(points.begin(), points.end());
+                function.merge(std::move(batch), MergePolicy::preferRight);
+            }
+            catch (...) {
+                merge = false;
+            }
+        }
+
+        for (const Update *u : kept) {
+            try {
+                if (!u->value) {
+                    function.erase(u->argument);
+                } else if (!merge) {
+                    function.set_value(u->argument, *u->value);
+                }
+            }
+            catch (...) {
+                fail(std::current_exception());
+            }
+        }
+    }
+
+    void fail(std::exception_ptr error) noexcept {
+        std::lock_guard<std::mutex> guard(failureLock);
+
+        if (!failure) {
+            failure = error;
+        }
+    }
+
+    function_type function;
+    mutable std::shared_mutex lock;
+    MaximaUpdateQueue<Node> queue;
+    std::atomic<std::uint64_t> coalescedUpdates{0};
+
+    std::mutex failureLock;
+    std::exception_ptr failure;
+
+    std::mutex sleepLock;
+    std::condition_variable wakeUp;
+    std::atomic<bool> sleeping{false};
+    std::atomic<bool> stopping{false};
+
+    std::thread applier;
+};
+
+#endif //MAXIMA_CONCURRENT_FUNCTION_MAXIMA_H
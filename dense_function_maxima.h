@@ -0,0 +1,864 @@
+#ifndef MAXIMA_DENSE_FUNCTION_MAXIMA_H
+#define MAXIMA_DENSE_FUNCTION_MAXIMA_H
+
+#include "function_maxima.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <set>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*********************************DENSE_FUNCTION_MAXIMA*********************************/
+
+/**
+ * Variant of FunctionMaxima for integral arguments from a dense range [lo, hi) known up front.
+ * Values live in a flat array indexed by (argument - lo) with a presence bitmap next to it,
+ * so value_at() is O(1) and neighbours of a point are found by bitmap scans instead of tree walks.
+ * Maxima membership is a second bitmap, the descending order of maxima is kept in a set
+ * of (value, argument) entries.
+ *
+ * Unlike FunctionMaxima<A, V>::point_type, point_type of this class refers to the storage
+ * of the function, so it is valid only until the point is changed or erased.
+ * There are no point_type objects to refer to, so iterators return them by value: to the standard
+ * library they are input iterators, although they can also be decremented
+ * (iterator_concept tells C++20 ranges they are bidirectional).
+ *
+ * @tparam A - integral type of the domain values
+ * @tparam V - type of the range values, its move constructor must not throw
+ */
+template<typename A, typename V>
+class DenseFunctionMaxima {
+    static_assert(std::is_integral<A>::value && !std::is_same<A, bool>::value,
+                  "DenseFunctionMaxima requires an integral argument type");
+    static_assert(std::is_nothrow_move_constructible<V>::value,
+                  "DenseFunctionMaxima requires a value type with a nothrow move constructor");
+
+public:
+    class point_type;
+
+    class iterator;
+
+    class mx_iterator;
+
+    using size_type = std::size_t;
+
+    DenseFunctionMaxima(A const &lo, A const &hi);
+
+    DenseFunctionMaxima(const DenseFunctionMaxima &rhs);
+
+    /**
+     * Copy and swap provides strong guarantee.
+     */
+    DenseFunctionMaxima &operator=(const DenseFunctionMaxima &rhs) {
+        DenseFunctionMaxima copy(rhs);
+        swap(copy);
+
+        return *this;
+    }
+
+    DenseFunctionMaxima(DenseFunctionMaxima &&rhs) noexcept;
+
+    DenseFunctionMaxima &operator=(DenseFunctionMaxima &&rhs) noexcept {
+        DenseFunctionMaxima moved(std::move(rhs));
+        swap(moved);
+
+        return *this;
+    }
+
+    ~DenseFunctionMaxima();
+
+    V const &value_at(A const &a) const;
+
+    V const *try_value_at(A const &a) const noexcept;
+
+    bool contains(A const &a) const noexcept;
+
+    void set_value(A const &a, V const &v);
+
+    void erase(A const &a);
+
+    iterator begin() const noexcept;
+
+    iterator end() const noexcept;
+
+    iterator find(A const &a) const noexcept;
+
+    mx_iterator mx_begin() const noexcept;
+
+    mx_iterator mx_end() const noexcept;
+
+    size_type size() const noexcept;
+
+    void swap(DenseFunctionMaxima &rhs) noexcept;
+
+private:
+    using word_type = std::uint64_t;
+    using slot_type = typename std::aligned_storage<sizeof(V), alignof(V)>::type;
+    using unsigned_type = typename std::make_unsigned<A>::type;
+
+    static constexpr size_type wordBits = 64;
+
+    /**
+     * Entry of the maxima index. It keeps its own copy of the value,
+     * so the index can be prepared before the flat array is modified.
+     */
+    struct MaximumEntry {
+        V value;
+        A argument;
+    };
+
+    /**
+     * Key used to look up an entry without copying the value.
+     */
+    struct MaximumKey {
+        const V *value;
+        A argument;
+    };
+
+    /**
+     * Orders maxima in descending order of values, ties are broken by ascending arguments.
+     */
+    struct maximaCmp {
+        using is_transparent = void;
+
+        static bool less(const V &aValue, const A &aArg, const V &bValue, const A &bArg) {
+            return MaximaValueOrder<V>::maximumBefore(aValue, aArg, bValue, bArg);
+        }
+
+        bool operator()(const MaximumEntry &a, const MaximumEntry &b) const {
+            return less(a.value, a.argument, b.value, b.argument);
+        }
+
+        bool operator()(const MaximumKey &a, const MaximumEntry &b) const {
+            return less(*a.value, a.argument, b.value, b.argument);
+        }
+
+        bool operator()(const MaximumEntry &a, const MaximumKey &b) const {
+            return less(a.value, a.argument, *b.value, b.argument);
+        }
+    };
+
+    using maxima_set = std::set<MaximumEntry, maximaCmp>;
+
+    enum {
+        middle,
+        leftNeighbour,
+        rightNeighbour,
+        requiredSpace
+    };
+
+    /**
+     * Changes of the maxima index prepared by set_value() and erase().
+     * Capacity is fixed, so recording a change never allocates.
+     */
+    struct Changes {
+        typename maxima_set::iterator outdated[requiredSpace];
+        typename maxima_set::iterator inserted[requiredSpace];
+        size_type outdatedCount = 0;
+        size_type insertedCount = 0;
+    };
+
+    static bool sameValue(const V &v1, const V &v2) {
+        return MaximaValueOrder<V>::same(v1, v2);
+    }
+
+    /**
+     * @param left   - value of the left neighbour or nullptr if there is none
+     * @param value  - value of the point
+     * @param right  - value of the right neighbour or nullptr if there is none
+     * @return       - true if the point is a local maximum.
+     */
+    static bool shouldBeMaximum(const V *left, const V &value, const V *right) {
+        return MaximaValueOrder<V>::isMaximum(left, value, right);
+    }
+
+    static bool testBit(const std::vector<word_type> &bits, size_type i) noexcept {
+        return (bits[i / wordBits] >> (i % wordBits)) & 1u;
+    }
+
+    static void assignBit(std::vector<word_type> &bits, size_type i, bool value) noexcept {
+        if (value) {
+            bits[i / wordBits] |= word_type(1) << (i % wordBits);
+        } else {
+            bits[i / wordBits] &= ~(word_type(1) << (i % wordBits));
+        }
+    }
+
+    static size_type lowestBit(word_type word) noexcept {
+#if defined(__GNUC__)
+        return static_cast<size_type>(__builtin_ctzll(word));
+#else
+        size_type bit = 0;
+
+        while ((word & 1) == 0) {
+            word >>= 1;
+            bit++;
+        }
+
+        return bit;
+#endif
+    }
+
+    static size_type highestBit(word_type word) noexcept {
+#if defined(__GNUC__)
+        return wordBits - 1 - static_cast<size_type>(__builtin_clzll(word));
+#else
+        size_type bit = 0;
+
+        while (word >>= 1) {
+            bit++;
+        }
+
+        return bit;
+#endif
+    }
+
+    static size_type wordCount(size_type bitCount) noexcept {
+        return (bitCount + wordBits - 1) / wordBits;
+    }
+
+    /**
+     * @return - position of a in the flat array, capacity if a is outside of [lo, hi).
+     */
+    size_type indexOf(const A &a) const noexcept {
+        if (a < lo) {
+            return capacity;
+        }
+
+        auto index = static_cast<size_type>(static_cast<unsigned_type>(a) - static_cast<unsigned_type>(lo));
+
+        return index < capacity ? index : capacity;
+    }
+
+    A argumentOf(size_type index) const noexcept {
+        return static_cast<A>(static_cast<unsigned_type>(lo) + static_cast<unsigned_type>(index));
+    }
+
+    V &slot(size_type index) noexcept {
+        return *reinterpret_cast<V *>(&slots[index]);
+    }
+
+    const V &slot(size_type index) const noexcept {
+        return *reinterpret_cast<const V *>(&slots[index]);
+    }
+
+    const V *valueOrNull(size_type index) const noexcept {
+        return index == capacity ? nullptr : &slot(index);
+    }
+
+    /**
+     * Scans the presence bitmap to the right, skipping empty words with the summary bitmap.
+     *
+     * @param from - first position to check
+     * @return     - first present position >= from, capacity if there is none.
+     */
+    size_type nextPresent(size_type from) const noexcept {
+        if (from >= capacity) {
+            return capacity;
+        }
+
+        size_type word = from / wordBits;
+        word_type bits = presence[word] & (~word_type(0) << (from % wordBits));
+
+        if (bits != 0) {
+            return word * wordBits + lowestBit(bits);
+        }
+
+        if (++word == presence.size()) {
+            return capacity;
+        }
+
+        size_type summaryWord = word / wordBits;
+        word_type summaryBits = summary[summaryWord] & (~word_type(0) << (word % wordBits));
+
+        while (summaryBits == 0) {
+            if (++summaryWord == summary.size()) {
+                return capacity;
+            }
+
+            summaryBits = summary[summaryWord];
+        }
+
+        word = summaryWord * wordBits + lowestBit(summaryBits);
+
+        return word * wordBits + lowestBit(presence[word]);
+    }
+
+    /**
+     * Scans the presence bitmap to the left, skipping empty words with the summary bitmap.
+     *
+     * @param before - position one past the last position to check
+     * @return       - last present position < before, capacity if there is none.
+     */
+    size_type prevPresent(size_type before) const noexcept {
+        if (before == 0) {
+            return capacity;
+        }
+
+        size_type last = before - 1;
+        size_type word = last / wordBits;
+        word_type bits = presence[word] & (~word_type(0) >> (wordBits - 1 - last % wordBits));
+
+        if (bits != 0) {
+            return word * wordBits + highestBit(bits);
+        }
+
+        if (word-- == 0) {
+            return capacity;
+        }
+
+        size_type summaryWord = word / wordBits;
+        word_type summaryBits = summary[summaryWord] & (~word_type(0) >> (wordBits - 1 - word % wordBits));
+
+        while (summaryBits == 0) {
+            if (summaryWord-- == 0) {
+                return capacity;
+            }
+
+            summaryBits = summary[summaryWord];
+        }
+
+        word = summaryWord * wordBits + highestBit(summaryBits);
+
+        return word * wordBits + highestBit(presence[word]);
+    }
+
+    /**
+     * Remembers the entry of a point that stops being a maximum (or changes its value).
+     * Function has strong guarantee: find() on std::set has strong guarantee.
+     */
+    void markOutdated(size_type index, Changes &changes) const {
+        if (testBit(maximaBits, index)) {
+            changes.outdated[changes.outdatedCount++] =
+                    maxima.find(MaximumKey{&slot(index), argumentOf(index)});
+        }
+    }
+
+    /**
+     * Inserts an entry of a point that becomes a maximum.
+     * Function has strong guarantee: insert() on std::set has strong guarantee.
+     */
+    void insertMaximum(const V &value, size_type index, Changes &changes) {
+        changes.inserted[changes.insertedCount++] = maxima.insert(MaximumEntry{value, argumentOf(index)}).first;
+    }
+
+    /**
+     * Prepares the change of maximum status of a neighbour of the modified point.
+     */
+    void updateNeighbour(size_type index, bool isMaximum, Changes &changes) {
+        if (index == capacity || testBit(maximaBits, index) == isMaximum) {
+            return;
+        }
+
+        if (isMaximum) {
+            insertMaximum(slot(index), index, changes);
+        } else {
+            markOutdated(index, changes);
+        }
+    }
+
+    /**
+     * Function is nothrow: erase() on std::set by iterator is nothrow.
+     */
+    void makeRollback(Changes &changes) noexcept {
+        for (size_type i = 0; i < changes.insertedCount; i++) {
+            maxima.erase(changes.inserted[i]);
+        }
+    }
+
+    /**
+     * Erases outdated entries and refreshes maxima bitmap of the given positions.
+     * Function is nothrow: erase() on std::set by iterator is nothrow.
+     */
+    void makeCommit(Changes &changes, const size_type (&positions)[requiredSpace],
+                    const bool (&statuses)[requiredSpace]) noexcept {
+        for (size_type i = 0; i < changes.outdatedCount; i++) {
+            maxima.erase(changes.outdated[i]);
+        }
+
+        for (size_type i = 0; i < requiredSpace; i++) {
+            if (positions[i] != capacity) {
+                assignBit(maximaBits, positions[i], statuses[i]);
+            }
+        }
+    }
+
+    void markPresent(size_type index) noexcept {
+        assignBit(presence, index, true);
+        assignBit(summary, index / wordBits, true);
+    }
+
+    void markAbsent(size_type index) noexcept {
+        assignBit(presence, index, false);
+
+        if (presence[index / wordBits] == 0) {
+            assignBit(summary, index / wordBits, false);
+        }
+    }
+
+    void destroyAll() noexcept {
+        for (size_type i = nextPresent(0); i != capacity; i = nextPresent(i + 1)) {
+            slot(i).~V();
+        }
+    }
+
+    A lo;
+    size_type capacity;
+    size_type count;
+    std::unique_ptr<slot_type[]> slots;
+    std::vector<word_type> presence;
+    std::vector<word_type> summary;
+    std::vector<word_type> maximaBits;
+    maxima_set maxima;
+};
+
+/*********************************DENSE_POINT_TYPE*********************************/
+
+template<typename A, typename V>
+class DenseFunctionMaxima<A, V>::point_type {
+public:
+    A const &arg() const noexcept {
+        return argument;
+    }
+
+    V const &value() const noexcept {
+        return *point;
+    }
+
+    point_type(const point_type &rhs) = default;
+
+    point_type &operator=(const point_type &rhs) = default;
+
+private:
+    friend class DenseFunctionMaxima<A, V>;
+
+    point_type(const A &argument, const V *point) : argument(argument), point(point) {}
+
+    A argument;
+    const V *point;
+};
+
+/*********************************DENSE_ITERATORS*********************************/
+
+template<typename A, typename V>
+class DenseFunctionMaxima<A, V>::iterator {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using iterator_concept = std::bidirectional_iterator_tag;
+    using value_type = point_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = MaximaArrowProxy<point_type>;
+    using reference = point_type;
+
+    iterator() noexcept : fun(nullptr), index(0) {}
+
+    reference operator*() const noexcept {
+        return point_type(fun->argumentOf(index), &fun->slot(index));
+    }
+
+    pointer operator->() const noexcept {
+        return pointer(**this);
+    }
+
+    iterator &operator++() noexcept {
+        index = fun->nextPresent(index + 1);
+
+        return *this;
+    }
+
+    iterator operator++(int) noexcept {
+        iterator result = *this;
+        ++*this;
+
+        return result;
+    }
+
+    iterator &operator--() noexcept {
+        index = fun->prevPresent(index);
+
+        return *this;
+    }
+
+    iterator operator--(int) noexcept {
+        iterator result = *this;
+        --*this;
+
+        return result;
+    }
+
+    bool operator==(const iterator &rhs) const noexcept {
+        return fun == rhs.fun && index == rhs.index;
+    }
+
+    bool operator!=(const iterator &rhs) const noexcept {
+        return !(*this == rhs);
+    }
+
+private:
+    friend class DenseFunctionMaxima<A, V>;
+
+    iterator(const DenseFunctionMaxima *fun, size_type index) noexcept : fun(fun), index(index) {}
+
+    const DenseFunctionMaxima *fun;
+    size_type index;
+};
+
+template<typename A, typename V>
+class DenseFunctionMaxima<A, V>::mx_iterator {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using iterator_concept = std::bidirectional_iterator_tag;
+    using value_type = point_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = MaximaArrowProxy<point_type>;
+    using reference = point_type;
+
+    mx_iterator() noexcept = default;
+
+    reference operator*() const noexcept {
+        return point_type(it->argument, &it->value);
+    }
+
+    pointer operator->() const noexcept {
+        return pointer(**this);
+    }
+
+    mx_iterator &operator++() noexcept {
+        ++it;
+
+        return *this;
+    }
+
+    mx_iterator operator++(int) noexcept {
+        mx_iterator result = *this;
+        ++it;
+
+        return result;
+    }
+
+    mx_iterator &operator--() noexcept {
+        --it;
+
+        return *this;
+    }
+
+    mx_iterator operator--(int) noexcept {
+        mx_iterator result = *this;
+        --it;
+
+        return result;
+    }
+
+    bool operator==(const mx_iterator &rhs) const noexcept {
+        return it == rhs.it;
+    }
+
+    bool operator!=(const mx_iterator &rhs) const noexcept {
+        return it != rhs.it;
+    }
+
+private:
+    friend class DenseFunctionMaxima<A, V>;
+
+    explicit mx_iterator(typename maxima_set::const_iterator it) noexcept : it(it) {}
+
+    typename maxima_set::const_iterator it;
+};
+
+/*********************************DENSE_FUNCTION_MAXIMA_DEFINITIONS*********************************/
+
+/**
+ * Creates an empty function with the domain [lo, hi).
+ * Throws InvalidArg if hi < lo.
+ *
+ * @tparam A - integral type of the domain values
+ * @tparam V - type of the range values
+ * @param lo - smallest argument that can be set
+ * @param hi - one past the greatest argument that can be set
+ */
+template<typename A, typename V>
+DenseFunctionMaxima<A, V>::DenseFunctionMaxima(const A &lo, const A &hi) : lo(lo), capacity(0), count(0) {
+    if (hi < lo) {
+        throw InvalidArg("invalid argument range");
+    }
+
+    capacity = static_cast<size_type>(static_cast<unsigned_type>(hi) - static_cast<unsigned_type>(lo));
+    slots = std::unique_ptr<slot_type[]>(new slot_type[capacity]);
+    presence.assign(wordCount(capacity), 0);
+    summary.assign(wordCount(presence.size()), 0);
+    maximaBits.assign(wordCount(capacity), 0);
+}
+
+/**
+ * Copy constructor has strong guarantee: if copying a value throws,
+ * already copied values are destroyed and the exception is propagated.
+ */
+template<typename A, typename V>
+DenseFunctionMaxima<A, V>::DenseFunctionMaxima(const DenseFunctionMaxima &rhs)
+        : lo(rhs.lo), capacity(rhs.capacity), count(0), slots(new slot_type[rhs.capacity]),
+          presence(wordCount(rhs.capacity), 0), summary(rhs.summary.size(), 0),
+          maximaBits(rhs.maximaBits), maxima(rhs.maxima) {
+    try {
+        for (size_type i = rhs.nextPresent(0); i != capacity; i = rhs.nextPresent(i + 1)) {
+            new(&slots[i]) V(rhs.slot(i));
+            markPresent(i);
+            count++;
+        }
+    }
+    catch (...) {
+        destroyAll();
+
+        throw;
+    }
+}
+
+template<typename A, typename V>
+DenseFunctionMaxima<A, V>::DenseFunctionMaxima(DenseFunctionMaxima &&rhs) noexcept
+        : lo(rhs.lo), capacity(rhs.capacity), count(rhs.count), slots(std::move(rhs.slots)),
+          presence(std::move(rhs.presence)), summary(std::move(rhs.summary)),
+          maximaBits(std::move(rhs.maximaBits)), maxima(std::move(rhs.maxima)) {
+    rhs.capacity = 0;
+    rhs.count = 0;
+    rhs.presence.clear();
+    rhs.summary.clear();
+    rhs.maximaBits.clear();
+    rhs.maxima.clear();
+}
+
+template<typename A, typename V>
+DenseFunctionMaxima<A, V>::~DenseFunctionMaxima() {
+    destroyAll();
+}
+
+template<typename A, typename V>
+void DenseFunctionMaxima<A, V>::swap(DenseFunctionMaxima &rhs) noexcept {
+    using std::swap;
+
+    swap(lo, rhs.lo);
+    swap(capacity, rhs.capacity);
+    swap(count, rhs.count);
+    swap(slots, rhs.slots);
+    swap(presence, rhs.presence);
+    swap(summary, rhs.summary);
+    swap(maximaBits, rhs.maximaBits);
+    swap(maxima, rhs.maxima);
+}
+
+/**
+ * O(1) lookup in the flat array.
+ * Throws InvalidArg if the argument is outside of the domain or has no value.
+ *
+ * @tparam A - integral type of the domain values
+ * @tparam V - type of the range values
+ * @param a - argument to be searched
+ * @return the value of the found argument
+ */
+template<typename A, typename V>
+V const &DenseFunctionMaxima<A, V>::value_at(const A &a) const {
+    size_type index = indexOf(a);
+
+    if (index == capacity || !testBit(presence, index)) {
+        throw InvalidArg("invalid argument value");
+    }
+
+    return slot(index);
+}
+
+/**
+ * O(1) lookup in the flat array that never throws.
+ *
+ * @tparam A - integral type of the domain values
+ * @tparam V - type of the range values
+ * @param a - argument to be searched
+ * @return pointer to the value of the found argument or nullptr if it is outside of the domain or has no value.
+ */
+template<typename A, typename V>
+V const *DenseFunctionMaxima<A, V>::try_value_at(const A &a) const noexcept {
+    size_type index = indexOf(a);
+
+    if (index == capacity || !testBit(presence, index)) {
+        return nullptr;
+    }
+
+    return &slot(index);
+}
+
+/**
+ * @return true if a lies in the domain and has a value, otherwise false.
+ */
+template<typename A, typename V>
+bool DenseFunctionMaxima<A, V>::contains(const A &a) const noexcept {
+    size_type index = indexOf(a);
+
+    return index != capacity && testBit(presence, index);
+}
+
+/**
+ * Sets the value of a, which has to lie in [lo, hi), otherwise InvalidArg is thrown.
+ * Neighbours are found with at most four bitmap scans. All comparisons, the copy of v
+ * and insertions to the maxima index happen before the flat array is touched,
+ * insertions are undone if anything throws, and the final commit is nothrow
+ * (erase by iterator, nothrow move of the copied value), so the function has strong guarantee.
+ *
+ * @tparam A - integral type of the domain values
+ * @tparam V - type of the range values
+ * @param a - argument to be updated
+ * @param v - value to be assigned
+ */
+template<typename A, typename V>
+void DenseFunctionMaxima<A, V>::set_value(const A &a, const V &v) {
+    size_type index = indexOf(a);
+
+    if (index == capacity) {
+        throw InvalidArg("argument out of range");
+    }
+
+    bool present = testBit(presence, index);
+
+    if (present && sameValue(slot(index), v)) {
+        return;
+    }
+
+    V value(v);
+    size_type left = prevPresent(index);
+    size_type right = nextPresent(index + 1);
+    size_type leftmost = left == capacity ? capacity : prevPresent(left);
+    size_type rightmost = right == capacity ? capacity : nextPresent(right + 1);
+
+    const size_type positions[requiredSpace] = {index, left, right};
+    const bool statuses[requiredSpace] = {
+            shouldBeMaximum(valueOrNull(left), value, valueOrNull(right)),
+            left != capacity && shouldBeMaximum(valueOrNull(leftmost), slot(left), &value),
+            right != capacity && shouldBeMaximum(&value, slot(right), valueOrNull(rightmost))
+    };
+
+    Changes changes;
+
+    try {
+        if (present) {
+            markOutdated(index, changes);
+        }
+
+        updateNeighbour(left, statuses[leftNeighbour], changes);
+        updateNeighbour(right, statuses[rightNeighbour], changes);
+
+        if (statuses[middle]) {
+            insertMaximum(value, index, changes);
+        }
+    }
+    catch (...) {
+        makeRollback(changes);
+
+        throw;
+    }
+
+    makeCommit(changes, positions, statuses);
+
+    if (present) {
+        slot(index).~V();
+    } else {
+        markPresent(index);
+        count++;
+    }
+
+    new(&slots[index]) V(std::move(value));
+}
+
+/**
+ * Erases the value of a, nothing happens if a has no value.
+ * Function has strong guarantee for the same reasons as set_value().
+ *
+ * @tparam A - integral type of the domain values
+ * @tparam V - type of the range values
+ * @param a - argument to be erased
+ */
+template<typename A, typename V>
+void DenseFunctionMaxima<A, V>::erase(const A &a) {
+    size_type index = indexOf(a);
+
+    if (index == capacity || !testBit(presence, index)) {
+        return;
+    }
+
+    size_type left = prevPresent(index);
+    size_type right = nextPresent(index + 1);
+    size_type leftmost = left == capacity ? capacity : prevPresent(left);
+    size_type rightmost = right == capacity ? capacity : nextPresent(right + 1);
+
+    const size_type positions[requiredSpace] = {index, left, right};
+    const bool statuses[requiredSpace] = {
+            false,
+            left != capacity && shouldBeMaximum(valueOrNull(leftmost), slot(left), valueOrNull(right)),
+            right != capacity && shouldBeMaximum(valueOrNull(left), slot(right), valueOrNull(rightmost))
+    };
+
+    Changes changes;
+
+    try {
+        markOutdated(index, changes);
+        updateNeighbour(left, statuses[leftNeighbour], changes);
+        updateNeighbour(right, statuses[rightNeighbour], changes);
+    }
+    catch (...) {
+        makeRollback(changes);
+
+        throw;
+    }
+
+    makeCommit(changes, positions, statuses);
+    slot(index).~V();
+    markAbsent(index);
+    count--;
+}
+
+/**
+ * Iteration is done in ascending order according to the arguments.
+ */
+template<typename A, typename V>
+typename DenseFunctionMaxima<A, V>::iterator DenseFunctionMaxima<A, V>::begin() const noexcept {
+    return iterator(this, nextPresent(0));
+}
+
+template<typename A, typename V>
+typename DenseFunctionMaxima<A, V>::iterator DenseFunctionMaxima<A, V>::end() const noexcept {
+    return iterator(this, capacity);
+}
+
+/**
+ * @return iterator pointing to the point with argument a, or end() if there is none.
+ */
+template<typename A, typename V>
+typename DenseFunctionMaxima<A, V>::iterator DenseFunctionMaxima<A, V>::find(const A &a) const noexcept {
+    size_type index = indexOf(a);
+
+    if (index == capacity || !testBit(presence, index)) {
+        return end();
+    }
+
+    return iterator(this, index);
+}
+
+/**
+ * Iteration is done in descending order according to the values.
+ */
+template<typename A, typename V>
+typename DenseFunctionMaxima<A, V>::mx_iterator DenseFunctionMaxima<A, V>::mx_begin() const noexcept {
+    return mx_iterator(maxima.begin());
+}
+
+template<typename A, typename V>
+typename DenseFunctionMaxima<A, V>::mx_iterator DenseFunctionMaxima<A, V>::mx_end() const noexcept {
+    return mx_iterator(maxima.end());
+}
+
+template<typename A, typename V>
+typename DenseFunctionMaxima<A, V>::size_type DenseFunctionMaxima<A, V>::size() const noexcept {
+    return count;
+}
+
+#endif //MAXIMA_DENSE_FUNCTION_MAXIMA_H
@@ -0,0 +1,748 @@
+#ifndef MAXIMA_FROZEN_FUNCTION_MAXIMA_H
+#define MAXIMA_FROZEN_FUNCTION_MAXIMA_H
+
+#include "function_maxima.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*********************************FROZEN_COLUMNS*********************************/
+
+/**
+ * Number of points in one block of a compressed column. Every block starts with
+ * an uncompressed entry, so random access decodes at most frozenBlockSize - 1 entries.
+ */
+constexpr std::size_t frozenBlockSize = 32;
+
+/**
+ * True for types stored by the compressed columns of FrozenFunctionMaxima.
+ */
+template<typename T>
+constexpr bool frozenCompressible = std::is_integral<T>::value && !std::is_same<T, bool>::value;
+
+/**
+ * Array of unsigned integers of a fixed bit width packed into 64 bit words.
+ */
+class FrozenPackedInts {
+public:
+    static unsigned widthOf(std::uint64_t maximum) noexcept {
+        unsigned width = 0;
+
+        while (width < 64 && (maximum >> width) != 0) {
+            width++;
+        }
+
+        return width;
+    }
+
+    static std::uint64_t get(const std::vector<std::uint64_t> &words, std::size_t bit, unsigned width) noexcept {
+        if (width == 0) {
+            return 0;
+        }
+
+        std::size_t word = bit / 64;
+        unsigned shift = bit % 64;
+        std::uint64_t result = words[word] >> shift;
+
+        if (shift + width > 64) {
+            result |= words[word + 1] << (64 - shift);
+        }
+
+        return width == 64 ? result : result & ((std::uint64_t(1) << width) - 1);
+    }
+
+    /**
+     * Appends width lowest bits of v, words has to end exactly at bit.
+     */
+    static void append(std::vector<std::uint64_t> &words, std::size_t bit, std::uint64_t v, unsigned width) {
+        if (width == 0) {
+            return;
+        }
+
+        unsigned shift = bit % 64;
+
+        if (shift == 0) {
+            words.push_back(v);
+        } else {
+            words.back() |= v << shift;
+
+            if (shift + width > 64) {
+                words.push_back(v >> (64 - shift));
+            }
+        }
+    }
+};
+
+/**
+ * Column stored as a plain array, used for types which are not compressed.
+ *
+ * @tparam T - type of the entries
+ */
+template<typename T>
+class FrozenPlainColumn {
+public:
+    /**
+     * Position in the column which reads entries sequentially.
+     */
+    class Cursor {
+    public:
+        Cursor() noexcept = default;
+
+        Cursor(const FrozenPlainColumn *column, std::size_t index) noexcept : column(column), position(index) {}
+
+        const T &get() const noexcept {
+            return column->items[position];
+        }
+
+        std::size_t index() const noexcept {
+            return position;
+        }
+
+        void next() noexcept {
+            position++;
+        }
+
+    private:
+        const FrozenPlainColumn *column = nullptr;
+        std::size_t position = 0;
+    };
+
+    void append(const T &t) {
+        items.push_back(t);
+    }
+
+    void finish() {
+        items.shrink_to_fit();
+    }
+
+    const T &at(std::size_t i) const noexcept {
+        return items[i];
+    }
+
+    Cursor cursor(std::size_t i) const noexcept {
+        return Cursor(this, i);
+    }
+
+    /**
+     * @return - cursor at the first entry not less than t.
+     */
+    Cursor lowerBound(const T &t) const {
+        return Cursor(this, static_cast<std::size_t>(std::lower_bound(items.begin(), items.end(), t) - items.begin()));
+    }
+
+    std::size_t memory() const noexcept {
+        return items.capacity() * sizeof(T);
+    }
+
+private:
+    std::vector<T> items;
+};
+
+/**
+ * Column of strictly increasing integers. Every block keeps its first entry,
+ * the others are stored as LEB128 varints of (difference to the previous entry - 1),
+ * so dense arguments take one byte per point.
+ *
+ * @tparam T - integral type of the entries
+ */
+template<typename T>
+class FrozenDeltaColumn {
+    using unsigned_type = typename std::make_unsigned<T>::type;
+
+public:
+    /**
+     * Position in the column which decodes entries sequentially, one varint per step.
+     */
+    class Cursor {
+    public:
+        Cursor() noexcept = default;
+
+        Cursor(const FrozenDeltaColumn *column, std::size_t index) noexcept : column(column), position(index) {
+            if (position >= column->count) {
+                return;
+            }
+
+            std::size_t block = position / frozenBlockSize;
+            current = column->firsts[block];
+            bytes = column->deltas.data() + column->offsets[block];
+
+            for (std::size_t i = block * frozenBlockSize; i < position; i++) {
+                step();
+            }
+        }
+
+        const T &get() const noexcept {
+            return current;
+        }
+
+        std::size_t index() const noexcept {
+            return position;
+        }
+
+        void next() noexcept {
+            if (++position >= column->count) {
+                return;
+            }
+
+            if (position % frozenBlockSize == 0) {
+                current = column->firsts[position / frozenBlockSize];
+            } else {
+                step();
+            }
+        }
+
+    private:
+        void step() noexcept {
+            std::uint64_t delta = 0;
+
+            for (unsigned shift = 0;; shift += 7) {
+                unsigned char byte = *bytes++;
+                delta |= std::uint64_t(byte & 0x7f) << shift;
+
+                if ((byte & 0x80) == 0) {
+                    break;
+                }
+            }
+
+            current = static_cast<T>(static_cast<unsigned_type>(current) + static_cast<unsigned_type>(delta) + 1);
+        }
+
+        const FrozenDeltaColumn *column = nullptr;
+        std::size_t position = 0;
+        const unsigned char *bytes = nullptr;
+        T current = T();
+    };
+
+    void append(const T &t) {
+        if (count % frozenBlockSize == 0) {
+            firsts.push_back(t);
+            offsets.push_back(deltas.size());
+        } else {
+            auto delta = static_cast<std::uint64_t>(static_cast<unsigned_type>(
+                    static_cast<unsigned_type>(t) - static_cast<unsigned_type>(last) - 1));
+
+            while (delta >= 0x80) {
+                deltas.push_back(static_cast<unsigned char>(delta | 0x80));
+                delta >>= 7;
+            }
+
+            deltas.push_back(static_cast<unsigned char>(delta));
+        }
+
+        last = t;
+        count++;
+    }
+
+    void finish() {
+        firsts.shrink_to_fit();
+        offsets.shrink_to_fit();
+        deltas.shrink_to_fit();
+    }
+
+    T at(std::size_t i) const noexcept {
+        return Cursor(this, i).get();
+    }
+
+    Cursor cursor(std::size_t i) const noexcept {
+        return Cursor(this, i);
+    }
+
+    /**
+     * Binary search over the first entries of blocks, then a walk within one block.
+     *
+     * @return - cursor at the first entry not less than t.
+     */
+    Cursor lowerBound(const T &t) const noexcept {
+        auto block = static_cast<std::size_t>(std::upper_bound(firsts.begin(), firsts.end(), t) - firsts.begin());
+
+        if (block == 0) {
+            return Cursor(this, 0);
+        }
+
+        Cursor cursor(this, (block - 1) * frozenBlockSize);
+
+        while (cursor.index() < count && cursor.get() < t) {
+            cursor.next();
+        }
+
+        return cursor;
+    }
+
+    std::size_t memory() const noexcept {
+        return firsts.capacity() * sizeof(T) + offsets.capacity() * sizeof(std::size_t) + deltas.capacity();
+    }
+
+private:
+    std::vector<T> firsts;
+    std::vector<std::size_t> offsets;
+    std::vector<unsigned char> deltas;
+    std::size_t count = 0;
+    T last = T();
+};
+
+/**
+ * Column of integers compressed with frame of reference: every block keeps its minimum
+ * and the bit width of the largest difference to it, the differences are bit packed,
+ * so any entry is decoded in O(1).
+ *
+ * @tparam T - integral type of the entries
+ */
+template<typename T>
+class FrozenPackedColumn {
+    using unsigned_type = typename std::make_unsigned<T>::type;
+
+public:
+    void append(const T &t) {
+        pending.push_back(t);
+
+        if (pending.size() == frozenBlockSize) {
+            flush();
+        }
+    }
+
+    void finish() {
+        flush();
+        bases.shrink_to_fit();
+        widths.shrink_to_fit();
+        starts.shrink_to_fit();
+        words.shrink_to_fit();
+        pending = std::vector<T>();
+    }
+
+    T at(std::size_t i) const noexcept {
+        std::size_t block = i / frozenBlockSize;
+        std::uint64_t difference = FrozenPackedInts::get(words, starts[block] + (i % frozenBlockSize) * widths[block],
+                                                         widths[block]);
+
+        return static_cast<T>(static_cast<unsigned_type>(bases[block]) + static_cast<unsigned_type>(difference));
+    }
+
+    std::size_t memory() const noexcept {
+        return bases.capacity() * sizeof(T) + widths.capacity() + starts.capacity() * sizeof(std::size_t) +
+               words.capacity() * sizeof(std::uint64_t);
+    }
+
+private:
+    static std::uint64_t differenceOf(const T &t, const T &base) noexcept {
+        return static_cast<std::uint64_t>(static_cast<unsigned_type>(
+                static_cast<unsigned_type>(t) - static_cast<unsigned_type>(base)));
+    }
+
+    void flush() {
+        if (pending.empty()) {
+            return;
+        }
+
+        T base = *std::min_element(pending.begin(), pending.end());
+        std::uint64_t largest = 0;
+
+        for (const T &t : pending) {
+            largest = std::max(largest, differenceOf(t, base));
+        }
+
+        unsigned width = FrozenPackedInts::widthOf(largest);
+        bases.push_back(base);
+        widths.push_back(static_cast<unsigned char>(width));
+        starts.push_back(bits);
+
+        for (const T &t : pending) {
+            FrozenPackedInts::append(words, bits, differenceOf(t, base), width);
+            bits += width;
+        }
+
+        pending.clear();
+    }
+
+    std::vector<T> bases;
+    std::vector<unsigned char> widths;
+    std::vector<std::size_t> starts;
+    std::vector<std::uint64_t> words;
+    std::size_t bits = 0;
+    std::vector<T> pending;
+};
+
+/*********************************FROZEN_FUNCTION_MAXIMA*********************************/
+
+/**
+ * Immutable compact snapshot of a FunctionMaxima for functions which are only read.
+ * Points are kept in argument order in two columns instead of two multisets of nodes:
+ * integral arguments are delta and varint encoded, integral values are compressed
+ * with frame of reference in blocks of frozenBlockSize points, other types are stored in plain arrays.
+ * Maxima are kept as bit packed positions of points in the order of FunctionMaxima::mx_iterator.
+ * value_at() and find() take a binary search over blocks and a walk within one block,
+ * iteration decodes points one by one.
+ *
+ * Values are decoded on access, so value_at() and point_type return copies
+ * and iterators return point_type by value.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ */
+template<typename A, typename V>
+class FrozenFunctionMaxima {
+public:
+    class point_type;
+
+    class iterator;
+
+    class mx_iterator;
+
+    using size_type = std::size_t;
+
+    using function_type = FunctionMaxima<A, V>;
+
+    FrozenFunctionMaxima() = default;
+
+    explicit FrozenFunctionMaxima(const function_type &fun);
+
+    function_type thaw() const;
+
+    V value_at(A const &a) const;
+
+    bool contains(A const &a) const;
+
+    iterator begin() const noexcept;
+
+    iterator end() const noexcept;
+
+    iterator find(A const &a) const;
+
+    mx_iterator mx_begin() const noexcept;
+
+    mx_iterator mx_end() const noexcept;
+
+    size_type size() const noexcept;
+
+    size_type memory_usage() const noexcept;
+
+private:
+    using argument_column = typename std::conditional<frozenCompressible<A>, FrozenDeltaColumn<A>,
+            FrozenPlainColumn<A>>::type;
+    using value_column = typename std::conditional<frozenCompressible<V>, FrozenPackedColumn<V>,
+            FrozenPlainColumn<V>>::type;
+
+    size_type maximumAt(size_type rank) const noexcept {
+        return static_cast<size_type>(FrozenPackedInts::get(maximaPositions, rank * positionWidth, positionWidth));
+    }
+
+    size_type count = 0;
+    argument_column arguments;
+    value_column values;
+    size_type maximaCount = 0;
+    unsigned positionWidth = 0;
+    std::vector<std::uint64_t> maximaPositions;
+};
+
+/**
+ * Freezes the given function, see FrozenFunctionMaxima.
+ */
+template<typename A, typename V>
+FrozenFunctionMaxima<A, V> freeze(const FunctionMaxima<A, V> &fun) {
+    return FrozenFunctionMaxima<A, V>(fun);
+}
+
+/*********************************FROZEN_POINT_TYPE*********************************/
+
+template<typename A, typename V>
+class FrozenFunctionMaxima<A, V>::point_type {
+public:
+    A const &arg() const noexcept {
+        return argument;
+    }
+
+    V const &value() const noexcept {
+        return point;
+    }
+
+private:
+    friend class FrozenFunctionMaxima<A, V>;
+
+    point_type(const A &argument, const V &point) : argument(argument), point(point) {}
+
+    A argument;
+    V point;
+};
+
+/*********************************FROZEN_ITERATORS*********************************/
+
+/**
+ * Iterator over points in argument order. Points are decoded on every dereference and returned by value,
+ * so to the standard library it is an input iterator (a forward one to C++20 ranges).
+ */
+template<typename A, typename V>
+class FrozenFunctionMaxima<A, V>::iterator {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using iterator_concept = std::forward_iterator_tag;
+    using value_type = point_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = MaximaArrowProxy<point_type>;
+    using reference = point_type;
+
+    iterator() noexcept = default;
+
+    reference operator*() const {
+        return point_type(cursor.get(), fun->values.at(cursor.index()));
+    }
+
+    pointer operator->() const {
+        return pointer(**this);
+    }
+
+    iterator &operator++() noexcept {
+        cursor.next();
+
+        return *this;
+    }
+
+    iterator operator++(int) noexcept {
+        iterator result = *this;
+        cursor.next();
+
+        return result;
+    }
+
+    bool operator==(const iterator &rhs) const noexcept {
+        return fun == rhs.fun && cursor.index() == rhs.cursor.index();
+    }
+
+    bool operator!=(const iterator &rhs) const noexcept {
+        return !(*this == rhs);
+    }
+
+private:
+    friend class FrozenFunctionMaxima<A, V>;
+
+    using cursor_type = typename argument_column::Cursor;
+
+    iterator(const FrozenFunctionMaxima *fun, cursor_type cursor) noexcept : fun(fun), cursor(cursor) {}
+
+    const FrozenFunctionMaxima *fun = nullptr;
+    cursor_type cursor;
+};
+
+/**
+ * Iterator over maxima in the order of FunctionMaxima::mx_iterator. It returns decoded points by value
+ * like iterator, so it is an input iterator to the standard library (a bidirectional one to C++20 ranges).
+ */
+template<typename A, typename V>
+class FrozenFunctionMaxima<A, V>::mx_iterator {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using iterator_concept = std::bidirectional_iterator_tag;
+    using value_type = point_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = MaximaArrowProxy<point_type>;
+    using reference = point_type;
+
+    mx_iterator() noexcept = default;
+
+    reference operator*() const {
+        size_type position = fun->maximumAt(rank);
+
+        return point_type(fun->arguments.at(position), fun->values.at(position));
+    }
+
+    pointer operator->() const {
+        return pointer(**this);
+    }
+
+    mx_iterator &operator++() noexcept {
+        ++rank;
+
+        return *this;
+    }
+
+    mx_iterator operator++(int) noexcept {
+        mx_iterator result = *this;
+        ++rank;
+
+        return result;
+    }
+
+    mx_iterator &operator--() noexcept {
+        --rank;
+
+        return *this;
+    }
+
+    mx_iterator operator--(int) noexcept {
+        mx_iterator result = *this;
+        --rank;
+
+        return result;
+    }
+
+    bool operator==(const mx_iterator &rhs) const noexcept {
+        return fun == rhs.fun && rank == rhs.rank;
+    }
+
+    bool operator!=(const mx_iterator &rhs) const noexcept {
+        return !(*this == rhs);
+    }
+
+private:
+    friend class FrozenFunctionMaxima<A, V>;
+
+    mx_iterator(const FrozenFunctionMaxima *fun, size_type rank) noexcept : fun(fun), rank(rank) {}
+
+    const FrozenFunctionMaxima *fun = nullptr;
+    size_type rank = 0;
+};
+
+/*********************************FROZEN_FUNCTION_MAXIMA_DEFINITIONS*********************************/
+
+/**
+ * Encodes points and maxima of fun in one pass over each, O(n log n) for the position lookups of maxima.
+ * Function has strong guarantee: only the object being constructed is modified.
+ *
+ * @tparam A   - type of the domain values
+ * @tparam V   - type of the range values
+ * @param fun  - function to be frozen
+ */
+template<typename A, typename V>
+FrozenFunctionMaxima<A, V>::FrozenFunctionMaxima(const function_type &fun) : count(fun.size()) {
+    for (const auto &p : fun) {
+        arguments.append(p.arg());
+        values.append(p.value());
+    }
+
+    arguments.finish();
+    values.finish();
+
+    std::vector<A> keys;
+    std::vector<size_type> positions;
+
+    for (auto it = fun.mx_begin(); it != fun.mx_end(); ++it) {
+        keys.push_back(it->arg());
+    }
+
+    std::vector<size_type> byArgument(keys.size());
+
+    for (size_type i = 0; i < byArgument.size(); i++) {
+        byArgument[i] = i;
+    }
+
+    std::sort(byArgument.begin(), byArgument.end(), [&keys](size_type i, size_type j) {
+        return keys[i] < keys[j];
+    });
+
+    positions.resize(keys.size());
+    auto cursor = arguments.cursor(0);
+
+    for (size_type i : byArgument) {
+        while (cursor.get() < keys[i]) {
+            cursor.next();
+        }
+
+        positions[i] = cursor.index();
+    }
+
+    maximaCount = positions.size();
+    positionWidth = FrozenPackedInts::widthOf(count == 0 ? 0 : count - 1);
+    size_type bits = 0;
+
+    for (size_type position : positions) {
+        FrozenPackedInts::append(maximaPositions, bits, position, positionWidth);
+        bits += positionWidth;
+    }
+
+    maximaPositions.shrink_to_fit();
+}
+
+/**
+ * Builds a mutable function with the same points with one bulk assign().
+ *
+ * @return - FunctionMaxima equal to the frozen one.
+ */
+template<typename A, typename V>
+typename FrozenFunctionMaxima<A, V>::function_type FrozenFunctionMaxima<A, V>::thaw() const {
+    std::vector<std::pair<A, V>> points;
+    points.reserve(count);
+
+    for (const point_type &p : *this) {
+        points.emplace_back(p.arg(), p.value());
+    }
+
+    function_type result;
+    result.assign(points.begin(), points.end());
+
+    return result;
+}
+
+/**
+ * Throws InvalidArg if the argument has no value.
+ *
+ * @param a - argument to be searched
+ * @return  - copy of the value of the found argument.
+ */
+template<typename A, typename V>
+V FrozenFunctionMaxima<A, V>::value_at(const A &a) const {
+    iterator it = find(a);
+
+    if (it == end()) {
+        throw InvalidArg("invalid argument value");
+    }
+
+    return values.at(it.cursor.index());
+}
+
+template<typename A, typename V>
+bool FrozenFunctionMaxima<A, V>::contains(const A &a) const {
+    return find(a) != end();
+}
+
+template<typename A, typename V>
+typename FrozenFunctionMaxima<A, V>::iterator FrozenFunctionMaxima<A, V>::begin() const noexcept {
+    return iterator(this, arguments.cursor(0));
+}
+
+template<typename A, typename V>
+typename FrozenFunctionMaxima<A, V>::iterator FrozenFunctionMaxima<A, V>::end() const noexcept {
+    return iterator(this, arguments.cursor(count));
+}
+
+/**
+ * @param a - argument to be searched
+ * @return  - iterator to the point with argument a or end() if there is none.
+ */
+template<typename A, typename V>
+typename FrozenFunctionMaxima<A, V>::iterator FrozenFunctionMaxima<A, V>::find(const A &a) const {
+    auto cursor = arguments.lowerBound(a);
+
+    if (cursor.index() == count || a < cursor.get()) {
+        return end();
+    }
+
+    return iterator(this, cursor);
+}
+
+template<typename A, typename V>
+typename FrozenFunctionMaxima<A, V>::mx_iterator FrozenFunctionMaxima<A, V>::mx_begin() const noexcept {
+    return mx_iterator(this, 0);
+}
+
+template<typename A, typename V>
+typename FrozenFunctionMaxima<A, V>::mx_iterator FrozenFunctionMaxima<A, V>::mx_end() const noexcept {
+    return mx_iterator(this, maximaCount);
+}
+
+template<typename A, typename V>
+typename FrozenFunctionMaxima<A, V>::size_type FrozenFunctionMaxima<A, V>::size() const noexcept {
+    return count;
+}
+
+/**
+ * @return - number of bytes taken by the object and its heap storage.
+ */
+template<typename A, typename V>
+typename FrozenFunctionMaxima<A, V>::size_type FrozenFunctionMaxima<A, V>::memory_usage() const noexcept {
+    return sizeof(*this) + arguments.memory() + values.memory() + maximaPositions.capacity() * sizeof(std::uint64_t);
+}
+
+#endif //MAXIMA_FROZEN_FUNCTION_MAXIMA_H
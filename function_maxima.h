@@ -1,10 +1,21 @@
 #ifndef MAXIMA_FUNCTION_MAXIMA_H
 #define MAXIMA_FUNCTION_MAXIMA_H
 
+#include <atomic>
+#include <cstdint>
 #include <map>
 #include <set>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "maxima_kernel.h"
 
 /*********************************INVALID_ARG*********************************/
 
@@ -20,6 +31,99 @@ private:
     const char *errorMessage;
 };
 
+/*********************************MERGE_POLICY*********************************/
+
+/**
+ * Decides which point is kept by FunctionMaxima::merge() when both functions have a point
+ * with the same argument. If both values are equal, the point of the left function
+ * (the one merge() is called on) is kept regardless of the policy.
+ */
+enum class MergePolicy {
+    preferLeft,
+    preferRight,
+    takeMax
+};
+
+/*********************************MAXIMA_STATS*********************************/
+
+/**
+ * Counters of events on the hot paths of FunctionMaxima, see FunctionMaxima::stats().
+ */
+struct MaximaStats {
+    std::uint64_t pointComparisons = 0;
+    std::uint64_t maximaComparisons = 0;
+    std::uint64_t allocations = 0;
+    std::uint64_t rollbacks = 0;
+    std::uint64_t maximaInsertions = 0;
+    std::uint64_t maximaErasures = 0;
+    std::uint64_t neighbourWalks = 0;
+};
+
+/**
+ * Statistics policy of FunctionMaxima. Events are counted only if MAXIMA_STATS is defined
+ * (the same way in every translation unit) before this header is included,
+ * otherwise count() compiles to nothing and snapshot() returns zeros.
+ * Counters are shared by all functions of one instantiation (Tag) and updated with relaxed atomics,
+ * so events of worker threads of the parallel assign() are counted as well.
+ *
+ * @tparam Tag - type whose events are counted
+ */
+template<typename Tag>
+class MaximaStatsRecorder {
+public:
+#ifdef MAXIMA_STATS
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    enum Event {
+        pointComparison,
+        maximaComparison,
+        allocation,
+        rollback,
+        maximaInsertion,
+        maximaErasure,
+        neighbourWalk,
+        eventCount
+    };
+
+    static void count(Event event, std::uint64_t n = 1) noexcept {
+        if constexpr (enabled) {
+            counters[event].fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+
+    static MaximaStats snapshot() noexcept {
+        MaximaStats result;
+
+        if constexpr (enabled) {
+            result.pointComparisons = load(pointComparison);
+            result.maximaComparisons = load(maximaComparison);
+            result.allocations = load(allocation);
+            result.rollbacks = load(rollback);
+            result.maximaInsertions = load(maximaInsertion);
+            result.maximaErasures = load(maximaErasure);
+            result.neighbourWalks = load(neighbourWalk);
+        }
+
+        return result;
+    }
+
+    static void reset() noexcept {
+        for (auto &counter : counters) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    static std::uint64_t load(Event event) noexcept {
+        return counters[event].load(std::memory_order_relaxed);
+    }
+
+    static inline std::atomic<std::uint64_t> counters[eventCount];
+};
+
 /*********************************FUNCTION_MAXIMA*********************************/
 
 template<typename A, typename V>
@@ -27,10 +131,13 @@ class FunctionMaxima {
 public:
     class point_type;
 
+    class mx_iterator;
+
+    class transaction;
+
     using size_type = std::size_t;
 
     using iterator = typename std::multiset<point_type>::iterator;
-    using mx_iterator = typename std::multiset<point_type>::iterator;
 
     explicit FunctionMaxima();
 
@@ -63,8 +170,20 @@ public:
 
     V const &value_at(A const &a) const;
 
+    V const *try_value_at(A const &a) const noexcept(nothrowComparisons);
+
+    bool contains(A const &a) const noexcept(nothrowComparisons);
+
+    template<typename KeyIt, typename OutIt>
+    OutIt values_at(KeyIt first, KeyIt last, OutIt out) const;
+
+    template<typename KeyIt, typename OutIt>
+    OutIt values_at_unsorted(KeyIt first, KeyIt last, OutIt out) const;
+
     void set_value(A const &a, V const &v);
 
+    void set_value(iterator hint, A const &a, V const &v);
+
     void erase(A const &a);
 
     iterator begin() const noexcept;
@@ -73,15 +192,67 @@ public:
 
     iterator find(A const &a) const;
 
-    mx_iterator mx_begin() const noexcept;
+    mx_iterator mx_begin() const;
 
-    mx_iterator mx_end() const noexcept;
+    mx_iterator mx_end() const;
 
     size_type size() const noexcept;
 
+    template<typename InputIt>
+    void assign(InputIt first, InputIt last);
+
+    template<typename InputIt>
+    void assign(InputIt first, InputIt last, size_type threads);
+
+    void merge(const FunctionMaxima &other, MergePolicy policy);
+
+    void merge(FunctionMaxima &&other, MergePolicy policy);
+
+    FunctionMaxima split_at(A const &a);
+
+    void join(const FunctionMaxima &other);
+
+    void join(FunctionMaxima &&other);
+
+    void enable_hash_index();
+
+    void enable_hash_index(std::function<std::size_t(A const &)> hasher);
+
+    void disable_hash_index() noexcept;
+
+    bool has_hash_index() const noexcept;
+
+    void enable_lazy_maxima() noexcept;
+
+    void disable_lazy_maxima();
+
+    bool has_lazy_maxima() const noexcept;
+
+    static MaximaStats stats() noexcept;
+
+    static void reset_stats() noexcept;
+
 private:
     class Impl;
 
+    using Stats = MaximaStatsRecorder<FunctionMaxima>;
+
+    /**
+     * True if comparisons of A and V can not throw.
+     * Nodes of such functions can be moved between multisets without any risk of a failure halfway.
+     */
+    static constexpr bool nothrowComparisons =
+            noexcept(std::declval<A const &>() < std::declval<A const &>()) &&
+            noexcept(std::declval<V const &>() < std::declval<V const &>());
+
+    /**
+     * True if copies and comparisons of A and V can not throw.
+     * Points of such types are stored inline instead of behind shared_ptr's
+     * and Impl uses lean versions of set_value() and erase() without rollback bookkeeping.
+     */
+    static constexpr bool nothrowTypes =
+            std::is_trivially_copyable<A>::value && std::is_trivially_copyable<V>::value && nothrowComparisons;
+
     std::unique_ptr<Impl> pImpl;
 };
 
@@ -91,11 +262,19 @@ template<typename A, typename V>
 class FunctionMaxima<A, V>::point_type {
 public:
     A const &arg() const noexcept {
-        return *argument.get();
+        if constexpr (nothrowTypes) {
+            return argument;
+        } else {
+            return *argument.get();
+        }
     }
 
     V const &value() const noexcept {
-        return *point.get();
+        if constexpr (nothrowTypes) {
+            return point;
+        } else {
+            return *point.get();
+        }
     }
 
     point_type(const point_type &rhs) = default;
@@ -106,13 +285,36 @@ private:
      */
     friend class FunctionMaxima<A, V>::Impl;
 
-    point_type(const A &argument, const V &point) : argument(std::make_shared<A>(argument)),
-                                                    point(std::make_shared<V>(point)) {}
+    /**
+     * Trivially copyable fields are stored inline, other ones are shared between copies of point_type,
+     * which makes copying point_type nothrow in both cases.
+     */
+    template<typename T>
+    using holder_type = std::conditional_t<nothrowTypes, T, std::shared_ptr<T>>;
+
+    template<typename T>
+    static holder_type<T> hold(const T &t) {
+        if constexpr (nothrowTypes) {
+            return t;
+        } else {
+            Stats::count(Stats::allocation);
+
+            return std::make_shared<T>(t);
+        }
+    }
+
+    point_type(const A &argument, const V &point) : argument(hold(argument)), point(hold(point)) {}
 
-    point_type(const A &argument) : argument(std::make_shared<A>(argument)), point(nullptr) {}
+    holder_type<A> argument;
+    holder_type<V> point;
 
-    std::shared_ptr<A> argument;
-    std::shared_ptr<V> point;
+    /**
+     * Maxima membership of a point stored in pointSet, so Impl can tell in O(1) whether a point
+     * is a maximum without searching maximaPointSet. Every operation sets and clears it together
+     * with the commit of the maxima entry (and transactions restore it on rollback), so it is true
+     * exactly for the points with an entry in maximaPointSet (except in lazy mode before a repair).
+     */
+    mutable bool maximum = false;
 };
 
 /*********************************FUNCTION_MAXIMA_IMPL*********************************/
@@ -120,320 +322,2903 @@ private:
 template<typename A, typename V>
 class FunctionMaxima<A, V>::Impl {
 public:
+    friend class FunctionMaxima<A, V>::mx_iterator;
+
     Impl() = default;
 
-    V const &value_at(const A &a) const {
-        point_type toSearch = {a};
+    /**
+     * Finger of the copy is not set, it would point to rhs. Hash index of the copy is built anew.
+     * Maxima entries of rhs point to its own nodes, so the copy enters its nodes in the order of rhs's entries
+     * (see copyMaxima()). If rhs has unrepaired (or lost) maxima, the copy classifies its maxima
+     * from scratch instead, so rhs is not modified. The repair lock of rhs is held while copying,
+     * because copying is a const operation on rhs and may run concurrently with its mx_begin().
+     */
+    Impl(const Impl &rhs) : Impl(rhs, std::unique_lock<std::mutex>(rhs.repairLock)) {}
 
-        auto it = pointSet.find(toSearch);
+    V const &value_at(const A &a) const {
+        auto it = lookup(a);
 
         if (it == pointSet.end()) {
             throw InvalidArg("invalid argument value");
         }
 
-        return ((point_type) *it).value();
+        return it->value();
     }
 
-    void set_value(const A &a, const V &v) {
-        Storage storage = {};
-        bool insertion = false;
+    V const *try_value_at(const A &a) const noexcept(nothrowComparisons) {
+        auto it = lookup(a);
 
-        try {
-            point_type toInsert = {a, v};
-            storage.surrounding.push_back(pointSet.find(toInsert));
+        return it == pointSet.end() ? nullptr : &it->value();
+    }
 
-            if (storage.surrounding[prevMiddle] == pointSet.end()) {
-                findSurrounding(pointSet.insert(toInsert), storage);
-            } else {
-                if (sameValue(toInsert, *storage.surrounding[prevMiddle])) {
-                    return;
-                }
+    bool contains(const A &a) const noexcept(nothrowComparisons) {
+        return lookup(a) != pointSet.end();
+    }
 
-                findSurrounding(storage.surrounding[prevMiddle], storage);
-                storage.surrounding[newMiddle] = pointSet.insert(toInsert);
-            }
+    /**
+     * Looks up sorted keys in one forward pass over pointSet. The cursor walks forward from the
+     * previous key; if the next key is not reached within about log2(n) steps (where walking
+     * gets more expensive than a descent), the cursor jumps there with lower_bound().
+     * So each key costs O(min(d, log n)) comparisons for distance d from the previous key.
+     *
+     * @param first - beginning of the range of keys sorted in ascending order
+     * @param last  - end of the range of keys
+     * @param out   - output iterator receiving a pointer to the value or nullptr for every key
+     * @return      - out past the last written pointer.
+     */
+    template<typename KeyIt, typename OutIt>
+    OutIt values_at(KeyIt first, KeyIt last, OutIt out) const {
+        int reach = 1;
 
-            insertion = true;
+        for (size_type n = pointSet.size(); n > 1; n >>= 1) {
+            reach++;
+        }
 
-            updateMaximum(leftmost, left, newMiddle, storage);
-            updateMaximum(newMiddle, right, rightmost, storage);
-            updateMaximum(left, newMiddle, right, storage);
+        iterator cursor = pointSet.begin();
 
-            if (storage.surrounding[prevMiddle] != pointSet.end()) {
-                storage.success.push_back(maximaPointSet.find(*storage.surrounding[prevMiddle]));
+        for (; first != last; ++first) {
+            const A &key = *first;
+            int step = 0;
+
+            while (cursor != pointSet.end() && cursor->arg() < key && step < reach) {
+                ++cursor;
+                step++;
             }
-        }
-        catch (...) {
-            makeRollback(insertion, storage);
 
-            throw;
+            if (step == reach && cursor != pointSet.end() && cursor->arg() < key) {
+                cursor = pointSet.lower_bound(key);
+            }
+
+            bool hit = cursor != pointSet.end() && !(key < cursor->arg());
+            *out = hit ? &cursor->value() : nullptr;
+            ++out;
         }
 
-        makeCommit(storage);
+        return out;
     }
 
-    void erase(const A &a) {
-        Storage storage = {};
-
-        try {
-            point_type toRemove = {a};
-            storage.surrounding.push_back(pointSet.find(toRemove));
-
-            if (storage.surrounding[prevMiddle] == pointSet.end()) {
-                return;
-            }
+    /**
+     * Looks up keys in any order, in groups of lookupGroup. With the hash index the hashes of a group
+     * are computed first and the home slots of all of them are prefetched before the first probe,
+     * so the cache misses of independent probes overlap instead of being paid one after another.
+     * Without it (or for keys the hasher throws on) the keys are looked up one by one with findPoint():
+     * std::multiset gives no access to its nodes level by level, so tree descents cannot be interleaved.
+     *
+     * @param first - beginning of the range of keys (forward iterator)
+     * @param last  - end of the range of keys
+     * @param out   - output iterator receiving a pointer to the value or nullptr for every key
+     * @return      - out past the last written pointer.
+     */
+    template<typename KeyIt, typename OutIt>
+    OutIt values_at_unsorted(KeyIt first, KeyIt last, OutIt out) const {
+        size_t hashes[lookupGroup];
+        bool hashed[lookupGroup];
 
-            findSurrounding(storage.surrounding[prevMiddle], storage);
+        while (first != last) {
+            KeyIt groupBegin = first;
+            size_t group = 0;
 
-            updateMaximum(leftmost, left, right, storage);
-            updateMaximum(left, right, rightmost, storage);
+            for (; group < lookupGroup && first != last; ++first, group++) {
+                hashed[group] = hashIndex && tryHash(*first, hashes[group]);
 
-            if (storage.surrounding[prevMiddle] != pointSet.end()) {
-                storage.success.push_back(maximaPointSet.find(*storage.surrounding[prevMiddle]));
+                if (hashed[group]) {
+                    hashIndex->prefetch(hashes[group]);
+                }
             }
-        }
-        catch (...) {
-            makeRollback(false, storage);
 
-            throw;
+            for (size_t i = 0; i < group; ++groupBegin, i++) {
+                iterator it = hashed[i] ? hashIndex->find(hashes[i], *groupBegin, pointSet.end())
+                                        : findPoint(*groupBegin);
+                *out = it == pointSet.end() ? nullptr : &it->value();
+                ++out;
+            }
         }
 
-        makeCommit(storage);
+        return out;
     }
 
-    FunctionMaxima<A, V>::iterator begin() const noexcept {
-        return pointSet.begin();
+    void set_value(const A &a, const V &v) {
+        setValueAt(locate(a), a, v);
     }
 
-    FunctionMaxima<A, V>::iterator end() const noexcept {
-        return pointSet.end();
+    void set_value(iterator hint, const A &a, const V &v) {
+        setValueAt(locate(hint, a), a, v);
     }
 
-    FunctionMaxima<A, V>::iterator find(A const &a) const {
-        point_type toSearch = {a};
+    void erase(const A &a) {
+        reserveUndo(undoPointsPerWrite, undoMaximaPerWrite);
 
-        return pointSet.find(toSearch);
-    }
+        if (!hashIndex) {
+            return eraseAt(findPoint(a, &fingerNear));
+        }
 
-    FunctionMaxima<A, V>::mx_iterator mx_begin() const noexcept {
-        return maximaPointSet.begin();
-    }
+        size_t hash = hashIndex->hash(a);
+        iterator toRemove = hashIndex->find(hash, a, pointSet.end());
 
-    FunctionMaxima<A, V>::mx_iterator mx_end() const noexcept {
-        return maximaPointSet.end();
+        if (toRemove != pointSet.end()) {
+            if (inTransaction()) {
+                reserveIndex(1);
+            }
+
+            auto *entry = hashIndex->entryOf(hash, toRemove);
+            const point_type *removed = &*toRemove;
+            eraseAt(toRemove);
+            hashIndex->remove(entry);
+            noteIndexed(hash, removed, pointSet.end());
+        }
     }
 
-    size_type size() const noexcept {
-        return pointSet.size();
+    /**
+     * Enables the hash index with the given hasher (replacing the previous one).
+     * Function has strong guarantee: the index is built aside and then installed (nothrow).
+     */
+    void enableHashIndex(std::function<size_t(const A &)> hasher) {
+        auto index = std::make_unique<HashIndex>(std::move(hasher));
+        index->reserve(pointSet.size());
+
+        for (iterator it = pointSet.begin(); it != pointSet.end(); ++it) {
+            index->insert(index->hash(it->arg()), it);
+        }
+
+        hashIndex = std::move(index);
     }
 
-private:
+    void disableHashIndex() noexcept {
+        hashIndex.reset();
+    }
 
-    enum {
-        prevMiddle,
-        newMiddle,
-        left,
-        right,
-        leftmost,
-        rightmost,
-        requiredSpace
-    };
+    bool hasHashIndex() const noexcept {
+        return static_cast<bool>(hashIndex);
+    }
 
     /**
-     * Struct which contains std::vector's with reserved necessary amount of space
-     * for operations in Implementation.
-     * It makes push_back() nothrow (on those vectors).
+     * Empties the hash index (if enabled) of an Impl whose points were all moved away,
+     * keeping the hasher. Function is nothrow.
      */
-    struct Storage {
-        Storage() {
-            success = std::vector<mx_iterator>();
-            rollback = std::vector<mx_iterator>();
-            surrounding = std::vector<iterator>();
-            success.reserve(requiredSpace);
-            rollback.reserve(requiredSpace);
-            surrounding.reserve(requiredSpace);
+    void releaseHashIndex() noexcept {
+        if (hashIndex) {
+            hashIndex->release();
         }
-
-        std::vector<mx_iterator> success;
-        std::vector<mx_iterator> rollback;
-        std::vector<iterator> surrounding;
-    };
+    }
 
     /**
-     * Function is nothrow because it only tries to move given iterator using iterator arithmetic.
-     *
-     * @param it - iterator
-     * @return   - it-- (in terms of iterator arithmetic) or pointSet.end() if it-- is out of set's range.
+     * Adds hash index entries (if enabled) for the points starting at first, one for each of hashes
+     * (from hashesOf()); requires space reserved for them. Function is nothrow.
      */
-    iterator moveItLeft(iterator it) const noexcept {
-        if (it != pointSet.end() && it != pointSet.begin()) {
-            it--;
-        } else {
-            it = pointSet.end();
+    void indexPoints(iterator first, const std::vector<size_t> &hashes) noexcept {
+        for (size_t hash : hashes) {
+            hashIndex->insert(hash, first++);
         }
-
-        return it;
     }
 
     /**
-     * Function is nothrow because it only tries to move given iterator using iterator arithmetic.
-     *
-     * @param it - iterator
-     * @return   - it++ (in terms of iterator arithmetic) or pointSet.end() if it++ is out of set's range.
+     * Rebuilds the hash index (if enabled) after merge(), which moves nodes of both functions
+     * and costs O(n + m) anyway. If rebuilding fails, the index is switched off: lookups stay correct,
+     * only slower, and hasHashIndex() reports the drop.
      */
-    iterator moveItRight(iterator it) const noexcept {
-        if (it != pointSet.end()) {
-            it++;
-        } else {
-            it = pointSet.end();
+    void refreshHashIndex() noexcept {
+        if (!hashIndex) {
+            return;
         }
 
-        return it;
+        try {
+            enableHashIndex(hashIndex->hasher());
+        }
+        catch (...) {
+            hashIndex.reset();
+        }
     }
 
     /**
-     * Function has strong guarantee:
-     * comparing point_types has strong guarantee.
-     *
-     * @param p1 - left point_type operand
-     * @param p2 - right point_type operand
-     * @return   - true if the given point_type operands are the same, otherwise false.
+     * Gives target a hash index with the same hasher if this Impl has one.
+     * Function has strong guarantee.
      */
-    static bool sameValue(const point_type &p1, const point_type &p2) {
-        return (!(p1.value() < p2.value()) && !(p2.value() < p1.value()));
+    void shareHashIndex(Impl &target) const {
+        if (hashIndex) {
+            target.enableHashIndex(hashIndex->hasher());
+        }
+    }
+
+    void enableLazyMaxima() noexcept {
+        lazyMaxima = true;
     }
 
     /**
-     * Function has strong guarantee because it only uses functions with at least strong guarantee:
-     * comparing point_type objects has strong guarantee.
-     *
-     * @param leftIt  - iterator pointing to a point_type object that is lesser
-     *                  and is the closest (in terms of comparing arguments) to *it in pointSet
-     * @param it      - iterator pointing to a point_type object that may be maxima
-     * @param rightIt - iterator pointing to a point_type object that is greater
-     *                  and is the closest (in terms of comparing arguments) to *it in pointSet
-     * @return        - true if it points to a point_type object that is maxima, otherwise false.
+     * Function has strong guarantee: if repairing maxima throws, the lazy mode stays on.
      */
-    bool shouldBeMaximum(const iterator leftIt, const iterator it, const iterator rightIt) const {
-        return (leftIt == pointSet.end() || leftIt->value() < it->value() ||
-                sameValue(*leftIt, *it)) &&
-               (rightIt == pointSet.end() || rightIt->value() < it->value() ||
-                sameValue(*rightIt, *it));
+    void disableLazyMaxima() {
+        repairMaxima();
+        lazyMaxima = false;
+    }
+
+    bool hasLazyMaxima() const noexcept {
+        return lazyMaxima;
     }
 
     /**
-     * Updates maximaPointSet by checking whether point described by middle should be
-     * new maxima and inserts it to the maximaPointSet.
-     * Also updates iterators that should be erased in case of success and rollback
-     * (which are stored in storage).
-     * Function has strong guarantee because it only uses functions with at least strong guarantee:
-     * find() or insert() on std::multiset<point_type> where comparing point_type objects has strong guarantee,
-     * push_back() on std::vector is nothrow if the vector has enough reserved space which is the case here.
-     *
-     * @param left    - description of point that is lesser and is the closest (in terms of comparing arguments) to *it in pointSet
-     * @param middle  - description of point that is being updated
-     * @param right   - description of point that is greater and is the closest (in terms of comparing arguments) to *it in pointSet
-     * @param storage - struct containing necessary data
+     * Position in the undo log a transaction can be rolled back to.
      */
-    void updateMaximum(const size_t left, const size_t middle, const size_t right, Storage &storage) {
-        if (storage.surrounding[middle] == pointSet.end()) {
-            return;
-        }
+    struct Savepoint {
+        size_t points;
+        size_t maxima;
+    };
 
-        auto maximaIt = maximaPointSet.find(*storage.surrounding[middle]);
-        bool checkNew = shouldBeMaximum(storage.surrounding[left],
-                                        storage.surrounding[middle], storage.surrounding[right]);
+    /**
+     * Starts a (possibly nested) transaction. Maxima are repaired first, so the savepoint
+     * never has to restore dirty arguments of the lazy mode.
+     * Function has strong guarantee.
+     */
+    Savepoint beginTransaction() {
+        repairMaxima();
+        undoLog.depth++;
 
-        if (maximaIt != maximaPointSet.end() && !checkNew) {
-            storage.success.push_back(maximaIt);
-        }
+        return {undoLog.points.size(), undoLog.maxima.size()};
+    }
 
-        if (maximaIt == maximaPointSet.end() && checkNew) {
-            storage.rollback.push_back(maximaPointSet.insert(*storage.surrounding[middle]));
+    /**
+     * Keeps the changes made since the savepoint. They stay in the undo log of an enclosing transaction,
+     * the outermost one empties it (destroying the retired nodes).
+     * Function is nothrow.
+     */
+    void commitTransaction() noexcept {
+        if (--undoLog.depth == 0) {
+            undoLog.points.clear();
+            undoLog.maxima.clear();
+            undoLog.unindexed = 0;
         }
     }
 
     /**
-     * Updates content of storage with iterators of neighbours of the middle point.
+     * Undoes the changes made since the savepoint in reverse order: inserted nodes are erased,
+     * retired ones are put back as node handles (so pointers to their points stay valid), maximum flags
+     * and hash index entries restored (into space reserved by reserveIndex() when their removal
+     * was logged). Older changes of a node that was put back use the iterator returned by its insertion,
+     * found by the address of its point. Nothing is compared except when a node is put back,
+     * so it takes O(k log n) for k logged changes, regardless of the size of the function
+     * (plus moves of pointer pairs to keep the put back nodes sorted).
+     * Function is nothrow for nothrowComparisons, otherwise a throwing comparison leaves the remaining
+     * changes in the log and the transaction open, so the rollback can be retried.
+     */
+    void rollbackTransaction(Savepoint savepoint) noexcept(nothrowComparisons) {
+        Stats::count(Stats::rollback);
+
+        finger = pointSet.end();
+        dirty.clear();
+        std::vector<std::pair<const point_type *, iterator>> &points = undoLog.restoredPoints;
+        std::vector<std::pair<const point_type *, maxima_iterator>> &maxima = undoLog.restoredMaxima;
+
+        while (undoLog.points.size() > savepoint.points || undoLog.maxima.size() > savepoint.maxima) {
+            if (undoLog.maxima.size() > savepoint.maxima &&
+                undoLog.maxima.back().points >= undoLog.points.size()) {
+                MaximumChange &change = undoLog.maxima.back();
+
+                if (change.node.empty()) {
+                    maximaPointSet.erase(current(maxima, change.point, change.it));
+                } else {
+                    restored(maxima, change.point, maximaPointSet.insert(std::move(change.node)));
+                }
+
+                undoLog.maxima.pop_back();
+                continue;
+            }
+
+            PointChange &change = undoLog.points.back();
+            iterator it = current(points, change.point, change.it);
+
+            switch (change.kind) {
+                case PointChange::inserted:
+                    pointSet.erase(it);
+                    break;
+                case PointChange::erased:
+                    restored(points, change.point, pointSet.insert(std::move(change.node)));
+                    break;
+                case PointChange::flagged:
+                    it->maximum = false;
+                    break;
+                case PointChange::unflagged:
+                    it->maximum = true;
+                    break;
+                case PointChange::indexed:
+                    undoIndexed(change, it, current(points, change.replaced, pointSet.end()));
+                    break;
+            }
+
+            undoLog.points.pop_back();
+        }
+
+        points.clear();
+        maxima.clear();
+        commitTransaction();
+    }
+
+    /**
+     * Ends a transaction whose rollback failed: the whole undo log is dropped (enclosing transactions
+     * can not restore anything older either) and maxima are classified anew,
+     * so the function is valid again (basic guarantee). If even that fails, they are marked as lost
+     * and rebuilt by the next repairMaxima(). Function is nothrow.
+     */
+    void abandonTransaction() noexcept {
+        undoLog.points.clear();
+        undoLog.maxima.clear();
+        undoLog.restoredPoints.clear();
+        undoLog.restoredMaxima.clear();
+        undoLog.unindexed = 0;
+        commitTransaction();
+        refreshHashIndex();
+
+        try {
+            rebuildMaxima();
+        }
+        catch (...) {
+            maximaLost = true;
+            maximaStale.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    bool inTransaction() const noexcept {
+        return undoLog.depth > 0;
+    }
+
+    /**
+     * Operations that move or rebuild whole sets can not be recorded in the undo log.
+     */
+    void requireNoTransaction() const {
+        if (inTransaction()) {
+            throw InvalidArg("not allowed inside a transaction");
+        }
+    }
+
+    /**
+     * Brings maximaPointSet up to date with the writes recorded in lazy mode.
+     * Only points next to the written arguments (and the written points themselves) can change
+     * their maxima status, so each of them is classified once, in one sorted pass over the dirty arguments.
+     * If the dirty arguments are a big part of the function (or were too many to be recorded,
+     * see recordDirty()), maxima are rebuilt in one linear pass instead
+     * (except inside a transaction, whose undo log could not record a rebuild).
+     * Function has strong guarantee: new maxima entries are journaled and erased if anything throws,
+     * the dirty arguments (possibly reordered) are kept so the repair can be retried,
+     * and outdated entries are erased by iterators only at the end (nothrow).
+     */
+    void repairMaxima() {
+        if (dirty.empty() && !maximaLost && !rebuildPending) {
+            maximaStale.store(false, std::memory_order_release);
+
+            return;
+        }
+
+        if (maximaLost || rebuildPending ||
+            (dirty.size() >= pointSet.size() / lazyRebuildRatio && !inTransaction())) {
+            rebuildMaxima();
+            maximaLost = false;
+            rebuildPending = false;
+            dirty.clear();
+            maximaStale.store(false, std::memory_order_release);
+
+            return;
+        }
+
+        std::sort(dirty.begin(), dirty.end());
+        dirty.erase(std::unique(dirty.begin(), dirty.end(), [](const A &a1, const A &a2) {
+            return !(a1 < a2);
+        }), dirty.end());
+
+        std::vector<iterator> candidates;
+        candidates.reserve(3 * dirty.size());
+
+        auto addCandidate = [this, &candidates](iterator it) {
+            if (it != pointSet.end() && (candidates.empty() || candidates.back()->arg() < it->arg())) {
+                candidates.push_back(it);
+            }
+        };
+
+        for (const A &a : dirty) {
+            iterator next = pointSet.lower_bound(a);
+
+            addCandidate(next == pointSet.begin() ? pointSet.end() : std::prev(next));
+            addCandidate(next);
+
+            if (next != pointSet.end() && !(a < next->arg())) {
+                addCandidate(moveItRight(next));
+            }
+        }
+
+        Journal journal;
+        std::vector<maxima_iterator> demoted;
+        std::vector<unsigned char> statuses;
+        journal.maxima.reserve(candidates.size());
+        demoted.reserve(candidates.size());
+        statuses.reserve(candidates.size());
+
+        try {
+            for (iterator it : candidates) {
+                bool should = shouldBeMaximum(moveItLeft(it), it, moveItRight(it));
+                maxima_iterator entry = findMaximum(it);
+                statuses.push_back(should);
+
+                if (should && entry == maximaPointSet.end()) {
+                    journal.maxima.push_back(maximaPointSet.insert(&*it));
+                    Stats::count(Stats::maximaInsertion);
+                } else if (!should && entry != maximaPointSet.end()) {
+                    demoted.push_back(entry);
+                }
+            }
+
+            reserveUndo(candidates.size(), journal.maxima.size() + demoted.size());
+        }
+        catch (...) {
+            undo(journal);
+
+            throw;
+        }
+
+        for (maxima_iterator entry : journal.maxima) {
+            noteMaximum(entry);
+        }
+
+        for (maxima_iterator entry : demoted) {
+            eraseMaximum(entry);
+        }
+
+        for (size_t i = 0; i < candidates.size(); i++) {
+            markMaximum(candidates[i], statuses[i]);
+        }
+
+        dirty.clear();
+        maximaStale.store(false, std::memory_order_release);
+    }
+
+    /**
+     * repairMaxima() for the const mx_begin() and mx_end(), which may be called concurrently:
+     * the first caller to find maxima stale repairs them under repairLock, the others wait for it
+     * and then find nothing to repair. Up-to-date maxima cost one atomic load.
+     * Function has strong guarantee.
+     */
+    void repairShared() {
+        if (maximaStale.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> guard(repairLock);
+            repairMaxima();
+        }
+    }
+
+    /**
+     * Body of erase() once the point is found.
+     *
+     * @param toRemove - point to be erased or pointSet.end() if there is none
+     */
+    void eraseAt(iterator toRemove) {
+        if (lazyMaxima) {
+            return eraseLazy(toRemove);
+        }
+
+        if constexpr (nothrowTypes) {
+            return eraseNothrow(toRemove);
+        }
+
+        Storage storage = {};
+
+        try {
+            storage.surrounding.push_back(toRemove);
+
+            if (storage.surrounding[prevMiddle] == pointSet.end()) {
+                return;
+            }
+
+            findSurrounding(storage.surrounding[prevMiddle], storage);
+
+            updateMaximum(leftmost, left, right, storage);
+            updateMaximum(left, right, rightmost, storage);
+
+            if (storage.surrounding[prevMiddle] != pointSet.end()) {
+                storage.success.push_back({findMaximum(storage.surrounding[prevMiddle]), pointSet.end()});
+            }
+        }
+        catch (...) {
+            makeRollback(false, storage);
+
+            throw;
+        }
+
+        makeCommit(storage);
+        finger = storage.surrounding[right] != pointSet.end() ? storage.surrounding[right]
+                                                               : storage.surrounding[left];
+    }
+
+    FunctionMaxima<A, V>::iterator begin() const noexcept {
+        return pointSet.begin();
+    }
+
+    FunctionMaxima<A, V>::iterator end() const noexcept {
+        return pointSet.end();
+    }
+
+    FunctionMaxima<A, V>::iterator find(A const &a) const {
+        return lookup(a);
+    }
+
+    FunctionMaxima<A, V>::mx_iterator mx_begin() {
+        repairShared();
+
+        return FunctionMaxima<A, V>::mx_iterator(maximaPointSet.begin());
+    }
+
+    FunctionMaxima<A, V>::mx_iterator mx_end() {
+        repairShared();
+
+        return FunctionMaxima<A, V>::mx_iterator(maximaPointSet.end());
+    }
+
+    size_type size() const noexcept {
+        return pointSet.size();
+    }
+
+    /**
+     * Fills an empty Impl with the given (argument, value) pairs.
+     * The result is the same as after calling set_value() for the pairs in the given order:
+     * pairs are stably sorted by arguments, a later pair with a repeated argument replaces
+     * an earlier one only if its value differs, points are appended to pointSet
+     * with end() as a hint and maxima are classified in one pass.
+     * With more than one thread, sorting, classification and node allocation are split into
+     * chunks processed in parallel; nodes built by the workers are then spliced into pointSet
+     * and entries of maximaPointSet (pointing to those nodes) in order (no allocation, no comparisons of values).
+     *
+     * @param first   - beginning of the range of pairs
+     * @param last    - end of the range of pairs
+     * @param threads - number of threads to use
+     */
+    template<typename InputIt>
+    void assign(InputIt first, InputIt last, size_t threads) {
+        std::vector<point_type> points;
+
+        for (; first != last; ++first) {
+            points.push_back(point_type((*first).first, (*first).second));
+        }
+
+        std::vector<const point_type *> order;
+        order.reserve(points.size());
+
+        for (const point_type &p : points) {
+            order.push_back(&p);
+        }
+
+        parallelSort(order, [](const point_type *p1, const point_type *p2) {
+            return pointSetCmp()(*p1, *p2);
+        }, threads);
+
+        if (!order.empty()) {
+            auto kept = order.begin();
+
+            for (auto it = std::next(kept); it != order.end(); ++it) {
+                if ((*kept)->arg() < (*it)->arg()) {
+                    *++kept = *it;
+                } else if (!sameValue(**kept, **it)) {
+                    *kept = *it;
+                }
+            }
+
+            order.erase(std::next(kept), order.end());
+        }
+
+        std::vector<unsigned char> mask(order.size());
+        std::vector<const point_type *> nodes(order.size());
+        size_t chunks = chunkCount(order.size(), threads);
+        std::vector<std::multiset<point_type, pointSetCmp>> pointChunks(chunks);
+
+        parallelFor(chunks, [&](size_t chunk) {
+            size_t chunkBegin = chunkBound(order.size(), chunks, chunk);
+            size_t chunkEnd = chunkBound(order.size(), chunks, chunk + 1);
+
+            classify(order, chunkBegin, chunkEnd, mask.data());
+
+            for (size_t i = chunkBegin; i < chunkEnd; i++) {
+                iterator node = pointChunks[chunk].insert(pointChunks[chunk].end(), *order[i]);
+                node->maximum = mask[i];
+                nodes[i] = &*node;
+            }
+        });
+
+        std::vector<const point_type *> maxima;
+
+        for (size_t i = 0; i < order.size(); i++) {
+            if (mask[i]) {
+                maxima.push_back(nodes[i]);
+            }
+        }
+
+        auto rebuilt = buildMaxima(maxima, threads);
+
+        for (auto &chunk : pointChunks) {
+            while (!chunk.empty()) {
+                pointSet.insert(pointSet.end(), chunk.extract(chunk.begin()));
+            }
+        }
+
+        maximaPointSet.swap(rebuilt);
+    }
+
+    /**
+     * Merges points of other into this Impl, moving other's nodes instead of allocating new ones.
+     * First both sorted sequences are walked once without modifying anything. The walk decides
+     * which point wins every conflict and finds the points whose neighbours differ from their
+     * neighbours in the source function (or that replaced another point); only those points
+     * get their maximum status recomputed. Then other's nodes are spliced into pointSet
+     * (hinted by the position found during the walk) and its maxima entries into maximaPointSet.
+     * Function has strong guarantee with respect to this Impl: every insertion is recorded
+     * and undone by erasing by iterator (nothrow) if something throws, and the final commit only erases.
+     * other is left empty; if an exception is thrown it is left unchanged or, if splicing has already begun, empty.
+     *
+     * @param other  - Impl whose points are moved into this one
+     * @param policy - decides which point is kept when both Impls have the same argument
+     */
+    void merge(Impl &other, MergePolicy policy) {
+        requireNoTransaction();
+        other.requireNoTransaction();
+        repairMaxima();
+        other.repairMaxima();
+        dropFingers(other);
+
+        struct Step {
+            iterator source;
+            iterator hint;
+            bool fromOther;
+        };
+
+        std::vector<Step> merged;
+        std::vector<iterator> losers[2];
+        merged.reserve(pointSet.size() + other.pointSet.size());
+
+        iterator mine = pointSet.begin();
+        iterator theirs = other.pointSet.begin();
+
+        while (mine != pointSet.end() || theirs != other.pointSet.end()) {
+            if (theirs == other.pointSet.end() || (mine != pointSet.end() && mine->arg() < theirs->arg())) {
+                merged.push_back({mine++, pointSet.end(), false});
+            } else if (mine == pointSet.end() || theirs->arg() < mine->arg()) {
+                merged.push_back({theirs++, mine, true});
+            } else if (otherWins(*mine, *theirs, policy)) {
+                losers[0].push_back(mine);
+                merged.push_back({theirs++, mine++, true});
+            } else {
+                losers[1].push_back(theirs++);
+                merged.push_back({mine++, pointSet.end(), false});
+            }
+        }
+
+        std::vector<maxima_iterator> outdated[2];
+        std::vector<const point_type *> fresh;
+        std::vector<const point_type *> demoted;
+
+        for (size_t i = 0; i < merged.size(); i++) {
+            const Impl &source = merged[i].fromOther ? other : *this;
+            const point_type *prev = i > 0 ? &*merged[i - 1].source : nullptr;
+            const point_type *next = i + 1 < merged.size() ? &*merged[i + 1].source : nullptr;
+
+            if (prev == source.pointOrNull(source.moveItLeft(merged[i].source)) &&
+                next == source.pointOrNull(source.moveItRight(merged[i].source))) {
+                continue;
+            }
+
+            auto entry = source.findMaximum(merged[i].source);
+            bool isNew = isMaximum(prev, *merged[i].source, next);
+
+            if (entry != source.maximaPointSet.end() && !isNew) {
+                outdated[merged[i].fromOther].push_back(entry);
+                demoted.push_back(&*merged[i].source);
+            } else if (entry == source.maximaPointSet.end() && isNew) {
+                fresh.push_back(&*merged[i].source);
+            }
+        }
+
+        for (int side = 0; side < 2; side++) {
+            const Impl &source = side ? other : *this;
+
+            for (iterator loser : losers[side]) {
+                auto entry = source.findMaximum(loser);
+
+                if (entry != source.maximaPointSet.end()) {
+                    outdated[side].push_back(entry);
+                }
+            }
+        }
+
+        std::vector<iterator> insertedPoints;
+        std::vector<maxima_iterator> insertedMaxima;
+        insertedPoints.reserve(merged.size());
+        insertedMaxima.reserve(other.maximaPointSet.size() + fresh.size());
+
+        for (maxima_iterator entry : outdated[1]) {
+            other.maximaPointSet.erase(entry);
+        }
+
+        try {
+            for (const Step &step : merged) {
+                if (step.fromOther) {
+                    auto node = other.pointSet.extract(step.source);
+                    insertedPoints.push_back(pointSet.insert(step.hint, std::move(node)));
+                }
+            }
+
+            while (!other.maximaPointSet.empty()) {
+                auto node = other.maximaPointSet.extract(other.maximaPointSet.begin());
+                insertedMaxima.push_back(maximaPointSet.insert(std::move(node)));
+            }
+
+            for (const point_type *p : fresh) {
+                insertedMaxima.push_back(maximaPointSet.insert(p));
+            }
+        }
+        catch (...) {
+            for (maxima_iterator entry : insertedMaxima) {
+                maximaPointSet.erase(entry);
+            }
+
+            for (iterator point : insertedPoints) {
+                pointSet.erase(point);
+            }
+
+            other.clear();
+
+            throw;
+        }
+
+        for (maxima_iterator entry : outdated[0]) {
+            maximaPointSet.erase(entry);
+        }
+
+        for (const point_type *p : demoted) {
+            p->maximum = false;
+        }
+
+        for (const point_type *p : fresh) {
+            p->maximum = true;
+        }
+
+        for (iterator loser : losers[0]) {
+            pointSet.erase(loser);
+        }
+
+        other.clear();
+    }
+
+    void clear() noexcept {
+        maximaPointSet.clear();
+        pointSet.clear();
+        finger = pointSet.end();
+        dirty.clear();
+        maximaLost = false;
+        rebuildPending = false;
+        maximaStale.store(false, std::memory_order_relaxed);
+
+        if (hashIndex) {
+            hashIndex->clear();
+        }
+    }
+
+    void swapContent(Impl &other) noexcept {
+        pointSet.swap(other.pointSet);
+        maximaPointSet.swap(other.maximaPointSet);
+        dropFingers(other);
+    }
+
+    /**
+     * Moves points with arguments >= a to target, which has to be empty.
+     * Only the two points at the boundary get their maximum status recomputed.
+     * If comparisons can not throw, nodes of the smaller part are spliced (the bigger part stays in place,
+     * if needed the whole content is swapped first), so the cost is O(min(k, n - k) log n)
+     * for k moved points. Otherwise the moved part is copied into target and erased from
+     * this Impl by iterators only after everything else succeeded, which costs O(k log n) even when
+     * k is most of the function: splicing could not be undone if a later comparison threw.
+     * Hash index entries are moved with the points, so only the moved points are hashed.
+     * Function has strong guarantee.
+     *
+     * @param a      - smallest argument of the moved part
+     * @param target - empty Impl receiving the moved points, with a hash index using the same hasher
+     *                 if this Impl has one
+     */
+    void splitAt(const A &a, Impl &target) {
+        requireNoTransaction();
+        repairMaxima();
+        dropFingers(target);
+
+        iterator boundary = pointSet.lower_bound(a);
+
+        if (boundary == pointSet.end()) {
+            return;
+        }
+
+        if (boundary == pointSet.begin()) {
+            swapIndexedContent(target);
+            return;
+        }
+
+        iterator last = std::prev(boundary);
+        bool lastMaximum = isMaximum(pointOrNull(moveItLeft(last)), *last, nullptr);
+        bool firstMaximum = isMaximum(nullptr, *boundary, pointOrNull(moveItRight(boundary)));
+        maxima_iterator lastEntry = findMaximum(last);
+        maxima_iterator firstEntry = findMaximum(boundary);
+
+        if constexpr (nothrowComparisons) {
+            bool rightSmaller = rightPartSmaller(boundary);
+            std::vector<size_t> hashes = rightSmaller ? hashesOf(boundary, pointSet.end())
+                                                      : hashesOf(pointSet.begin(), boundary);
+
+            if (target.hashIndex) {
+                target.hashIndex->reserve(hashes.size());
+            }
+
+            maxima_set stagedLast, stagedFirst;
+
+            if (lastMaximum && lastEntry == maximaPointSet.end()) {
+                stagedLast.insert(&*last);
+            }
+
+            if (firstMaximum && firstEntry == maximaPointSet.end()) {
+                stagedFirst.insert(&*boundary);
+            }
+
+            if (!lastMaximum) {
+                eraseMaximum(lastEntry);
+            }
+
+            if (!firstMaximum) {
+                eraseMaximum(firstEntry);
+            }
+
+            if (rightSmaller) {
+                spliceRange(*this, boundary, pointSet.end(), target, target.pointSet.end(), hashes);
+            } else {
+                swapIndexedContent(target);
+                spliceRange(target, target.pointSet.begin(), boundary, *this, pointSet.end(), hashes);
+            }
+
+            last->maximum = lastMaximum;
+            boundary->maximum = firstMaximum;
+            maximaPointSet.merge(stagedLast);
+            target.maximaPointSet.merge(stagedFirst);
+        } else {
+            std::vector<size_t> hashes = hashesOf(boundary, pointSet.end());
+            Impl copied;
+            std::vector<maxima_iterator> moved;
+
+            if (target.hashIndex) {
+                target.hashIndex->reserve(hashes.size());
+            }
+
+            for (iterator it = boundary; it != pointSet.end(); ++it) {
+                iterator copy = copied.pointSet.insert(copied.pointSet.end(), *it);
+                maxima_iterator entry = it == boundary ? maximaPointSet.end() : findMaximum(it);
+
+                if (entry != maximaPointSet.end()) {
+                    copied.maximaPointSet.insert(&*copy);
+                    moved.push_back(entry);
+                }
+            }
+
+            copied.pointSet.begin()->maximum = firstMaximum;
+
+            if (firstMaximum) {
+                copied.maximaPointSet.insert(&*copied.pointSet.begin());
+            }
+
+            if (lastMaximum && lastEntry == maximaPointSet.end()) {
+                maximaPointSet.insert(&*last);
+                last->maximum = true;
+            }
+
+            for (maxima_iterator entry : moved) {
+                maximaPointSet.erase(entry);
+            }
+
+            eraseMaximum(firstEntry);
+
+            if (!lastMaximum) {
+                eraseMaximum(lastEntry);
+                last->maximum = false;
+            }
+
+            if (hashIndex) {
+                size_t i = 0;
+
+                for (iterator it = boundary; it != pointSet.end(); ++it) {
+                    hashIndex->remove(hashes[i++], it);
+                }
+            }
+
+            pointSet.erase(boundary, pointSet.end());
+            target.swapContent(copied);
+
+            target.indexPoints(target.pointSet.begin(), hashes);
+        }
+    }
+
+    /**
+     * Appends (or prepends) points of other, whose arguments all have to be greater (or all smaller)
+     * than arguments of this Impl, otherwise InvalidArg is thrown.
+     * Only the two points at the boundary get their maximum status recomputed.
+     * If comparisons can not throw, nodes of the smaller Impl are spliced into the bigger one
+     * (O(min(n, m) log(n + m))). Otherwise points of other are copied and every insertion is recorded,
+     * so it can be undone by erasing by iterator (nothrow); this costs O(m log(n + m)) for m points of other.
+     * With the hash index only the points of other are hashed and get entries (they are always
+     * spliced into this Impl then, O(m log(n + m))); the index of other is emptied.
+     * Function has strong guarantee with respect to this Impl, other is left empty on success.
+     *
+     * @param other - Impl whose points are moved to this one
+     */
+    void join(Impl &other) {
+        requireNoTransaction();
+        other.requireNoTransaction();
+        repairMaxima();
+        other.repairMaxima();
+        dropFingers(other);
+
+        if (other.pointSet.empty()) {
+            return;
+        }
+
+        std::vector<size_t> hashes = hashesOf(other.pointSet.begin(), other.pointSet.end());
+
+        if (hashIndex) {
+            hashIndex->reserve(pointSet.size() + hashes.size());
+        }
+
+        if (pointSet.empty()) {
+            swapContent(other);
+            indexPoints(pointSet.begin(), hashes);
+            other.releaseHashIndex();
+            return;
+        }
+
+        bool append = std::prev(pointSet.end())->arg() < other.pointSet.begin()->arg();
+
+        if (!append && !(std::prev(other.pointSet.end())->arg() < pointSet.begin()->arg())) {
+            throw InvalidArg("overlapping argument ranges");
+        }
+
+        Impl &low = append ? *this : other;
+        Impl &high = append ? other : *this;
+        iterator last = std::prev(low.pointSet.end());
+        iterator first = high.pointSet.begin();
+        bool lastMaximum = isMaximum(low.pointOrNull(low.moveItLeft(last)), *last, &*first);
+        bool firstMaximum = isMaximum(&*last, *first, high.pointOrNull(high.moveItRight(first)));
+        maxima_iterator lastEntry = low.findMaximum(last);
+        maxima_iterator firstEntry = high.findMaximum(first);
+
+        if constexpr (nothrowComparisons) {
+            maxima_set staged;
+
+            if (lastMaximum && lastEntry == low.maximaPointSet.end()) {
+                staged.insert(&*last);
+            }
+
+            if (firstMaximum && firstEntry == high.maximaPointSet.end()) {
+                staged.insert(&*first);
+            }
+
+            if (!lastMaximum) {
+                low.eraseMaximum(lastEntry);
+            }
+
+            if (!firstMaximum) {
+                high.eraseMaximum(firstEntry);
+            }
+
+            Impl &smaller = hashIndex || other.pointSet.size() < pointSet.size() ? other : *this;
+            Impl &bigger = &smaller == this ? other : *this;
+            iterator hint = &smaller == &low ? bigger.pointSet.begin() : bigger.pointSet.end();
+
+            last->maximum = lastMaximum;
+            first->maximum = firstMaximum;
+            other.releaseHashIndex();
+            spliceRange(smaller, smaller.pointSet.begin(), smaller.pointSet.end(), bigger, hint, hashes);
+            bigger.maximaPointSet.merge(staged);
+
+            if (&bigger != this) {
+                swapContent(other);
+            }
+        } else {
+            Journal journal;
+            iterator hint = append ? pointSet.end() : pointSet.begin();
+            iterator ownPoint = append ? last : first;
+            bool ownMaximum = append ? lastMaximum : firstMaximum;
+            bool otherMaximum = append ? firstMaximum : lastMaximum;
+            maxima_iterator ownEntry = append ? lastEntry : firstEntry;
+
+            try {
+                journal.points.reserve(other.pointSet.size());
+                journal.maxima.reserve(other.maximaPointSet.size() + 2);
+
+                for (const point_type &p : other.pointSet) {
+                    journal.points.push_back(pointSet.insert(hint, p));
+                }
+
+                (append ? journal.points.front() : journal.points.back())->maximum = otherMaximum;
+
+                for (iterator copy : journal.points) {
+                    if (copy->maximum) {
+                        journal.maxima.push_back(maximaPointSet.insert(&*copy));
+                    }
+                }
+
+                if (ownMaximum && ownEntry == maximaPointSet.end()) {
+                    journal.maxima.push_back(maximaPointSet.insert(&*ownPoint));
+                    ownPoint->maximum = true;
+                }
+            }
+            catch (...) {
+                undo(journal);
+
+                throw;
+            }
+
+            if (!ownMaximum) {
+                eraseMaximum(ownEntry);
+                ownPoint->maximum = false;
+            }
+
+            for (size_t i = 0; i < hashes.size(); i++) {
+                hashIndex->insert(hashes[i], journal.points[i]);
+            }
+
+            other.clear();
+        }
+    }
+
+    /**
+     * Body of the copy constructor, the unnamed lock holds the repair lock of rhs until it returns.
+     */
+    Impl(const Impl &rhs, std::unique_lock<std::mutex>) : pointSet(rhs.pointSet), lazyMaxima(rhs.lazyMaxima) {
+        if (rhs.dirty.empty() && !rhs.maximaLost && !rhs.rebuildPending) {
+            copyMaxima(rhs);
+        } else {
+            rebuildMaxima();
+        }
+
+        if (rhs.hashIndex) {
+            enableHashIndex(rhs.hashIndex->hasher());
+        }
+    }
+
+    /**
+     * Fills empty maximaPointSet of a copy of rhs (pointSet already copied) with entries of the copied nodes,
+     * in the order of rhs's entries: both pointSets are walked together to pair the nodes of maxima
+     * (by their maximum flags, exact in rhs without pending repairs), the pairs are sorted by the address
+     * of rhs's node, and every entry of rhs is appended with end() as a hint.
+     * Costs O(n + m log m) comparisons of addresses and one comparison of values per entry.
+     * Function has strong guarantee (the Impl is under construction).
+     */
+    void copyMaxima(const Impl &rhs) {
+        std::vector<std::pair<const point_type *, const point_type *>> copies;
+        copies.reserve(rhs.maximaPointSet.size());
+
+        for (auto source = rhs.pointSet.begin(), copy = pointSet.begin(); source != rhs.pointSet.end();
+             ++source, ++copy) {
+            if (source->maximum) {
+                copies.emplace_back(&*source, &*copy);
+            }
+        }
+
+        std::sort(copies.begin(), copies.end(), [](const auto &c1, const auto &c2) {
+            return std::less<const point_type *>()(c1.first, c2.first);
+        });
+
+        for (const point_type *p : rhs.maximaPointSet) {
+            auto copy = std::lower_bound(copies.begin(), copies.end(), p, [](const auto &c, const point_type *q) {
+                return std::less<const point_type *>()(c.first, q);
+            });
+            maximaPointSet.insert(maximaPointSet.end(), copy->second);
+        }
+    }
+
+    /**
+     * Recomputes maximaPointSet from scratch in one pass over pointSet.
+     * Function has strong guarantee: the new maxima are collected in a local multiset
+     * which is swapped with maximaPointSet at the end (nothrow).
+     */
+    void rebuildMaxima() {
+        std::vector<const point_type *> order;
+        order.reserve(pointSet.size());
+
+        for (const point_type &p : pointSet) {
+            order.push_back(&p);
+        }
+
+        std::vector<unsigned char> mask(order.size());
+        classify(order, 0, order.size(), mask.data());
+
+        std::vector<const point_type *> maxima;
+
+        for (size_t i = 0; i < order.size(); i++) {
+            if (mask[i]) {
+                maxima.push_back(order[i]);
+            }
+        }
+
+        auto rebuilt = buildMaxima(maxima, 1);
+        maximaPointSet.swap(rebuilt);
+
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i]->maximum = mask[i];
+        }
+    }
+
+private:
+
+    /**
+     * Comparator for the multiset of all maxima points.
+     */
+    struct maximaPointSetCmp {
+        bool operator()(const point_type *a, const point_type *b) const {
+            Stats::count(Stats::maximaComparison);
+
+            return MaximaValueOrder<V>::maximumBefore(a->value(), a->arg(), b->value(), b->arg());
+        }
+    };
+
+    /**
+     * Maxima are kept as pointers to the nodes of pointSet ordered by values, so an entry
+     * neither copies its point nor shares its holders. Nodes of pointSet are only ever moved
+     * between multisets as node handles, which keeps the pointers valid.
+     */
+    using maxima_set = std::multiset<const point_type *, maximaPointSetCmp>;
+    using maxima_iterator = typename maxima_set::iterator;
+
+    enum {
+        prevMiddle,
+        newMiddle,
+        left,
+        right,
+        leftmost,
+        rightmost,
+        requiredSpace
+    };
+
+    /**
+     * Maxima entry to be erased (in success) or inserted one (in rollback) together with its point,
+     * whose maximum flag is updated on commit (pointSet.end() for a point erased by the commit).
+     */
+    struct MaximumUpdate {
+        maxima_iterator entry;
+        iterator point;
+    };
+
+    /**
+     * Struct which contains std::vector's with reserved necessary amount of space
+     * for operations in Implementation.
+     * It makes push_back() nothrow (on those vectors).
+     */
+    struct Storage {
+        Storage() {
+            success = std::vector<MaximumUpdate>();
+            rollback = std::vector<MaximumUpdate>();
+            surrounding = std::vector<iterator>();
+            success.reserve(requiredSpace);
+            rollback.reserve(requiredSpace);
+            surrounding.reserve(requiredSpace);
+            Stats::count(Stats::allocation, 3);
+        }
+
+        std::vector<MaximumUpdate> success;
+        std::vector<MaximumUpdate> rollback;
+        std::vector<iterator> surrounding;
+    };
+
+    /**
+     * Function is nothrow because it only tries to move given iterator using iterator arithmetic.
+     *
+     * @param it - iterator
+     * @return   - it-- (in terms of iterator arithmetic) or pointSet.end() if it-- is out of set's range.
+     */
+    iterator moveItLeft(iterator it) const noexcept {
+        Stats::count(Stats::neighbourWalk);
+
+        if (it != pointSet.end() && it != pointSet.begin()) {
+            it--;
+        } else {
+            it = pointSet.end();
+        }
+
+        return it;
+    }
+
+    /**
+     * Function is nothrow because it only tries to move given iterator using iterator arithmetic.
+     *
+     * @param it - iterator
+     * @return   - it++ (in terms of iterator arithmetic) or pointSet.end() if it++ is out of set's range.
+     */
+    iterator moveItRight(iterator it) const noexcept {
+        Stats::count(Stats::neighbourWalk);
+
+        if (it != pointSet.end()) {
+            it++;
+        } else {
+            it = pointSet.end();
+        }
+
+        return it;
+    }
+
+    /**
+     * Function has strong guarantee:
+     * comparing point_types has strong guarantee.
+     *
+     * @param p1 - left point_type operand
+     * @param p2 - right point_type operand
+     * @return   - true if the given point_type operands are the same, otherwise false.
+     */
+    static bool sameValue(const point_type &p1, const point_type &p2) {
+        return MaximaValueOrder<V>::same(p1.value(), p2.value());
+    }
+
+    /**
+     * Function has strong guarantee because it only uses functions with at least strong guarantee:
+     * comparing point_type objects has strong guarantee.
+     *
+     * @param leftIt  - iterator pointing to a point_type object that is lesser
+     *                  and is the closest (in terms of comparing arguments) to *it in pointSet
+     * @param it      - iterator pointing to a point_type object that may be maxima
+     * @param rightIt - iterator pointing to a point_type object that is greater
+     *                  and is the closest (in terms of comparing arguments) to *it in pointSet
+     * @return        - true if it points to a point_type object that is maxima, otherwise false.
+     */
+    bool shouldBeMaximum(const iterator leftIt, const iterator it, const iterator rightIt) const {
+        return isMaximum(pointOrNull(leftIt), *it, pointOrNull(rightIt));
+    }
+
+    /**
+     * Updates maximaPointSet by checking whether point described by middle should be
+     * new maxima and inserts it to the maximaPointSet.
+     * Also updates iterators that should be erased in case of success and rollback
+     * (which are stored in storage).
+     * Function has strong guarantee because it only uses functions with at least strong guarantee:
+     * find() or insert() on std::multiset<point_type> where comparing point_type objects has strong guarantee,
+     * push_back() on std::vector is nothrow if the vector has enough reserved space which is the case here.
+     *
+     * @param left    - description of point that is lesser and is the closest (in terms of comparing arguments) to *it in pointSet
+     * @param middle  - description of point that is being updated
+     * @param right   - description of point that is greater and is the closest (in terms of comparing arguments) to *it in pointSet
+     * @param storage - struct containing necessary data
+     */
+    void updateMaximum(const size_t left, const size_t middle, const size_t right, Storage &storage) {
+        if (storage.surrounding[middle] == pointSet.end()) {
+            return;
+        }
+
+        auto maximaIt = findMaximum(storage.surrounding[middle]);
+        bool checkNew = shouldBeMaximum(storage.surrounding[left],
+                                        storage.surrounding[middle], storage.surrounding[right]);
+
+        if (maximaIt != maximaPointSet.end() && !checkNew) {
+            storage.success.push_back({maximaIt, storage.surrounding[middle]});
+        }
+
+        if (maximaIt == maximaPointSet.end() && checkNew) {
+            storage.rollback.push_back({maximaPointSet.insert(&*storage.surrounding[middle]),
+                                        storage.surrounding[middle]});
+            Stats::count(Stats::maximaInsertion);
+        }
+    }
+
+    /**
+     * Updates content of storage with iterators of neighbours of the middle point.
      * Function is nothrow because it uses only nothrow functions:
      * push_back() on std::vector is nothrow if the vector has enough reserved space which is the case here.
      *
-     * @param it      - iterator to the middle point
-     * @param storage - struct containing necessary data
+     * @param it      - iterator to the middle point
+     * @param storage - struct containing necessary data
+     */
+    void findSurrounding(iterator it, Storage &storage) const noexcept {
+        storage.surrounding.push_back(it);
+        storage.surrounding.push_back(moveItLeft(it));
+        storage.surrounding.push_back(moveItRight(it));
+        storage.surrounding.push_back(moveItLeft(storage.surrounding[left]));
+        storage.surrounding.push_back(moveItRight(storage.surrounding[right]));
+    }
+
+    /**
+     * Makes commit in form of erasing outdated points from maximaPointSet
+     * (their iterators are stored in storage), updating maximum flags of the affected points
+     * and erases outdated point from pointSet (is such one exists).
+     * Inside a transaction the inserted maxima are noted and the erased nodes retired to the undo log.
+     * Function is nothrow:
+     * erase on std::multiset<point_type> by iterator is nothrow
+     * and the undo log has space reserved by reserveUndo().
+     *
+     * @param storage - struct containing necessary data
+     */
+    void makeCommit(Storage &storage) noexcept {
+        for (size_t i = 0; i < storage.rollback.size(); i++) {
+            noteMaximum(storage.rollback[i].entry);
+            markMaximum(storage.rollback[i].point, true);
+        }
+
+        for (size_t i = 0; i < storage.success.size(); i++) {
+            eraseMaximum(storage.success[i].entry);
+            markMaximum(storage.success[i].point, false);
+        }
+
+        if (storage.surrounding[prevMiddle] != pointSet.end()) {
+            erasePoint(storage.surrounding[prevMiddle]);
+        }
+    }
+
+    /**
+     * Makes rollback in form of erasing inserted points from maximaPointSet
+     * (their iterators are stored in storage)
+     * and erases inserted point from pointSet (is such one exists).
+     * Function is nothrow:
+     * erase on std::multiset<point_type> by iterator is nothrow.
+     *
+     * @param insertion - bool determining whether insertion to pointSet was made
+     * @param storage   - struct containing necessary data
+     */
+    void makeRollback(const bool insertion, Storage &storage) noexcept {
+        Stats::count(Stats::rollback);
+
+        for (size_t i = 0; i < storage.rollback.size(); i++) {
+            if (storage.rollback[i].entry != maximaPointSet.end()) {
+                maximaPointSet.erase(storage.rollback[i].entry);
+                Stats::count(Stats::maximaErasure);
+            }
+        }
+
+        if (insertion && storage.surrounding[newMiddle] != pointSet.end()) {
+            pointSet.erase(storage.surrounding[newMiddle]);
+        }
+    }
+
+    /**
+     * Insertions made by an operation, so they can be undone.
+     */
+    struct Journal {
+        std::vector<iterator> points;
+        std::vector<maxima_iterator> maxima;
+    };
+
+    /**
+     * Function is nothrow: erase on std::multiset<point_type> by iterator is nothrow.
+     */
+    void undo(Journal &journal) noexcept {
+        for (maxima_iterator entry : journal.maxima) {
+            maximaPointSet.erase(entry);
+        }
+
+        for (iterator point : journal.points) {
+            pointSet.erase(point);
+        }
+    }
+
+    /**
+     * Moves points [first, last) of from, together with their maxima entries, to target before hint.
+     * If hashes (from hashesOf()) are given, hash index entries of the points move with them:
+     * target needs space reserved for them, from may have no index.
+     * Function is nothrow for nothrowComparisons: moving nodes neither allocates nor copies.
+     */
+    static void spliceRange(Impl &from, iterator first, iterator last, Impl &target, iterator hint,
+                            const std::vector<size_t> &hashes = {}) noexcept {
+        for (size_t i = 0; first != last; i++) {
+            iterator it = first++;
+            maxima_iterator entry = from.findMaximum(it);
+
+            if (entry != from.maximaPointSet.end()) {
+                target.maximaPointSet.insert(from.maximaPointSet.extract(entry));
+            }
+
+            if (hashes.empty()) {
+                target.pointSet.insert(hint, from.pointSet.extract(it));
+                continue;
+            }
+
+            if (from.hashIndex) {
+                from.hashIndex->remove(hashes[i], it);
+            }
+
+            target.hashIndex->insert(hashes[i], target.pointSet.insert(hint, from.pointSet.extract(it)));
+        }
+    }
+
+    /**
+     * Swaps pointSet, maximaPointSet and the hash index entries (both Impls have the index or neither,
+     * with the same hasher). Function is nothrow.
+     */
+    void swapIndexedContent(Impl &other) noexcept {
+        swapContent(other);
+
+        if (hashIndex) {
+            hashIndex->swapEntries(*other.hashIndex);
+        }
+    }
+
+    /**
+     * Walks from boundary towards both ends of pointSet at the same pace,
+     * so it takes O(min(k, n - k)) steps.
+     *
+     * @return - true if there are fewer points in [boundary, end) than in [begin, boundary).
+     */
+    bool rightPartSmaller(iterator boundary) const noexcept {
+        iterator forward = boundary;
+        iterator backward = boundary;
+
+        while (true) {
+            if (++forward == pointSet.end()) {
+                return true;
+            }
+
+            if (backward == pointSet.begin()) {
+                return false;
+            }
+
+            --backward;
+        }
+    }
+
+    /**
+     * @return - true if merge() should keep point theirs instead of mine (both have the same argument).
+     */
+    static bool otherWins(const point_type &mine, const point_type &theirs, MergePolicy policy) {
+        switch (policy) {
+            case MergePolicy::preferRight:
+                return !sameValue(mine, theirs);
+            case MergePolicy::takeMax:
+                return mine.value() < theirs.value();
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * Number of hash index probes prefetched together by values_at_unsorted(), enough to keep
+     * the memory system busy with independent misses.
+     */
+    static constexpr size_t lookupGroup = 16;
+
+    /**
+     * Lazy maxima are rebuilt from scratch when at least 1 / lazyRebuildRatio of the points
+     * is dirty: one linear pass is then cheaper than a search per dirty argument.
+     */
+    static constexpr size_t lazyRebuildRatio = 4;
+
+    /**
+     * Upper bounds of undo log entries added by one set_value() or erase():
+     * an inserted and an erased point, three changed flags and an index change,
+     * and up to three inserted and four erased maxima entries.
+     */
+    static constexpr size_t undoPointsPerWrite = 6;
+    static constexpr size_t undoMaximaPerWrite = 7;
+
+    /**
+     * Smallest number of points worth a separate thread in bulk operations.
+     */
+    static constexpr size_t minimalChunk = 1 << 14;
+
+    static size_t chunkCount(size_t n, size_t threads) noexcept {
+        return std::max<size_t>(1, std::min(threads, n / minimalChunk));
+    }
+
+    /**
+     * @return - index of the first element of the given chunk when n elements are split into chunks.
+     */
+    static size_t chunkBound(size_t n, size_t chunks, size_t chunk) noexcept {
+        return n / chunks * chunk + std::min(chunk, n % chunks);
+    }
+
+    /**
+     * Hint that memory at address will be read soon. Does nothing where the compiler has no builtin.
+     */
+    static void prefetch(const void *address) noexcept {
+#if defined(__GNUC__)
+        __builtin_prefetch(address);
+#else
+        (void) address;
+#endif
+    }
+
+    /**
+     * Calls task(i) for every i in [0, tasks), each call in a separate thread
+     * (the last one in the calling thread). All threads are joined before returning,
+     * even if one of the tasks throws or a thread can not be started;
+     * the first exception is then rethrown.
+     *
+     * @param tasks - number of tasks
+     * @param task  - function called with the index of a task
+     */
+    template<typename Task>
+    static void parallelFor(size_t tasks, Task task) {
+        std::vector<std::exception_ptr> errors(tasks);
+        std::vector<std::thread> workers;
+        workers.reserve(tasks);
+
+        auto run = [&errors, &task](size_t i) {
+            try {
+                task(i);
+            }
+            catch (...) {
+                errors[i] = std::current_exception();
+            }
+        };
+
+        try {
+            for (size_t i = 0; i + 1 < tasks; i++) {
+                workers.emplace_back(run, i);
+            }
+        }
+        catch (...) {
+            for (auto &worker : workers) {
+                worker.join();
+            }
+
+            throw;
+        }
+
+        if (tasks > 0) {
+            run(tasks - 1);
+        }
+
+        for (auto &worker : workers) {
+            worker.join();
+        }
+
+        for (auto &error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    /**
+     * Stable sort: chunks are sorted in parallel and then merged pairwise, also in parallel.
+     */
+    template<typename T, typename Compare>
+    static void parallelSort(std::vector<T> &data, Compare cmp, size_t threads) {
+        size_t chunks = chunkCount(data.size(), threads);
+
+        parallelFor(chunks, [&](size_t chunk) {
+            std::stable_sort(data.begin() + chunkBound(data.size(), chunks, chunk),
+                             data.begin() + chunkBound(data.size(), chunks, chunk + 1), cmp);
+        });
+
+        for (size_t width = 1; width < chunks; width *= 2) {
+            parallelFor((chunks + 2 * width - 1) / (2 * width), [&](size_t pair) {
+                size_t first = pair * 2 * width;
+                size_t middle = std::min(first + width, chunks);
+                size_t last = std::min(first + 2 * width, chunks);
+
+                std::inplace_merge(data.begin() + chunkBound(data.size(), chunks, first),
+                                   data.begin() + chunkBound(data.size(), chunks, middle),
+                                   data.begin() + chunkBound(data.size(), chunks, last), cmp);
+            });
+        }
+    }
+
+    /**
+     * Classifies points order[chunkBegin .. chunkEnd) as maxima or not, writing the result to mask.
+     * Points on the chunk boundaries are classified with their neighbours from the adjacent chunks,
+     * so classifying all chunks separately gives the same mask as classifying the whole sequence.
+     * For arithmetic V values are gathered into a contiguous array and classified by MaximaKernel.
+     *
+     * @param order      - points sorted by arguments
+     * @param chunkBegin - first point to classify
+     * @param chunkEnd   - one past the last point to classify
+     * @param mask       - mask of the whole sequence
+     */
+    static void classify(const std::vector<const point_type *> &order, size_t chunkBegin, size_t chunkEnd,
+                         unsigned char *mask) {
+        const point_type *before = chunkBegin > 0 ? order[chunkBegin - 1] : nullptr;
+        const point_type *after = chunkEnd < order.size() ? order[chunkEnd] : nullptr;
+
+        if constexpr (std::is_arithmetic<V>::value) {
+            std::vector<V> values;
+            values.reserve(chunkEnd - chunkBegin);
+
+            for (size_t i = chunkBegin; i < chunkEnd; i++) {
+                values.push_back(order[i]->value());
+            }
+
+            MaximaKernel::maxima_mask(values.data(), values.size(), mask + chunkBegin,
+                                      before ? &before->value() : nullptr, after ? &after->value() : nullptr);
+        } else {
+            for (size_t i = chunkBegin; i < chunkEnd; i++) {
+                mask[i] = isMaximum(i > 0 ? order[i - 1] : nullptr, *order[i],
+                                    i + 1 < order.size() ? order[i + 1] : nullptr);
+            }
+
+            (void) before;
+            (void) after;
+        }
+    }
+
+    /**
+     * Builds a new maxima multiset from the given maxima in any order.
+     */
+    static auto buildMaxima(std::vector<const point_type *> &maxima, size_t threads) {
+        parallelSort(maxima, maximaPointSetCmp(), threads);
+
+        size_t chunks = chunkCount(maxima.size(), threads);
+        std::vector<maxima_set> maximaChunks(chunks);
+
+        parallelFor(chunks, [&](size_t chunk) {
+            size_t chunkEnd = chunkBound(maxima.size(), chunks, chunk + 1);
+
+            for (size_t i = chunkBound(maxima.size(), chunks, chunk); i < chunkEnd; i++) {
+                maximaChunks[chunk].insert(maximaChunks[chunk].end(), maxima[i]);
+            }
+        });
+
+        maxima_set result;
+
+        for (auto &chunk : maximaChunks) {
+            while (!chunk.empty()) {
+                result.insert(result.end(), chunk.extract(chunk.begin()));
+            }
+        }
+
+        return result;
+    }
+
+    /**
+     * Number of steps a search walks from the finger before it gives up and descends from the root.
+     * A step to a neighbour in the tree costs one comparison and usually no cache miss, while a descent
+     * costs about log2 n comparisons with a miss on most of the lower levels, so up to 8 steps are
+     * cheaper than a descent in any function with more than a few hundred points. More steps would
+     * make a failed walk cost more than the descent it precedes in functions that fit in cache.
+     * After a search of set_value() or erase() gave up, searches walk only coldFingerReach steps
+     * until one succeeds again: the immediate neighbours of the finger are still in cache after
+     * an update, so trying them costs almost nothing, and random access patterns then waste
+     * at most two comparisons per search.
+     * The finger follows writes only, see finger.
+     */
+    static constexpr int fingerReach = 8;
+    static constexpr int coldFingerReach = 2;
+
+    /**
+     * Same as pointSet.lower_bound(a), but if the finger is set, it first walks from the finger towards a.
+     * Arguments within reach from the finger are found with d + 1 comparisons for distance d.
+     * Function has strong guarantee: it only compares arguments.
+     *
+     * @param a      - argument to be searched
+     * @param walked - if not nullptr, set to true if the walk found a, false if the tree was searched
+     */
+    iterator lowerBound(const A &a, bool *walked = nullptr) const {
+        iterator it = finger;
+        int reach = fingerNear ? fingerReach : coldFingerReach;
+
+        if (walked != nullptr) {
+            *walked = true;
+        }
+
+        if (it != pointSet.end() && it->arg() < a) {
+            for (int step = 0; step < reach; step++) {
+                if (++it == pointSet.end() || !(it->arg() < a)) {
+                    return it;
+                }
+            }
+        } else if (it != pointSet.end()) {
+            for (int step = 0; step < reach; step++) {
+                if (it == pointSet.begin() || std::prev(it)->arg() < a) {
+                    return it;
+                }
+
+                --it;
+            }
+        }
+
+        if (walked != nullptr) {
+            *walked = false;
+        }
+
+        return pointSet.lower_bound(a);
+    }
+
+    /**
+     * Same as pointSet.find(a), but starts from the finger (see lowerBound()).
+     */
+    iterator findPoint(const A &a, bool *walked = nullptr) const {
+        iterator it = lowerBound(a, walked);
+
+        return (it != pointSet.end() && !(a < it->arg())) ? it : pointSet.end();
+    }
+
+    /**
+     * Exact lookup: through the hash index if it is enabled, otherwise same as findPoint().
+     * If the hasher throws, the point is searched for in pointSet instead, so the lookup
+     * throws only if a comparison does.
+     */
+    iterator lookup(const A &a) const noexcept(nothrowComparisons) {
+        size_t hash;
+
+        if (!hashIndex || !tryHash(a, hash)) {
+            return findPoint(a);
+        }
+
+        return hashIndex->find(hash, a, pointSet.end());
+    }
+
+    /**
+     * Stores the hash of a in hash. Function is nothrow.
+     *
+     * @return - false if the hasher threw.
+     */
+    bool tryHash(const A &a, size_t &hash) const noexcept {
+        try {
+            hash = hashIndex->hash(a);
+
+            return true;
+        }
+        catch (...) {
+            return false;
+        }
+    }
+
+    /**
+     * Hashes of the arguments of points [first, last), in order, for moving their hash index entries
+     * together with the points (empty without the index). Function has strong guarantee.
+     */
+    std::vector<size_t> hashesOf(iterator first, iterator last) const {
+        std::vector<size_t> hashes;
+
+        if (hashIndex) {
+            for (; first != last; ++first) {
+                hashes.push_back(hashIndex->hash(first->arg()));
+            }
+        }
+
+        return hashes;
+    }
+
+    /**
+     * Unsets fingers of this Impl and of other, for operations that move or erase many nodes.
+     */
+    void dropFingers(Impl &other) noexcept {
+        finger = pointSet.end();
+        other.finger = other.pointSet.end();
+    }
+
+    /**
+     * Position of an argument in pointSet.
+     */
+    struct Location {
+        iterator previous; // point with the argument or pointSet.end() if there is none
+        iterator next;     // first point with a greater argument or pointSet.end()
+    };
+
+    /**
+     * Appending a point greater than all others is recognized by one comparison with the last point,
+     * otherwise pointSet is searched once (lowerBound()), not twice (find and upper_bound).
+     * Function has strong guarantee: it only compares arguments.
+     */
+    Location locate(const A &a) {
+        if (pointSet.empty() || std::prev(pointSet.end())->arg() < a) {
+            return {pointSet.end(), pointSet.end()};
+        }
+
+        iterator it = lowerBound(a, &fingerNear);
+
+        if (a < it->arg()) {
+            return {pointSet.end(), it};
+        }
+
+        return {it, std::next(it)};
+    }
+
+    /**
+     * Same as locate(a), but first checks with at most two comparisons whether hint points
+     * to the point with argument a or to the first point with a greater argument.
+     * A wrong hint is ignored.
+     */
+    Location locate(iterator hint, const A &a) {
+        if (hint != pointSet.end() && (hint == pointSet.begin() || std::prev(hint)->arg() < a) &&
+            !(hint->arg() < a)) {
+            if (a < hint->arg()) {
+                return {pointSet.end(), hint};
+            }
+
+            return {hint, std::next(hint)};
+        }
+
+        return locate(a);
+    }
+
+    /**
+     * Body of set_value() once the position of a is known. Keeps the hash index (if enabled)
+     * up to date: the hash of a and space for a new entry are obtained before anything is modified,
+     * and the index is updated after the point is written, which is nothrow
+     * (the entry of a replaced point is found while the point still exists).
+     * writeValue() leaves the finger at the point with argument a.
+     */
+    void setValueAt(Location at, const A &a, const V &v) {
+        reserveUndo(undoPointsPerWrite, undoMaximaPerWrite);
+
+        if (!hashIndex) {
+            return writeValue(at, a, v);
+        }
+
+        size_t hash = hashIndex->hash(a);
+        auto *entry = at.previous == pointSet.end() ? nullptr : hashIndex->entryOf(hash, at.previous);
+        const point_type *previous = pointOrNull(at.previous);
+
+        if (previous == nullptr) {
+            reserveIndex(1);
+        }
+
+        writeValue(at, a, v);
+
+        if (previous == nullptr) {
+            hashIndex->insert(hash, finger);
+        } else if (entry != nullptr) {
+            hashIndex->replace(entry, finger);
+        }
+
+        noteIndexed(hash, previous, finger);
+    }
+
+    /**
+     * Points appended after all others take appendValue(), nothrowTypes take setValueNothrow(),
+     * lazy mode takes writeLazy().
+     * In the remaining case new node is inserted with at.next as a hint.
+     */
+    void writeValue(Location at, const A &a, const V &v) {
+        if (lazyMaxima) {
+            return writeLazy(at, a, v);
+        }
+
+        if (at.previous == pointSet.end() && at.next == pointSet.end()) {
+            return appendValue(a, v);
+        }
+
+        if constexpr (nothrowTypes) {
+            return setValueNothrow(at, a, v);
+        }
+
+        Storage storage = {};
+        bool insertion = false;
+
+        try {
+            point_type toInsert = {a, v};
+            storage.surrounding.push_back(at.previous);
+
+            if (storage.surrounding[prevMiddle] == pointSet.end()) {
+                findSurrounding(pointSet.insert(at.next, toInsert), storage);
+            } else {
+                if (sameValue(toInsert, *storage.surrounding[prevMiddle])) {
+                    finger = at.previous;
+
+                    return;
+                }
+
+                findSurrounding(storage.surrounding[prevMiddle], storage);
+                storage.surrounding[newMiddle] = pointSet.insert(at.next, toInsert);
+            }
+
+            insertion = true;
+
+            updateMaximum(leftmost, left, newMiddle, storage);
+            updateMaximum(newMiddle, right, rightmost, storage);
+            updateMaximum(left, newMiddle, right, storage);
+
+            if (storage.surrounding[prevMiddle] != pointSet.end()) {
+                storage.success.push_back({findMaximum(storage.surrounding[prevMiddle]), pointSet.end()});
+            }
+        }
+        catch (...) {
+            makeRollback(insertion, storage);
+
+            throw;
+        }
+
+        notePoint(storage.surrounding[newMiddle]);
+        makeCommit(storage);
+        finger = storage.surrounding[newMiddle];
+    }
+
+    /**
+     * Version of set_value() for a point with argument greater than all others.
+     * Only the last point and the new one may change their maxima status, and the last point
+     * can only lose it (it gains a right neighbour), which happens if the new value is greater.
+     * So maximaPointSet is probed only in that case, the new point is appended to pointSet
+     * with end() as a hint (amortized O(1)) and no rollback bookkeeping is allocated.
+     * Function has strong guarantee: the only insertion after the point one is undone if it throws
+     * and the final erase is by iterator (nothrow).
+     *
+     * @param a - argument greater than all arguments in pointSet
+     * @param v - value to be assigned
+     */
+    void appendValue(const A &a, const V &v) {
+        point_type toInsert = {a, v};
+        iterator last = pointSet.empty() ? pointSet.end() : std::prev(pointSet.end());
+
+        int order = last == pointSet.end() ? 1 : MaximaValueOrder<V>::compare(toInsert.value(), last->value());
+        bool newMaximum = order >= 0;
+        bool lastDemoted = last != pointSet.end() && order > 0;
+        maxima_iterator lastEntry = lastDemoted ? findMaximum(last) : maximaPointSet.end();
+
+        toInsert.maximum = newMaximum;
+
+        iterator inserted = pointSet.insert(pointSet.end(), toInsert);
+        maxima_iterator entry = maximaPointSet.end();
+
+        if (newMaximum) {
+            try {
+                entry = maximaPointSet.insert(&*inserted);
+                Stats::count(Stats::maximaInsertion);
+            }
+            catch (...) {
+                Stats::count(Stats::rollback);
+                pointSet.erase(inserted);
+
+                throw;
+            }
+        }
+
+        notePoint(inserted);
+        noteMaximum(entry);
+        eraseMaximum(lastEntry);
+        finger = inserted;
+
+        if (lastDemoted) {
+            markMaximum(last, false);
+        }
+    }
+
+    /**
+     * Version of set_value() for lazy mode: only pointSet is modified and a is recorded as dirty,
+     * maximaPointSet is brought up to date by repairMaxima(). The maxima entry of the replaced point
+     * (if it has one) is erased right away, so no entry ever points to an erased node.
+     * Function has strong guarantee: the argument is recorded and the entry found before the insertion,
+     * which is the last operation that may throw.
+     *
+     * @param at - position of a
+     * @param a  - argument to be updated
+     * @param v  - value to be assigned
+     */
+    void writeLazy(Location at, const A &a, const V &v) {
+        point_type toInsert = {a, v};
+
+        if (at.previous != pointSet.end() && sameValue(*at.previous, toInsert)) {
+            finger = at.previous;
+
+            return;
+        }
+
+        bool recorded = recordDirty(a);
+        maxima_iterator replaced = maximaPointSet.end();
+
+        try {
+            replaced = findMaximum(at.previous);
+            finger = pointSet.insert(at.next, toInsert);
+        }
+        catch (...) {
+            if (recorded) {
+                dirty.pop_back();
+            }
+
+            throw;
+        }
+
+        notePoint(finger);
+        eraseMaximum(replaced);
+
+        if (at.previous != pointSet.end()) {
+            erasePoint(at.previous);
+        }
+    }
+
+    /**
+     * Records a written argument of lazy mode in dirty. Once so many arguments are dirty that
+     * repairMaxima() would rebuild maxima from scratch anyway, recording stops: dirty is dropped
+     * and the rebuild is scheduled instead, so it never holds more than about
+     * 1 / lazyRebuildRatio of the function. Inside a transaction, which can not be rebuilt,
+     * everything is recorded.
+     * Function has strong guarantee.
+     *
+     * @param a - written argument
+     * @return  - true if a was appended to dirty (and has to be popped if the write fails).
+     */
+    bool recordDirty(const A &a) {
+        maximaStale.store(true, std::memory_order_relaxed);
+
+        if (!rebuildPending && !inTransaction() && dirty.size() >= pointSet.size() / lazyRebuildRatio) {
+            std::vector<A>().swap(dirty);
+            rebuildPending = true;
+        }
+
+        if (rebuildPending) {
+            return false;
+        }
+
+        dirty.push_back(a);
+
+        return true;
+    }
+
+    /**
+     * Version of erase() for lazy mode, see writeLazy().
+     *
+     * @param toRemove - point to be erased or pointSet.end() if there is none
+     */
+    void eraseLazy(iterator toRemove) {
+        if (toRemove == pointSet.end()) {
+            return;
+        }
+
+        bool recorded = recordDirty(toRemove->arg());
+        maxima_iterator removed = maximaPointSet.end();
+
+        try {
+            removed = findMaximum(toRemove);
+        }
+        catch (...) {
+            if (recorded) {
+                dirty.pop_back();
+            }
+
+            throw;
+        }
+
+        iterator next = std::next(toRemove);
+        finger = next != pointSet.end() ? next : moveItLeft(toRemove);
+        eraseMaximum(removed);
+        erasePoint(toRemove);
+    }
+
+    /**
+     * Makes sure that the next count push_back()'s on the vector do not allocate,
+     * growing it geometrically, so a sequence of calls takes amortized O(count).
+     */
+    template<typename T>
+    static void reserveMore(std::vector<T> &vector, size_t count = 1) {
+        if (vector.capacity() - vector.size() < count) {
+            vector.reserve(std::max(vector.size() + count, 2 * vector.capacity()));
+        }
+    }
+
+    /**
+     * Neighbourhood of a point that is about to be inserted, changed or erased.
+     */
+    struct Surrounding {
+        iterator leftmost;
+        iterator left;
+        iterator right;
+        iterator rightmost;
+    };
+
+    /**
+     * Function is nothrow because it only uses iterator arithmetic.
+     *
+     * @param at - position of the point
+     * @return   - two closest points on both sides of the point (pointSet.end() where there are none).
+     */
+    Surrounding surroundingOf(Location at) const noexcept {
+        Surrounding result;
+
+        result.right = at.next;
+
+        if (at.previous != pointSet.end()) {
+            result.left = moveItLeft(at.previous);
+        } else {
+            result.left = (at.next != pointSet.begin()) ? std::prev(at.next) : pointSet.end();
+        }
+
+        result.leftmost = moveItLeft(result.left);
+        result.rightmost = moveItRight(result.right);
+
+        return result;
+    }
+
+    /**
+     * Same as shouldBeMaximum(), but the point does not have to be stored in pointSet.
+     *
+     * @param left  - left neighbour or nullptr if there is none
+     * @param p     - point that may be maxima
+     * @param right - right neighbour or nullptr if there is none
+     * @return      - true if p is maxima, otherwise false.
+     */
+    static bool isMaximum(const point_type *left, const point_type &p, const point_type *right) {
+        return MaximaValueOrder<V>::isMaximum(left == nullptr ? nullptr : &left->value(), p.value(),
+                                              right == nullptr ? nullptr : &right->value());
+    }
+
+    const point_type *pointOrNull(iterator it) const noexcept {
+        return it == pointSet.end() ? nullptr : &*it;
+    }
+
+    /**
+     * Looks up entry of the given point in maximaPointSet.
+     * Points whose maximum flag is clear are known not to be there, so it costs no comparison.
+     * Entries equivalent to the point are told apart by the node they point to.
+     */
+    maxima_iterator findMaximum(iterator it) const {
+        if (it == pointSet.end() || !it->maximum) {
+            return maximaPointSet.end();
+        }
+
+        const point_type *p = &*it;
+
+        for (auto entry = maximaPointSet.lower_bound(p); entry != maximaPointSet.end() &&
+                                                         !maximaPointSetCmp()(p, *entry); ++entry) {
+            if (*entry == p) {
+                return entry;
+            }
+        }
+
+        return maximaPointSet.end();
+    }
+
+    /**
+     * Sets the maximum flag of the given point (if there is one).
+     * A change of the flag inside a transaction is noted in the undo log.
+     * Function is nothrow.
+     */
+    void markMaximum(iterator it, bool maximum) noexcept {
+        if (it == pointSet.end()) {
+            return;
+        }
+
+        if (maximum != it->maximum && inTransaction()) {
+            undoLog.points.push_back({maximum ? PointChange::flagged : PointChange::unflagged, it, &*it});
+        }
+
+        it->maximum = maximum;
+    }
+
+    /**
+     * Version of set_value() for nothrowTypes.
+     * The only operations that may throw are node allocations, so all of them are done first
+     * in local staging multisets. If one of them fails, nothing was modified yet.
+     * The new nodes are then spliced into pointSet and maximaPointSet as node handles,
+     * which neither allocates nor throws, so no rollback is ever needed.
+     *
+     * @param at - position of a
+     * @param a  - argument to be updated
+     * @param v  - value to be assigned
      */
-    void findSurrounding(iterator it, Storage &storage) const noexcept {
-        storage.surrounding.push_back(it);
-        storage.surrounding.push_back(moveItLeft(it));
-        storage.surrounding.push_back(moveItRight(it));
-        storage.surrounding.push_back(moveItLeft(storage.surrounding[left]));
-        storage.surrounding.push_back(moveItRight(storage.surrounding[right]));
+    void setValueNothrow(Location at, const A &a, const V &v) {
+        point_type toInsert = {a, v};
+        iterator previous = at.previous;
+
+        if (previous != pointSet.end() && sameValue(*previous, toInsert)) {
+            finger = previous;
+
+            return;
+        }
+
+        Surrounding around = surroundingOf(at);
+
+        bool middleMaximum = isMaximum(pointOrNull(around.left), toInsert, pointOrNull(around.right));
+        bool leftMaximum = around.left != pointSet.end() &&
+                           isMaximum(pointOrNull(around.leftmost), *around.left, &toInsert);
+        bool rightMaximum = around.right != pointSet.end() &&
+                            isMaximum(&toInsert, *around.right, pointOrNull(around.rightmost));
+
+        maxima_iterator previousEntry = findMaximum(previous);
+        maxima_iterator leftEntry = findMaximum(around.left);
+        maxima_iterator rightEntry = findMaximum(around.right);
+
+        std::multiset<point_type, pointSetCmp> stagedPoint;
+        maxima_set stagedMaxima;
+
+        toInsert.maximum = middleMaximum;
+        iterator staged = stagedPoint.insert(toInsert);
+        const point_type *inserted = &*staged;
+        auto pointNode = stagedPoint.extract(staged);
+
+        if (middleMaximum) {
+            stagedMaxima.insert(inserted);
+        }
+
+        if (leftMaximum && leftEntry == maximaPointSet.end()) {
+            stagedMaxima.insert(&*around.left);
+        }
+
+        if (rightMaximum && rightEntry == maximaPointSet.end()) {
+            stagedMaxima.insert(&*around.right);
+        }
+
+        eraseMaximum(previousEntry);
+
+        if (!leftMaximum) {
+            eraseMaximum(leftEntry);
+        }
+
+        if (!rightMaximum) {
+            eraseMaximum(rightEntry);
+        }
+
+        // Inserted before previous is erased, so that a rollback puts previous back first (see noteIndexed()).
+        finger = pointSet.insert(around.right, std::move(pointNode));
+        notePoint(finger);
+
+        if (previous != pointSet.end()) {
+            erasePoint(previous);
+        }
+
+        markMaximum(around.left, leftMaximum);
+        markMaximum(around.right, rightMaximum);
+        Stats::count(Stats::maximaInsertion, stagedMaxima.size());
+        adoptMaxima(stagedMaxima);
+    }
+
+    /**
+     * Version of erase() for nothrowTypes, see setValueNothrow().
+     *
+     * @param toRemove - point to be erased or pointSet.end() if there is none
+     */
+    void eraseNothrow(iterator toRemove) {
+        if (toRemove == pointSet.end()) {
+            return;
+        }
+
+        Surrounding around = surroundingOf({toRemove, std::next(toRemove)});
+
+        bool leftMaximum = around.left != pointSet.end() &&
+                           isMaximum(pointOrNull(around.leftmost), *around.left, pointOrNull(around.right));
+        bool rightMaximum = around.right != pointSet.end() &&
+                            isMaximum(pointOrNull(around.left), *around.right, pointOrNull(around.rightmost));
+
+        maxima_iterator removedEntry = findMaximum(toRemove);
+        maxima_iterator leftEntry = findMaximum(around.left);
+        maxima_iterator rightEntry = findMaximum(around.right);
+
+        maxima_set stagedMaxima;
+
+        if (leftMaximum && leftEntry == maximaPointSet.end()) {
+            stagedMaxima.insert(&*around.left);
+        }
+
+        if (rightMaximum && rightEntry == maximaPointSet.end()) {
+            stagedMaxima.insert(&*around.right);
+        }
+
+        eraseMaximum(removedEntry);
+
+        if (!leftMaximum) {
+            eraseMaximum(leftEntry);
+        }
+
+        if (!rightMaximum) {
+            eraseMaximum(rightEntry);
+        }
+
+        erasePoint(toRemove);
+        finger = around.right != pointSet.end() ? around.right : around.left;
+        markMaximum(around.left, leftMaximum);
+        markMaximum(around.right, rightMaximum);
+        Stats::count(Stats::maximaInsertion, stagedMaxima.size());
+        adoptMaxima(stagedMaxima);
+    }
+
+    /**
+     * Inside a transaction the node is extracted to the undo log instead of being destroyed.
+     * Function is nothrow: erase on std::multiset<point_type> by iterator is nothrow.
+     */
+    void eraseMaximum(maxima_iterator it) noexcept {
+        if (it == maximaPointSet.end()) {
+            return;
+        }
+
+        if (inTransaction()) {
+            const point_type *point = *it;
+            undoLog.maxima.push_back({maximaPointSet.end(), point, maximaPointSet.extract(it), undoLog.points.size()});
+        } else {
+            maximaPointSet.erase(it);
+        }
+
+        Stats::count(Stats::maximaErasure);
+    }
+
+    /**
+     * Same as eraseMaximum() for pointSet.
+     */
+    void erasePoint(iterator it) noexcept {
+        if (inTransaction()) {
+            const point_type *point = &*it;
+            undoLog.points.push_back({PointChange::erased, pointSet.end(), point, 0, pointSet.extract(it)});
+        } else {
+            pointSet.erase(it);
+        }
+    }
+
+    /**
+     * Notes an insertion made inside a transaction. Function is nothrow.
+     */
+    void notePoint(iterator it) noexcept {
+        if (inTransaction()) {
+            undoLog.points.push_back({PointChange::inserted, it, &*it});
+        }
+    }
+
+    void noteMaximum(maxima_iterator it) noexcept {
+        if (inTransaction() && it != maximaPointSet.end()) {
+            undoLog.maxima.push_back({it, *it, {}, undoLog.points.size()});
+        }
+    }
+
+    /**
+     * Comparator for the multiset of all points.
+     * It is transparent, so points can be looked up by their arguments
+     * without constructing (and allocating) a point_type.
+     */
+    struct pointSetCmp {
+        using is_transparent = void;
+
+        bool operator()(const point_type &a, const point_type &b) const {
+            Stats::count(Stats::pointComparison);
+
+            return a.arg() < b.arg();
+        }
+
+        bool operator()(const A &a, const point_type &b) const {
+            Stats::count(Stats::pointComparison);
+
+            return a < b.arg();
+        }
+
+        bool operator()(const point_type &a, const A &b) const {
+            Stats::count(Stats::pointComparison);
+
+            return a.arg() < b;
+        }
+    };
+
+    /**
+     * Open addressing (linear probing) hash table of iterators to pointSet, kept at most half full.
+     * Every slot remembers the full hash of its point, so probing compares arguments
+     * only for matching hashes and rehashing does not call the hasher.
+     * Entries are inserted, replaced and removed by a precomputed hash and iterator values,
+     * so with enough reserved space these operations neither compare arguments nor throw.
+     */
+    class HashIndex {
+        struct Slot;
+
+    public:
+        explicit HashIndex(std::function<size_t(const A &)> hasher) : hashFunction(std::move(hasher)) {}
+
+        const std::function<size_t(const A &)> &hasher() const noexcept {
+            return hashFunction;
+        }
+
+        size_t hash(const A &a) const {
+            return hashFunction(a);
+        }
+
+        /**
+         * Makes room for n entries. Function has strong guarantee: the new table is built aside.
+         */
+        void reserve(size_t n) {
+            if ((used + (n > live ? n - live : 0)) * 2 <= slots.size()) {
+                return;
+            }
+
+            size_t capacity = 16;
+
+            while (capacity < n * 4) {
+                capacity *= 2;
+            }
+
+            std::vector<Slot> rehashed(capacity);
+
+            for (const Slot &slot : slots) {
+                if (slot.state == full) {
+                    Slot &target = rehashed[freeSlot(rehashed, slot.hash)];
+                    target = slot;
+                }
+            }
+
+            slots.swap(rehashed);
+            used = live;
+        }
+
+        /**
+         * Requires space reserved by reserve(). Function is nothrow.
+         */
+        void insert(size_t hash, iterator it) noexcept {
+            Slot &slot = slots[freeSlot(slots, hash)];
+            used += slot.state == empty;
+            slot = {it, hash, full};
+            live++;
+        }
+
+        /**
+         * Entry of point it, found by its hash and compared as an iterator, or nullptr.
+         * Entries do not move until the next reserve(), so the entry of a point can be taken
+         * before the point is erased and updated afterwards. Function is nothrow.
+         */
+        Slot *entryOf(size_t hash, iterator it) noexcept {
+            if (slots.empty()) {
+                return nullptr;
+            }
+
+            size_t mask = slots.size() - 1;
+
+            for (size_t i = hash & mask; slots[i].state != empty; i = (i + 1) & mask) {
+                if (slots[i].state == full && slots[i].it == it) {
+                    return &slots[i];
+                }
+            }
+
+            return nullptr;
+        }
+
+        void replace(Slot *entry, iterator to) noexcept {
+            entry->it = to;
+        }
+
+        void remove(Slot *entry) noexcept {
+            entry->state = deleted;
+            live--;
+        }
+
+        void replace(size_t hash, iterator from, iterator to) noexcept {
+            if (Slot *entry = entryOf(hash, from)) {
+                replace(entry, to);
+            }
+        }
+
+        void remove(size_t hash, iterator it) noexcept {
+            if (Slot *entry = entryOf(hash, it)) {
+                remove(entry);
+            }
+        }
+
+        /**
+         * Prefetches the slot where probing for hash starts. Function is nothrow.
+         */
+        void prefetch(size_t hash) const noexcept {
+            if (!slots.empty()) {
+                Impl::prefetch(&slots[hash & (slots.size() - 1)]);
+            }
+        }
+
+        /**
+         * Function has strong guarantee: it only compares arguments.
+         */
+        iterator find(size_t hash, const A &a, iterator notFound) const {
+            if (slots.empty()) {
+                return notFound;
+            }
+
+            size_t mask = slots.size() - 1;
+
+            for (size_t i = hash & mask; slots[i].state != empty; i = (i + 1) & mask) {
+                const Slot &slot = slots[i];
+
+                if (slot.state == full && slot.hash == hash &&
+                    !(slot.it->arg() < a) && !(a < slot.it->arg())) {
+                    return slot.it;
+                }
+            }
+
+            return notFound;
+        }
+
+        void clear() noexcept {
+            std::fill(slots.begin(), slots.end(), Slot());
+            live = 0;
+            used = 0;
+        }
+
+        /**
+         * Drops all entries together with the table, in O(1) plus deallocation.
+         */
+        void release() noexcept {
+            std::vector<Slot>().swap(slots);
+            live = 0;
+            used = 0;
+        }
+
+        /**
+         * Exchanges entries with other, which has to use the same hasher. Function is nothrow.
+         */
+        void swapEntries(HashIndex &other) noexcept {
+            slots.swap(other.slots);
+            std::swap(live, other.live);
+            std::swap(used, other.used);
+        }
+
+    private:
+        enum State : unsigned char {
+            empty,
+            full,
+            deleted
+        };
+
+        struct Slot {
+            iterator it;
+            size_t hash = 0;
+            State state = empty;
+        };
+
+        static size_t freeSlot(const std::vector<Slot> &table, size_t hash) noexcept {
+            size_t mask = table.size() - 1;
+            size_t i = hash & mask;
+
+            while (table[i].state == full) {
+                i = (i + 1) & mask;
+            }
+
+            return i;
+        }
+
+        std::function<size_t(const A &)> hashFunction;
+        std::vector<Slot> slots;
+        size_t live = 0;
+        size_t used = 0;
+    };
+
+    /**
+     * Change of pointSet (or of the hash index) made inside a transaction.
+     * Erased nodes are kept as node handles, so undoing the erasure neither allocates nor copies.
+     * Iterators to a node are invalidated when it is extracted, but pointers to its point are not,
+     * so every change also records the address of its point: a rollback looks it up among the nodes
+     * it has put back (see rollbackTransaction()) and uses the iterator returned by their insertion.
+     */
+    struct PointChange {
+        enum Kind {
+            inserted,
+            erased,
+            flagged,
+            unflagged,
+            indexed
+        } kind = inserted;
+        iterator it = {};                 // inserted, flagged or unflagged point, entry of the index after the change
+        const point_type *point = nullptr; // point of it (nullptr for pointSet.end()) or the erased point
+        size_t hash = 0;
+        typename std::multiset<point_type, pointSetCmp>::node_type node = {};
+        const point_type *replaced = nullptr; // erased point whose index entry was changed (nullptr if none)
+    };
+
+    /**
+     * Insertion (empty node) or erasure of a maxima entry made inside a transaction.
+     * Entries point to nodes of pointSet, so changes of both logs are undone in the chronological order
+     * (every entry is then put back only while its point is in pointSet): points is the size
+     * of the point log when the change was made. Like PointChange, it records the point of the entry,
+     * which identifies an entry put back by the rollback.
+     */
+    struct MaximumChange {
+        maxima_iterator it = {}; // inserted entry (maximaPointSet.end() for an erasure)
+        const point_type *point = nullptr;
+        typename maxima_set::node_type node = {};
+        size_t points = 0;
+    };
+
+    /**
+     * Changes made inside the open transactions in chronological order, so they can be undone
+     * in reverse. Entries are only added at the nothrow commit points of the operations,
+     * into space reserved by reserveUndo() beforehand.
+     */
+    struct UndoLog {
+        std::vector<PointChange> points;
+        std::vector<MaximumChange> maxima;
+        size_t depth = 0;
+        size_t unindexed = 0; // logged removals of hash index entries, put back by a rollback
+
+        // Nodes put back by the running rollback, sorted by their points, with room for every logged erasure.
+        std::vector<std::pair<const point_type *, iterator>> restoredPoints;
+        std::vector<std::pair<const point_type *, maxima_iterator>> restoredMaxima;
+    };
+
+    void reserveUndo(size_t points, size_t maxima) {
+        if (inTransaction()) {
+            reserveMore(undoLog.points, points);
+            reserveMore(undoLog.maxima, maxima);
+            undoLog.restoredPoints.reserve(undoLog.points.capacity());
+            undoLog.restoredMaxima.reserve(undoLog.maxima.capacity());
+        }
+    }
+
+    /**
+     * Records that a rollback put back the node of point at it. A point may get a maxima entry put back
+     * more than once (it was erased, inserted anew and erased again), then the older entry replaces
+     * the newer one, which the rollback has erased in between. Function is nothrow:
+     * the space was reserved by reserveUndo().
+     */
+    template<typename It>
+    static void restored(std::vector<std::pair<const point_type *, It>> &nodes, const point_type *point,
+                         It it) noexcept {
+        auto position = std::lower_bound(nodes.begin(), nodes.end(), point, [](const auto &node, const point_type *p) {
+            return std::less<const point_type *>()(node.first, p);
+        });
+
+        if (position != nodes.end() && position->first == point) {
+            position->second = it;
+        } else {
+            nodes.insert(position, {point, it});
+        }
+    }
+
+    /**
+     * @return the iterator of the node of point if a rollback has put it back, otherwise it.
+     */
+    template<typename It>
+    static It current(const std::vector<std::pair<const point_type *, It>> &nodes, const point_type *point,
+                      It it) noexcept {
+        auto position = std::lower_bound(nodes.begin(), nodes.end(), point, [](const auto &node, const point_type *p) {
+            return std::less<const point_type *>()(node.first, p);
+        });
+
+        return position != nodes.end() && position->first == point ? position->second : it;
+    }
+
+    /**
+     * Makes room in the hash index for count more entries and for the entries a rollback
+     * of the open transactions would put back, so rollbackTransaction() never allocates.
+     * Function has strong guarantee.
+     */
+    void reserveIndex(size_t count) {
+        hashIndex->reserve(pointSet.size() + count + undoLog.unindexed);
+    }
+
+    /**
+     * Notes that the index entry of hash moved from the point from, erased by the write, to to
+     * (either may be missing, nothing is noted if they are the same). The change is logged just before
+     * the erasure of from, so a rollback puts the node of from back before its entry; maxima changes
+     * logged after the erasure are shifted along with it. Function is nothrow: the write logged at most
+     * undoPointsPerWrite changes, into space reserved by reserveUndo().
+     */
+    void noteIndexed(size_t hash, const point_type *from, iterator to) noexcept {
+        if (!inTransaction() || from == pointOrNull(to)) {
+            return;
+        }
+
+        std::vector<PointChange> &log = undoLog.points;
+        log.push_back({PointChange::indexed, to, pointOrNull(to), hash, {}, from});
+        undoLog.unindexed += to == pointSet.end();
+
+        for (size_t i = log.size() - 1, written = 0; from != nullptr && i > 0 && written < undoPointsPerWrite;
+             written++) {
+            if (log[--i].kind == PointChange::erased && log[i].point == from) {
+                std::rotate(log.begin() + static_cast<std::ptrdiff_t>(i), log.end() - 1, log.end());
+
+                for (auto maximum = undoLog.maxima.rbegin(); maximum != undoLog.maxima.rend() &&
+                                                             maximum->points > i; ++maximum) {
+                    maximum->points++;
+                }
+
+                break;
+            }
+        }
+    }
+
+    void undoIndexed(const PointChange &change, iterator to, iterator from) noexcept {
+        undoLog.unindexed -= to == pointSet.end();
+
+        if (!hashIndex) {
+            return;
+        }
+
+        if (to == pointSet.end()) {
+            hashIndex->insert(change.hash, from);
+        } else if (from == pointSet.end()) {
+            hashIndex->remove(change.hash, to);
+        } else {
+            hashIndex->replace(change.hash, to, from);
+        }
+    }
+
+    /**
+     * Moves staged maxima entries into maximaPointSet, noting each of them inside a transaction.
+     * Function is nothrow for nothrowComparisons, the only ones calling it.
+     */
+    void adoptMaxima(maxima_set &staged) noexcept {
+        if (!inTransaction()) {
+            return maximaPointSet.merge(staged);
+        }
+
+        while (!staged.empty()) {
+            noteMaximum(maximaPointSet.insert(staged.extract(staged.begin())));
+        }
+    }
+
+    std::multiset<point_type, pointSetCmp> pointSet;
+    maxima_set maximaPointSet;
+    std::unique_ptr<HashIndex> hashIndex;
+
+    /**
+     * Lazy mode: set_value() and erase() only erase the maxima entries of the points they remove
+     * and record the written arguments in dirty; repairMaxima() catches up.
+     * Outside of lazy mode (and right after a repair) dirty is empty.
+     */
+    bool lazyMaxima = false;
+    std::vector<A> dirty;
+
+    /**
+     * Set when maxima could not be restored after a failed rollback of a transaction,
+     * repairMaxima() then rebuilds them from scratch.
+     */
+    bool maximaLost = false;
+
+    /**
+     * Set by recordDirty() when lazy mode stops recording writes, repairMaxima() then rebuilds
+     * maxima from scratch.
+     */
+    bool rebuildPending = false;
+
+    /**
+     * Set by writes that leave maxima to repairMaxima() (dirty arguments, rebuildPending, maximaLost)
+     * and cleared by it, so the const mx_begin() and mx_end() check for a repair without reading
+     * the fields a concurrent repair writes. repairLock serializes their repairs and copies of this Impl.
+     * Writes do not take it: like every non-const function they must not run concurrently with anything.
+     */
+    std::atomic<bool> maximaStale{false};
+    mutable std::mutex repairLock;
+
+    UndoLog undoLog;
+
+    /**
+     * Point touched by the last set_value() or erase() (or pointSet.end() if none),
+     * lookups of nearby arguments start from it. It tracks writes only: const lookups (find(),
+     * value_at(), ...) read it but never move it, so they stay safe to run concurrently, and a run
+     * of reads benefits only while it stays near the last write.
+     */
+    iterator finger = pointSet.end();
+    bool fingerNear = false;
+};
+
+/*********************************MX_ITERATOR*********************************/
+
+/**
+ * Iterator over maxima in descending order of values (ties by ascending arguments).
+ * Entries of maxima are pointers to the nodes of the points, so it dereferences
+ * to the same point_type objects as iterator does.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ */
+template<typename A, typename V>
+class FunctionMaxima<A, V>::mx_iterator {
+public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = point_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const point_type *;
+    using reference = const point_type &;
+
+    mx_iterator() = default;
+
+    reference operator*() const noexcept {
+        return **entry;
+    }
+
+    pointer operator->() const noexcept {
+        return *entry;
+    }
+
+    mx_iterator &operator++() noexcept {
+        ++entry;
+
+        return *this;
+    }
+
+    mx_iterator operator++(int) noexcept {
+        mx_iterator result = *this;
+        ++entry;
+
+        return result;
+    }
+
+    mx_iterator &operator--() noexcept {
+        --entry;
+
+        return *this;
     }
 
+    mx_iterator operator--(int) noexcept {
+        mx_iterator result = *this;
+        --entry;
+
+        return result;
+    }
+
+    bool operator==(const mx_iterator &rhs) const noexcept {
+        return entry == rhs.entry;
+    }
+
+    bool operator!=(const mx_iterator &rhs) const noexcept {
+        return entry != rhs.entry;
+    }
+
+private:
+    friend class FunctionMaxima<A, V>::Impl;
+
+    explicit mx_iterator(typename Impl::maxima_iterator entry) noexcept : entry(entry) {}
+
+    typename Impl::maxima_iterator entry;
+};
+
+/*********************************TRANSACTION*********************************/
+
+/**
+ * Groups set_value() and erase() calls (and any lookups) on one FunctionMaxima into an all-or-nothing unit.
+ * While a transaction is open, erased nodes are retired to an undo log instead of being destroyed
+ * and insertions are noted there, so rollback() costs O(k log n) for k changes instead of a copy of the function.
+ * Transactions can be nested; an inner one acts as a savepoint of the enclosing one.
+ * A transaction that is neither committed nor rolled back is rolled back by its destructor.
+ * assign(), merge(), split_at(), join() and enable_hash_index() throw InvalidArg while a transaction
+ * is open; the function must not be assigned to or moved from until it ends.
+ * Transactions have to end in the reverse order of their construction.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ */
+template<typename A, typename V>
+class FunctionMaxima<A, V>::transaction {
+public:
     /**
-     * Makes commit in form of erasing outdated points from maximaPointSet
-     * (their iterators are stored in storage)
-     * and erases outdated point from pointSet (is such one exists).
-     * Function is nothrow:
-     * erase on std::multiset<point_type> by iterator is nothrow.
-     *
-     * @param insertion - bool determining whether insertion to pointSet was made
-     * @param storage   - struct containing necessary data
+     * Function has strong guarantee (lazy maxima are repaired first).
      */
-    void makeCommit(Storage &storage) noexcept {
-        for (size_t i = 0; i < storage.success.size(); i++) {
-            if (storage.success[i] != maximaPointSet.end()) {
-                maximaPointSet.erase(storage.success[i]);
-            }
-        }
+    explicit transaction(FunctionMaxima &fun) : fun(fun), impl(fun.pImpl.get()),
+                                                savepoint(impl->beginTransaction()) {}
 
-        if (storage.surrounding[prevMiddle] != pointSet.end()) {
-            pointSet.erase(storage.surrounding[prevMiddle]);
-        }
-    }
+    transaction(const transaction &) = delete;
+
+    transaction &operator=(const transaction &) = delete;
 
     /**
-     * Makes rollback in form of erasing inserted points from maximaPointSet
-     * (their iterators are stored in storage)
-     * and erases inserted point from pointSet (is such one exists).
-     * Function is nothrow:
-     * erase on std::multiset<point_type> by iterator is nothrow.
-     *
-     * @param insertion - bool determining whether insertion to pointSet was made
-     * @param storage   - struct containing necessary data
+     * Rolls back an open transaction. If the rollback throws (only possible when comparisons of A or V throw),
+     * the exception is swallowed and the function is left valid, with the changes partly undone.
      */
-    void makeRollback(const bool insertion, Storage &storage) noexcept {
-        for (size_t i = 0; i < storage.rollback.size(); i++) {
-            if (storage.rollback[i] != maximaPointSet.end()) {
-                maximaPointSet.erase(storage.rollback[i]);
-            }
+    ~transaction() {
+        if (!open()) {
+            return;
         }
 
-        if (insertion && storage.surrounding[newMiddle] != pointSet.end()) {
-            pointSet.erase(storage.surrounding[newMiddle]);
+        try {
+            rollback();
+        }
+        catch (...) {
+            impl->abandonTransaction();
         }
     }
 
     /**
-     * Comparator for the multiset of all points.
+     * Keeps all changes made since the transaction started. Function is nothrow.
      */
-    struct pointSetCmp {
-        bool operator()(point_type a, point_type b) const {
-            return a.arg() < b.arg();
+    void commit() noexcept {
+        if (open()) {
+            impl->commitTransaction();
+            ended = true;
         }
-    };
+    }
 
     /**
-     * Comparator for the multiset of all maxima points.
+     * Undoes all changes made since the transaction started.
+     * Function is nothrow if comparisons of A and V are nothrow; otherwise, if it throws,
+     * the transaction stays open and rollback() can be called again.
      */
-    struct maximaPointSetCmp {
-        bool operator()(point_type a, point_type b) const {
-            return (b.value() < a.value()) ||
-                   (sameValue(a, b) && (a.arg() < b.arg()));
+    void rollback() noexcept(nothrowComparisons) {
+        if (open()) {
+            impl->rollbackTransaction(savepoint);
+            ended = true;
         }
-    };
+    }
 
-    std::multiset<point_type, pointSetCmp> pointSet;
-    std::multiset<point_type, maximaPointSetCmp> maximaPointSet;
+private:
+    bool open() const noexcept {
+        return !ended && fun.pImpl.get() == impl;
+    }
+
+    FunctionMaxima &fun;
+    Impl *impl;
+    typename Impl::Savepoint savepoint;
+    bool ended = false;
 };
 
 /**
@@ -462,6 +3247,84 @@ V const &FunctionMaxima<A, V>::value_at(const A &a) const {
     return pImpl->value_at(a);
 }
 
+/**
+ * Same lookup as value_at(), but a missing key is reported by returning nullptr instead of throwing,
+ * so misses cost no more than hits. Nothing is allocated (pointSet is searched by the argument itself).
+ * Function has strong guarantee and is nothrow if comparisons of A and V are nothrow.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ * @param a - const reference to the key to be searched
+ * @return pointer to the value of the found key (valid until the point is changed or erased) or nullptr.
+ */
+template<typename A, typename V>
+V const *FunctionMaxima<A, V>::try_value_at(const A &a) const noexcept(nothrowComparisons) {
+    return pImpl->try_value_at(a);
+}
+
+/**
+ * Function has strong guarantee and is nothrow if comparisons of A and V are nothrow.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ * @param a - const reference to the key to be searched
+ * @return true if the function has a value for the key, otherwise false.
+ */
+template<typename A, typename V>
+bool FunctionMaxima<A, V>::contains(const A &a) const noexcept(nothrowComparisons) {
+    return pImpl->contains(a);
+}
+
+/**
+ * Batch version of try_value_at() for keys sorted in ascending order (repetitions are allowed):
+ * for every key a pointer to its value or nullptr is written to out.
+ * Instead of a separate descent from the root for every key, pointSet is walked forward once
+ * and only long gaps between consecutive keys are skipped by a descent, so a dense batch
+ * costs O(n + k) and a sparse one O(k log n) comparisons for k keys.
+ * Misses are reported without exceptions and nothing is allocated.
+ * Function has strong guarantee with respect to FunctionMaxima (pointers written before
+ * a throwing comparison stay in out).
+ *
+ * @tparam A     - type of the domain values
+ * @tparam V     - type of the range values
+ * @tparam KeyIt - input iterator over keys
+ * @tparam OutIt - output iterator accepting V const *
+ * @param first  - beginning of the range of sorted keys
+ * @param last   - end of the range of sorted keys
+ * @param out    - beginning of the output range
+ * @return out past the last written pointer.
+ */
+template<typename A, typename V>
+template<typename KeyIt, typename OutIt>
+OutIt FunctionMaxima<A, V>::values_at(KeyIt first, KeyIt last, OutIt out) const {
+    return pImpl->values_at(first, last, out);
+}
+
+/**
+ * Batch version of try_value_at() for keys in any order: for every key a pointer to its value
+ * or nullptr is written to out. With the hash index enabled (enable_hash_index()) keys are taken
+ * in groups of 16 and the hash table slots of a whole group are prefetched before the first probe,
+ * so memory latency of several lookups overlaps. Without the hash index the keys are simply looked up
+ * one after another, as with try_value_at(). Misses are reported without exceptions and nothing
+ * is allocated.
+ * Function has strong guarantee with respect to FunctionMaxima (pointers written before
+ * a throwing comparison stay in out).
+ *
+ * @tparam A     - type of the domain values
+ * @tparam V     - type of the range values
+ * @tparam KeyIt - forward iterator over keys
+ * @tparam OutIt - output iterator accepting V const *
+ * @param first  - beginning of the range of keys
+ * @param last   - end of the range of keys
+ * @param out    - beginning of the output range
+ * @return out past the last written pointer.
+ */
+template<typename A, typename V>
+template<typename KeyIt, typename OutIt>
+OutIt FunctionMaxima<A, V>::values_at_unsorted(KeyIt first, KeyIt last, OutIt out) const {
+    return pImpl->values_at_unsorted(first, last, out);
+}
+
 /**
  * The function will update the value of the existing key.
  * If the key does not exist in the multiset, then it will be inserted
@@ -473,6 +3336,10 @@ V const &FunctionMaxima<A, V>::value_at(const A &a) const {
  * First it tries to do all the inserts (strong guarantee) and at the end it erases by iterator (nothrow).
  * When exception is thrown, the function erases all inserts made during it's performance by iterators (nothrow).
  * Those actions assure that the function has strong guarantee.
+ * For trivially copyable A and V with nothrow comparisons only node allocations may throw,
+ * so they are done before any modification and no rollback is needed.
+ * A key greater than all others is recognized by one comparison and appended in amortized O(1)
+ * (plus one maxima insertion), only the last point has its maxima status re-evaluated.
  *
  * @tparam A - type of the domain values
  * @tparam V - type of the range values
@@ -484,6 +3351,23 @@ void FunctionMaxima<A, V>::set_value(const A &a, const V &v) {
     return pImpl->set_value(a, v);
 }
 
+/**
+ * Same as set_value(a, v), but if hint points to the point with key a or to the first point
+ * with a greater key (end() when appending), the point is located with at most two comparisons
+ * and inserted at the hint in amortized O(1) instead of searching pointSet. A wrong hint is ignored.
+ * Function has strong guarantee for the same reasons as set_value(a, v).
+ *
+ * @tparam A  - type of the domain values
+ * @tparam V  - type of the range values
+ * @param hint - iterator of this function close to the key
+ * @param a    - const reference to the key to be updated
+ * @param v    - const reference to the value to be assigned to a key
+ */
+template<typename A, typename V>
+void FunctionMaxima<A, V>::set_value(iterator hint, const A &a, const V &v) {
+    return pImpl->set_value(hint, a, v);
+}
+
 /**
  * The function will erase the element given by the key.
  * Function has strong guarantee because:
@@ -492,6 +3376,8 @@ void FunctionMaxima<A, V>::set_value(const A &a, const V &v) {
  * First it tries to do all the inserts (strong guarantee) and at the end it erases by iterator (nothrow).
  * When exception is thrown, the function erases all inserts made during it's performance by iterators (nothrow).
  * Those actions assure that function has strong guarantee.
+ * For trivially copyable A and V with nothrow comparisons only node allocations may throw,
+ * so they are done before any modification and no rollback is needed.
  *
  * @tparam A - type of the domain values
  * @tparam V - type of the range values
@@ -532,6 +3418,10 @@ typename FunctionMaxima<A, V>::iterator FunctionMaxima<A, V>::end() const noexce
  *  the argument matches.  If successful the function returns an iterator
  *  pointing to the sought after element. If unsuccessful it returns the
  *  past-the-end ( @c end() ) iterator.
+ *  The search starts from the point of the last set_value() or erase() and walks at most a few
+ *  neighbours before descending from the root, so arguments next to the last write are found
+ *  in O(1). Only writes move that starting point: find() is const and may run concurrently,
+ *  so reads far from the last write pay the usual O(log n) descent however local they are.
  *  Function has strong guarantee:
  *  find() on std::multiset<point_type> (where comparing point_type objects has strong guarantee) has strong guarantee.
  *
@@ -547,30 +3437,317 @@ typename FunctionMaxima<A, V>::iterator FunctionMaxima<A, V>::find(const A &a) c
 
 /**
  * Iteration is done in descending order according to the values.
- * Function is nothrow because begin() on std::multiset is nothrow.
+ * Function is nothrow (begin() on std::multiset is nothrow) unless lazy maxima are enabled,
+ * then it first repairs maxima after the recent writes, with strong guarantee (see enable_lazy_maxima()).
  *
  * @tparam A - type of the domain values
  * @tparam V - type of the range values
  * @return a read-only (constant) iterator that points to the first maxima element in FunctionMaxima.
  */
 template<typename A, typename V>
-typename FunctionMaxima<A, V>::mx_iterator FunctionMaxima<A, V>::mx_begin() const noexcept {
+typename FunctionMaxima<A, V>::mx_iterator FunctionMaxima<A, V>::mx_begin() const {
     return pImpl->mx_begin();
 }
 
 /**
  * Iteration is done in descending order according to the values.
- * Function is nothrow because end() on std::multiset is nothrow.
+ * Function is nothrow (end() on std::multiset is nothrow) unless lazy maxima are enabled, see mx_begin().
  *
  * @tparam A - type of the domain values
  * @tparam V - type of the range values
  * @return a read-only (constant) iterator that points one past the last maxima element in FunctionMaxima.
  */
 template<typename A, typename V>
-typename FunctionMaxima<A, V>::mx_iterator FunctionMaxima<A, V>::mx_end() const noexcept {
+typename FunctionMaxima<A, V>::mx_iterator FunctionMaxima<A, V>::mx_end() const {
     return pImpl->mx_end();
 }
 
+/**
+ * Replaces the content of FunctionMaxima with the given (argument, value) pairs
+ * (anything with .first and .second, e.g. std::pair<A, V>).
+ * The result is the same as after calling set_value() for each pair in order,
+ * but it takes one sort and one linear pass instead of n tree updates with neighbourhood fixups,
+ * and maxima of arithmetic values are detected with SIMD instructions (see MaximaKernel).
+ * Function has strong guarantee: the new content is built in a separate Impl
+ * and then moved into pImpl (nothrow).
+ *
+ * @tparam A       - type of the domain values
+ * @tparam V       - type of the range values
+ * @tparam InputIt - input iterator over pairs
+ * @param first    - beginning of the range of pairs
+ * @param last     - end of the range of pairs
+ */
+template<typename A, typename V>
+template<typename InputIt>
+void FunctionMaxima<A, V>::assign(InputIt first, InputIt last) {
+    assign(first, last, 1);
+}
+
+/**
+ * Parallel version of assign(first, last), the result is exactly the same.
+ * Sorting, classification of maxima and allocation of nodes are done in chunks
+ * by the given number of threads (chunks smaller than Impl::minimalChunk points are not split further),
+ * points on chunk boundaries are classified with their neighbours from the adjacent chunks.
+ * Function has strong guarantee for the same reasons as assign(first, last);
+ * an exception thrown by a worker thread is rethrown in the calling thread.
+ *
+ * @tparam A       - type of the domain values
+ * @tparam V       - type of the range values
+ * @tparam InputIt - input iterator over pairs
+ * @param first    - beginning of the range of pairs
+ * @param last     - end of the range of pairs
+ * @param threads  - maximal number of threads to use
+ */
+template<typename A, typename V>
+template<typename InputIt>
+void FunctionMaxima<A, V>::assign(InputIt first, InputIt last, size_type threads) {
+    pImpl->requireNoTransaction();
+    auto built = std::make_unique<Impl>();
+    built->assign(first, last, std::max<size_type>(threads, 1));
+
+    pImpl->shareHashIndex(*built);
+
+    if (pImpl->hasLazyMaxima()) {
+        built->enableLazyMaxima();
+    }
+
+    pImpl = std::move(built);
+}
+
+/**
+ * Merges points of other into FunctionMaxima in O(n + m) walk over both functions
+ * plus logarithmic work for each point whose neighbourhood changed.
+ * When both functions have the same argument, policy decides which point is kept.
+ * Function has strong guarantee: other is copied first and then merged as an rvalue.
+ *
+ * @tparam A     - type of the domain values
+ * @tparam V     - type of the range values
+ * @param other  - function to be merged into this one
+ * @param policy - decides which point is kept when both functions have the same argument
+ */
+template<typename A, typename V>
+void FunctionMaxima<A, V>::merge(const FunctionMaxima &other, MergePolicy policy) {
+    if (&other == this) {
+        return;
+    }
+
+    merge(FunctionMaxima(other), policy);
+}
+
+/**
+ * Same as merge(const FunctionMaxima &, MergePolicy), but nodes of other are moved into
+ * this function instead of being copied. Function has strong guarantee with respect
+ * to this function; other is left empty (if an exception is thrown, other is either unchanged or empty).
+ *
+ * @tparam A     - type of the domain values
+ * @tparam V     - type of the range values
+ * @param other  - function to be merged into this one
+ * @param policy - decides which point is kept when both functions have the same argument
+ */
+template<typename A, typename V>
+void FunctionMaxima<A, V>::merge(FunctionMaxima &&other, MergePolicy policy) {
+    if (&other == this) {
+        return;
+    }
+
+    pImpl->merge(*other.pImpl, policy);
+    pImpl->refreshHashIndex();
+}
+
+/**
+ * Moves points with arguments >= a to a new function, this function keeps the points with arguments < a.
+ * Only the two points on both sides of the split get their maxima status recomputed.
+ * Nodes of the smaller part are moved (not copied) when comparisons of A and V can not throw,
+ * so the cost is O(min(k, n - k) log n) for k moved points rather than proportional to the whole
+ * function; std::multiset does not offer a logarithmic split. When comparisons may throw, the moved
+ * part is copied instead and erased from this function only after everything else succeeded,
+ * so the cost is O(k log n): moved nodes could not be put back if a comparison threw midway,
+ * and copying is the price of the strong guarantee.
+ * Function has strong guarantee.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ * @param a  - smallest argument of the moved part
+ * @return function with points of this function with arguments >= a.
+ */
+template<typename A, typename V>
+FunctionMaxima<A, V> FunctionMaxima<A, V>::split_at(const A &a) {
+    FunctionMaxima result;
+    pImpl->shareHashIndex(*result.pImpl);
+    pImpl->splitAt(a, *result.pImpl);
+
+    if (pImpl->hasLazyMaxima()) {
+        result.pImpl->enableLazyMaxima();
+    }
+
+    return result;
+}
+
+/**
+ * Joins other to this function. All arguments of other have to be greater than all arguments
+ * of this function or all of them smaller, otherwise InvalidArg is thrown.
+ * Only the two points on both sides of the junction get their maxima status recomputed.
+ * Function has strong guarantee: other is copied first and then joined as an rvalue.
+ *
+ * @tparam A    - type of the domain values
+ * @tparam V    - type of the range values
+ * @param other - function with arguments disjoint from and ordered with respect to this function
+ */
+template<typename A, typename V>
+void FunctionMaxima<A, V>::join(const FunctionMaxima &other) {
+    join(FunctionMaxima(other));
+}
+
+/**
+ * Same as join(const FunctionMaxima &), but nodes of the smaller function are moved
+ * when comparisons of A and V can not throw (O(min(n, m) log(n + m)) for n points of this function
+ * and m of other). When comparisons may throw, the points of other are copied instead, which costs
+ * O(m log(n + m)) even when other is the bigger function: that keeps this function restorable
+ * by nothrow erasures if a comparison throws. Function has strong guarantee with respect
+ * to this function; other is left empty on success.
+ *
+ * @tparam A    - type of the domain values
+ * @tparam V    - type of the range values
+ * @param other - function with arguments disjoint from and ordered with respect to this function
+ */
+template<typename A, typename V>
+void FunctionMaxima<A, V>::join(FunctionMaxima &&other) {
+    if (&other == this) {
+        throw InvalidArg("overlapping argument ranges");
+    }
+
+    pImpl->join(*other.pImpl);
+}
+
+/**
+ * Enables a secondary hash index keyed by std::hash<A>, see enable_hash_index(hasher).
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ */
+template<typename A, typename V>
+void FunctionMaxima<A, V>::enable_hash_index() {
+    enable_hash_index(std::hash<A>());
+}
+
+/**
+ * Enables a secondary hash index of points by their arguments, so value_at(), try_value_at(),
+ * find() and contains() take O(1) expected time and compare arguments only for matching hashes.
+ * Keys equivalent with respect to operator< of A must have equal hashes.
+ * set_value() and erase() keep the index up to date under their strong guarantee, so they cost
+ * one hash more. split_at() and join() move the entries of the points they move and hash only the points
+ * that get a new entry (the moved part or the points of the joined function), assign() builds the index
+ * of the new content before installing it. merge() rebuilds it, and if that fails, the index is switched
+ * off instead (see has_hash_index()). Copies of the function get their own index.
+ * If the hasher throws in a lookup, the point is searched for in the tree instead.
+ * Function has strong guarantee.
+ *
+ * @tparam A     - type of the domain values
+ * @tparam V     - type of the range values
+ * @param hasher - hash function of arguments
+ */
+template<typename A, typename V>
+void FunctionMaxima<A, V>::enable_hash_index(std::function<std::size_t(A const &)> hasher) {
+    pImpl->requireNoTransaction();
+    pImpl->enableHashIndex(std::move(hasher));
+}
+
+/**
+ * Function is nothrow.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ */
+template<typename A, typename V>
+void FunctionMaxima<A, V>::disable_hash_index() noexcept {
+    pImpl->disableHashIndex();
+}
+
+/**
+ * Function is nothrow.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ * @return true if lookups are served by the hash index.
+ */
+template<typename A, typename V>
+bool FunctionMaxima<A, V>::has_hash_index() const noexcept {
+    return pImpl->hasHashIndex();
+}
+
+/**
+ * Enables lazy maintenance of maxima for write-heavy phases: set_value() and erase() update only
+ * the points (dropping the maxima entry of a removed point) and record the written arguments, and maxima
+ * are repaired in one pass over the recorded arguments on the next mx_begin() or mx_end() (merge(), split_at()
+ * and join() repair them first, copies classify their maxima anew), so a write costs about one search
+ * instead of up to three maxima updates.
+ * Observable results are the same as in the eager mode. mx_begin() and mx_end() may then throw
+ * (with strong guarantee). They repair maxima under an internal lock, so like other const functions
+ * they may still be called concurrently with each other (and with copying); the lock is taken only
+ * while a repair is due.
+ * Function is nothrow.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ */
+template<typename A, typename V>
+void FunctionMaxima<A, V>::enable_lazy_maxima() noexcept {
+    pImpl->enableLazyMaxima();
+}
+
+/**
+ * Repairs maxima and switches back to updating them on every write.
+ * Function has strong guarantee.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ */
+template<typename A, typename V>
+void FunctionMaxima<A, V>::disable_lazy_maxima() {
+    pImpl->disableLazyMaxima();
+}
+
+/**
+ * Function is nothrow.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ * @return true if maxima are maintained lazily.
+ */
+template<typename A, typename V>
+bool FunctionMaxima<A, V>::has_lazy_maxima() const noexcept {
+    return pImpl->hasLazyMaxima();
+}
+
+/**
+ * Counters of hot-path events of all functions of this instantiation since the start
+ * or the last reset_stats(): invocations of both comparators, allocations made by point_type
+ * and by the rollback bookkeeping of set_value() and erase() (multiset nodes are not counted),
+ * rollbacks, neighbour walks, and insertions and erasures of maxima made by set_value() and erase()
+ * (other operations count only some of them).
+ * Counting is enabled by defining MAXIMA_STATS, otherwise it costs nothing and all counters are 0.
+ * Function is nothrow.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ * @return snapshot of the counters.
+ */
+template<typename A, typename V>
+MaximaStats FunctionMaxima<A, V>::stats() noexcept {
+    return Stats::snapshot();
+}
+
+/**
+ * Resets counters returned by stats(). Function is nothrow.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ */
+template<typename A, typename V>
+void FunctionMaxima<A, V>::reset_stats() noexcept {
+    Stats::reset();
+}
+
 /**
  * Function is nothrow because size() on std::multiset is nothrow.
  *
@@ -0,0 +1,179 @@
+#ifndef MAXIMA_INSTRUMENTED_FUNCTION_MAXIMA_H
+#define MAXIMA_INSTRUMENTED_FUNCTION_MAXIMA_H
+
+#include "function_maxima.h"
+#include "latency_histogram.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+
+/*********************************MAXIMA_OPERATION*********************************/
+
+/**
+ * Operations of FunctionMaxima whose latencies are recorded by InstrumentedFunctionMaxima.
+ */
+enum class MaximaOperation {
+    valueAt,
+    setValue,
+    erase,
+    find,
+    copy,
+    assignment,
+    operationCount
+};
+
+/*********************************INSTRUMENTED_FUNCTION_MAXIMA*********************************/
+
+/**
+ * FunctionMaxima that records latency of value_at(), set_value(), erase(), find(),
+ * copying and copy assignment in one LatencyHistogram per operation.
+ * Latencies are taken with std::chrono::steady_clock (a vDSO call, no syscall),
+ * operations that throw are recorded as well.
+ * A copy shares the histograms of the original, so a whole workload reports to one place;
+ * assignment keeps the histograms of the assigned-to function.
+ * Not thread-safe: functions sharing histograms must not be used concurrently.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ */
+template<typename A, typename V>
+class InstrumentedFunctionMaxima {
+public:
+    using function_type = FunctionMaxima<A, V>;
+    using point_type = typename function_type::point_type;
+    using size_type = typename function_type::size_type;
+    using iterator = typename function_type::iterator;
+    using mx_iterator = typename function_type::mx_iterator;
+
+    InstrumentedFunctionMaxima() : histograms(std::make_shared<Histograms>()) {}
+
+    InstrumentedFunctionMaxima(const InstrumentedFunctionMaxima &rhs)
+            : histograms(rhs.histograms), function(timed(MaximaOperation::copy, [&rhs]() {
+        return rhs.function;
+    })) {}
+
+    /**
+     * Function has strong guarantee, because copy assignment of FunctionMaxima has one.
+     */
+    InstrumentedFunctionMaxima &operator=(const InstrumentedFunctionMaxima &rhs) {
+        timed(MaximaOperation::assignment, [this, &rhs]() {
+            function = rhs.function;
+        });
+
+        return *this;
+    }
+
+    InstrumentedFunctionMaxima(InstrumentedFunctionMaxima &&rhs) noexcept = default;
+
+    InstrumentedFunctionMaxima &operator=(InstrumentedFunctionMaxima &&rhs) noexcept = default;
+
+    V const &value_at(A const &a) const {
+        return timed(MaximaOperation::valueAt, [this, &a]() -> V const & {
+            return function.value_at(a);
+        });
+    }
+
+    void set_value(A const &a, V const &v) {
+        timed(MaximaOperation::setValue, [this, &a, &v]() {
+            function.set_value(a, v);
+        });
+    }
+
+    void erase(A const &a) {
+        timed(MaximaOperation::erase, [this, &a]() {
+            function.erase(a);
+        });
+    }
+
+    iterator find(A const &a) const {
+        return timed(MaximaOperation::find, [this, &a]() {
+            return function.find(a);
+        });
+    }
+
+    iterator begin() const noexcept {
+        return function.begin();
+    }
+
+    iterator end() const noexcept {
+        return function.end();
+    }
+
+    mx_iterator mx_begin() const {
+        return function.mx_begin();
+    }
+
+    mx_iterator mx_end() const {
+        return function.mx_end();
+    }
+
+    size_type size() const noexcept {
+        return function.size();
+    }
+
+    const function_type &unwrap() const noexcept {
+        return function;
+    }
+
+    const LatencyHistogram &histogram(MaximaOperation operation) const noexcept {
+        return histograms->of[static_cast<std::size_t>(operation)];
+    }
+
+    void reset_latencies() noexcept {
+        for (auto &h : histograms->of) {
+            h.reset();
+        }
+    }
+
+    /**
+     * Prints p50, p99, p99.9 and max latency (in nanoseconds) of every operation recorded at least once.
+     */
+    void dump(std::FILE *out) const {
+        static const char *names[] = {"value_at", "set_value", "erase", "find", "copy", "assignment"};
+
+        for (std::size_t i = 0; i < static_cast<std::size_t>(MaximaOperation::operationCount); i++) {
+            if (histograms->of[i].count() > 0) {
+                histograms->of[i].dump(out, names[i]);
+            }
+        }
+    }
+
+private:
+    struct Histograms {
+        LatencyHistogram of[static_cast<std::size_t>(MaximaOperation::operationCount)];
+    };
+
+    /**
+     * Records time between its construction and destruction, so the operation
+     * is recorded also if it exits with an exception.
+     */
+    class Stopwatch {
+    public:
+        explicit Stopwatch(LatencyHistogram &histogram) noexcept
+                : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+
+        ~Stopwatch() {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            histogram.record(static_cast<std::uint64_t>(
+                                     std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+
+    private:
+        LatencyHistogram &histogram;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    template<typename Operation>
+    decltype(auto) timed(MaximaOperation operation, Operation op) const {
+        Stopwatch stopwatch(histograms->of[static_cast<std::size_t>(operation)]);
+
+        return op();
+    }
+
+    std::shared_ptr<Histograms> histograms;
+    function_type function;
+};
+
+#endif //MAXIMA_INSTRUMENTED_FUNCTION_MAXIMA_H
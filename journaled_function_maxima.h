@@ -0,0 +1,580 @@
+#ifndef MAXIMA_JOURNALED_FUNCTION_MAXIMA_H
+#define MAXIMA_JOURNALED_FUNCTION_MAXIMA_H
+
+#include "function_maxima.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*********************************MAXIMA_JOURNAL_CODEC*********************************/
+
+/**
+ * Bounds-checked cursor over the payload of one journal record.
+ */
+class MaximaJournalReader {
+public:
+    MaximaJournalReader(const char *begin, const char *end) noexcept : pos(begin), end(end) {}
+
+    /**
+     * Copies the next n bytes to target. Throws std::runtime_error if the payload is shorter.
+     */
+    void read(void *target, std::size_t n) {
+        if (static_cast<std::size_t>(end - pos) < n) {
+            throw std::runtime_error("truncated journal record");
+        }
+
+        std::memcpy(target, pos, n);
+        pos += n;
+    }
+
+    /**
+     * @return number of bytes of the payload not yet read.
+     */
+    std::size_t remaining() const noexcept {
+        return static_cast<std::size_t>(end - pos);
+    }
+
+private:
+    const char *pos;
+    const char *end;
+};
+
+/**
+ * Binary encoding of arguments and values in journal records and snapshots of JournaledFunctionMaxima.
+ * Trivially copyable types are stored as their bytes (the files are meant to be read on the same machine),
+ * std::string as its length followed by its characters. Other types can opt in by specializing this struct
+ * with static void encode(const T &, std::string &out) appending the encoding to out
+ * and static T decode(MaximaJournalReader &in).
+ *
+ * @tparam T - type of the encoded arguments or values
+ */
+template<typename T, typename = void>
+struct MaximaJournalCodec;
+
+template<typename T>
+struct MaximaJournalCodec<T, std::enable_if_t<std::is_trivially_copyable<T>::value>> {
+    static void encode(const T &t, std::string &out) {
+        out.append(reinterpret_cast<const char *>(&t), sizeof(T));
+    }
+
+    static T decode(MaximaJournalReader &in) {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        in.read(&storage, sizeof(T));
+
+        return *reinterpret_cast<const T *>(&storage);
+    }
+};
+
+template<>
+struct MaximaJournalCodec<std::string> {
+    static void encode(const std::string &s, std::string &out) {
+        MaximaJournalCodec<std::uint64_t>::encode(s.size(), out);
+        out += s;
+    }
+
+    static std::string decode(MaximaJournalReader &in) {
+        std::uint64_t length = MaximaJournalCodec<std::uint64_t>::decode(in);
+
+        // Checked before allocating: a corrupted length must not request gigabytes.
+        if (length > in.remaining()) {
+            throw std::runtime_error("truncated journal record");
+        }
+
+        std::string s(static_cast<std::size_t>(length), '\0');
+        in.read(&s[0], s.size());
+
+        return s;
+    }
+};
+
+/*********************************JOURNALED_FUNCTION_MAXIMA*********************************/
+
+/**
+ * FunctionMaxima that survives crashes: every set_value() and erase() is appended to a write-ahead log
+ * (path + ".log") and checkpoint() writes the whole function to a snapshot (path + ".snapshot")
+ * and empties the log. Constructing the function from the same path recovers the last snapshot
+ * and replays the log on top of it.
+ *
+ * Records are written in groups (group commit): a change is kept in memory until groupSize changes
+ * are pending and then the whole group is written with one write() and one fsync(), so the cost
+ * of the fsync is shared by the group. A change is durable once sync() returns (sync() is also called
+ * by the destructor, best effort); a crash may lose the changes of the last unsynced group.
+ * Each record carries its length and a checksum, so recovery stops at a record torn by a crash
+ * (or one of unknown type) and cuts it off the log.
+ *
+ * Not thread-safe, like FunctionMaxima. The log and the snapshot are in native byte order.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ */
+template<typename A, typename V>
+class JournaledFunctionMaxima {
+public:
+    using function_type = FunctionMaxima<A, V>;
+    using point_type = typename function_type::point_type;
+    using size_type = typename function_type::size_type;
+    using iterator = typename function_type::iterator;
+    using mx_iterator = typename function_type::mx_iterator;
+
+    /**
+     * Opens (creating if needed) the log and the snapshot at path and recovers their content.
+     * Throws std::system_error if a file can not be read or written
+     * and std::runtime_error if the snapshot or the header of the log is corrupted.
+     *
+     * @param path      - common prefix of the log and the snapshot files
+     * @param groupSize - number of changes written and synced together (at least 1)
+     */
+    explicit JournaledFunctionMaxima(std::string path, size_type groupSize = 64)
+            : path(std::move(path)), groupSize(std::max<size_type>(groupSize, 1)) {
+        recoverSnapshot();
+        openLog();
+    }
+
+    JournaledFunctionMaxima(const JournaledFunctionMaxima &) = delete;
+
+    JournaledFunctionMaxima &operator=(const JournaledFunctionMaxima &) = delete;
+
+    /**
+     * Syncs the pending group. Errors are swallowed, the group is then lost as if the process crashed.
+     */
+    ~JournaledFunctionMaxima() {
+        try {
+            sync();
+        }
+        catch (...) {}
+
+        ::close(log);
+    }
+
+    V const &value_at(A const &a) const {
+        return function.value_at(a);
+    }
+
+    /**
+     * Syncs the group as soon as the change completes it.
+     * Function has strong guarantee, except when the sync of the group completed by the change fails:
+     * the change is then kept in the function and in the pending group (not yet durable) and the
+     * std::system_error of the sync is thrown, so the caller learns that the group is not on disk;
+     * the next change or sync() retries it. A full group left this way is synced before anything else
+     * (if that fails again, nothing was changed) and the record is dropped from the group if the change throws.
+     */
+    void set_value(A const &a, V const &v) {
+        journaled(setRecord, [this, &a, &v]() {
+            function.set_value(a, v);
+        }, a, &v);
+    }
+
+    /**
+     * Function has strong guarantee, see set_value().
+     */
+    void erase(A const &a) {
+        journaled(eraseRecord, [this, &a]() {
+            function.erase(a);
+        }, a, nullptr);
+    }
+
+    iterator find(A const &a) const {
+        return function.find(a);
+    }
+
+    iterator begin() const noexcept {
+        return function.begin();
+    }
+
+    iterator end() const noexcept {
+        return function.end();
+    }
+
+    mx_iterator mx_begin() const {
+        return function.mx_begin();
+    }
+
+    mx_iterator mx_end() const {
+        return function.mx_end();
+    }
+
+    size_type size() const noexcept {
+        return function.size();
+    }
+
+    const function_type &unwrap() const noexcept {
+        return function;
+    }
+
+    /**
+     * @return number of changes not yet written to the log.
+     */
+    size_type pending() const noexcept {
+        return pendingRecords;
+    }
+
+    /**
+     * Writes the pending group to the log and waits until it is on disk.
+     * Throws std::system_error on failure; the group then stays pending and the log is cut back
+     * to its last synced size, so sync() can be retried.
+     */
+    void sync() {
+        if (pendingRecords == 0) {
+            return;
+        }
+
+        try {
+            writeAll(log, group);
+            syncFile(log, "fsync of journal");
+        }
+        catch (...) {
+            // A partly written group would hide the records appended after it from recovery.
+            [[maybe_unused]] int ignored = ::ftruncate(log, static_cast<off_t>(logSize));
+
+            throw;
+        }
+
+        logSize += group.size();
+        group.clear();
+        pendingRecords = 0;
+    }
+
+    /**
+     * Writes the whole function to a new snapshot, replaces the old one with it (rename()) and empties the log.
+     * A crash before the log is emptied is harmless: set_value() and erase() overwrite whole points,
+     * so replaying the log on top of the snapshot that already contains its changes gives the same function.
+     * Function has strong guarantee with respect to the recovered state: until the rename
+     * the old snapshot and log stay in place.
+     */
+    void checkpoint() {
+        sync();
+
+        std::string snapshot = snapshotHeader();
+
+        for (const point_type &p : function) {
+            appendRecord(snapshot, setRecord, p.arg(), &p.value());
+        }
+
+        std::string temporary = path + ".snapshot.tmp";
+        int file = openFile(temporary, O_WRONLY | O_CREAT | O_TRUNC);
+
+        try {
+            writeAll(file, snapshot);
+            syncFile(file, "fsync of snapshot");
+        }
+        catch (...) {
+            ::close(file);
+            ::unlink(temporary.c_str());
+
+            throw;
+        }
+
+        ::close(file);
+
+        if (::rename(temporary.c_str(), snapshotPath().c_str()) != 0) {
+            throw std::system_error(errno, std::generic_category(), "rename of snapshot");
+        }
+
+        syncDirectory();
+
+        if (::ftruncate(log, static_cast<off_t>(logHeader().size())) != 0) {
+            throw std::system_error(errno, std::generic_category(), "truncation of journal");
+        }
+
+        syncFile(log, "fsync of journal");
+        logSize = logHeader().size();
+    }
+
+private:
+    enum RecordType : char {
+        setRecord = 's',
+        eraseRecord = 'e'
+    };
+
+    /**
+     * Layout of a record: payload length and checksum (both std::uint32_t), then the payload:
+     * record type, encoded argument and, for setRecord, encoded value.
+     */
+    static constexpr std::size_t recordHeader = 2 * sizeof(std::uint32_t);
+
+    template<typename Change>
+    void journaled(RecordType type, Change change, const A &a, const V *v) {
+        if (pendingRecords >= groupSize) {
+            sync();
+        }
+
+        size_t groupEnd = group.size();
+
+        try {
+            appendRecord(group, type, a, v);
+            change();
+        }
+        catch (...) {
+            group.resize(groupEnd);
+
+            throw;
+        }
+
+        pendingRecords++;
+
+        if (pendingRecords >= groupSize) {
+            sync();
+        }
+    }
+
+    static void appendRecord(std::string &out, RecordType type, const A &a, const V *v) {
+        size_t start = out.size();
+        out.append(recordHeader, '\0');
+        out += static_cast<char>(type);
+        MaximaJournalCodec<A>::encode(a, out);
+
+        if (v != nullptr) {
+            MaximaJournalCodec<V>::encode(*v, out);
+        }
+
+        std::uint32_t length = static_cast<std::uint32_t>(out.size() - start - recordHeader);
+        std::uint32_t sum = checksum(out.data() + start + recordHeader, length);
+        std::memcpy(&out[start], &length, sizeof(length));
+        std::memcpy(&out[start + sizeof(length)], &sum, sizeof(sum));
+    }
+
+    /**
+     * 32-bit FNV-1a, enough to tell a torn record from a complete one.
+     */
+    static std::uint32_t checksum(const char *data, size_t n) noexcept {
+        std::uint32_t hash = 2166136261u;
+
+        for (size_t i = 0; i < n; i++) {
+            hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+        }
+
+        return hash;
+    }
+
+    /**
+     * Calls apply(type, argument reader) for each complete record of data starting at offset.
+     * A record of unknown type is corrupted (its checksum matched by chance or the file was damaged),
+     * so replay stops before it like before a torn record.
+     *
+     * @return offset just past the last complete record.
+     */
+    template<typename Apply>
+    static size_t replay(const std::string &data, size_t offset, Apply apply) {
+        while (data.size() - offset >= recordHeader) {
+            std::uint32_t length, sum;
+            std::memcpy(&length, data.data() + offset, sizeof(length));
+            std::memcpy(&sum, data.data() + offset + sizeof(length), sizeof(sum));
+
+            const char *payload = data.data() + offset + recordHeader;
+
+            if (length == 0 || data.size() - offset - recordHeader < length || checksum(payload, length) != sum) {
+                break;
+            }
+
+            RecordType type = static_cast<RecordType>(payload[0]);
+
+            if (type != setRecord && type != eraseRecord) {
+                break;
+            }
+
+            MaximaJournalReader in(payload + 1, payload + length);
+            apply(type, in);
+            offset += recordHeader + length;
+        }
+
+        return offset;
+    }
+
+    void recoverSnapshot() {
+        std::string data;
+
+        if (!readFile(snapshotPath(), data)) {
+            return;
+        }
+
+        const std::string header = snapshotHeader();
+
+        if (data.compare(0, header.size(), header) != 0) {
+            throw std::runtime_error("corrupted snapshot header");
+        }
+
+        std::vector<std::pair<A, V>> points;
+        size_t end = replay(data, header.size(), [&points](RecordType type, MaximaJournalReader &in) {
+            if (type != setRecord) {
+                throw std::runtime_error("corrupted snapshot record");
+            }
+
+            A a = MaximaJournalCodec<A>::decode(in);
+            points.emplace_back(std::move(a), MaximaJournalCodec<V>::decode(in));
+        });
+
+        if (end != data.size()) {
+            throw std::runtime_error("corrupted snapshot record");
+        }
+
+        function.assign(points.begin(), points.end());
+    }
+
+    void openLog() {
+        std::string data;
+        readFile(logPath(), data);
+        const std::string header = logHeader();
+        size_t headerPart = std::min(data.size(), header.size());
+
+        // A log shorter than its header is torn only if it holds the beginning of the header.
+        if (data.compare(0, headerPart, header, 0, headerPart) != 0) {
+            throw std::runtime_error("corrupted journal header");
+        }
+
+        log = openFile(logPath(), O_WRONLY | O_CREAT | O_APPEND);
+
+        try {
+            if (data.size() < header.size()) {
+                // A new log, or one torn before its header reached the disk.
+                if (::ftruncate(log, 0) != 0) {
+                    throw std::system_error(errno, std::generic_category(), "truncation of journal");
+                }
+
+                writeAll(log, header);
+                syncFile(log, "fsync of journal");
+                logSize = header.size();
+
+                return;
+            }
+
+            logSize = replay(data, header.size(), [this](RecordType type, MaximaJournalReader &in) {
+                A a = MaximaJournalCodec<A>::decode(in);
+
+                if (type == setRecord) {
+                    function.set_value(a, MaximaJournalCodec<V>::decode(in));
+                } else {
+                    function.erase(a);
+                }
+            });
+
+            if (logSize != data.size()) {
+                if (::ftruncate(log, static_cast<off_t>(logSize)) != 0) {
+                    throw std::system_error(errno, std::generic_category(), "truncation of journal");
+                }
+
+                syncFile(log, "fsync of journal");
+            }
+        }
+        catch (...) {
+            ::close(log);
+
+            throw;
+        }
+    }
+
+    static std::string logHeader() {
+        return "MXJLOG01";
+    }
+
+    static std::string snapshotHeader() {
+        return "MXJSNP01";
+    }
+
+    std::string logPath() const {
+        return path + ".log";
+    }
+
+    std::string snapshotPath() const {
+        return path + ".snapshot";
+    }
+
+    static int openFile(const std::string &name, int flags) {
+        int file = ::open(name.c_str(), flags | O_CLOEXEC, 0644);
+
+        if (file < 0) {
+            throw std::system_error(errno, std::generic_category(), "open of " + name);
+        }
+
+        return file;
+    }
+
+    /**
+     * @return false if the file does not exist.
+     */
+    static bool readFile(const std::string &name, std::string &data) {
+        int file = ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (file < 0) {
+            if (errno == ENOENT) {
+                return false;
+            }
+
+            throw std::system_error(errno, std::generic_category(), "open of " + name);
+        }
+
+        char buffer[1 << 16];
+        ssize_t n;
+
+        while ((n = ::read(file, buffer, sizeof(buffer))) != 0) {
+            if (n < 0 && errno != EINTR) {
+                int error = errno;
+                ::close(file);
+
+                throw std::system_error(error, std::generic_category(), "read of " + name);
+            }
+
+            if (n > 0) {
+                data.append(buffer, static_cast<size_t>(n));
+            }
+        }
+
+        ::close(file);
+
+        return true;
+    }
+
+    static void writeAll(int file, const std::string &data) {
+        for (size_t written = 0; written < data.size();) {
+            ssize_t n = ::write(file, data.data() + written, data.size() - written);
+
+            if (n < 0 && errno != EINTR) {
+                throw std::system_error(errno, std::generic_category(), "write");
+            }
+
+            written += n > 0 ? static_cast<size_t>(n) : 0;
+        }
+    }
+
+    static void syncFile(int file, const char *what) {
+        if (::fsync(file) != 0) {
+            throw std::system_error(errno, std::generic_category(), what);
+        }
+    }
+
+    /**
+     * Makes the rename of the snapshot durable. Best effort: not every file system allows syncing directories.
+     */
+    void syncDirectory() const {
+        size_t slash = path.find_last_of('/');
+        std::string directory = slash == std::string::npos ? "." : path.substr(0, std::max<size_t>(slash, 1));
+        int file = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (file >= 0) {
+            ::fsync(file);
+            ::close(file);
+        }
+    }
+
+    std::string path;
+    size_type groupSize;
+    function_type function;
+
+    int log = -1;
+    size_t logSize = 0;    // bytes of the log known to be on disk
+    std::string group;     // encoded pending records
+    size_type pendingRecords = 0;
+};
+
+#endif //MAXIMA_JOURNALED_FUNCTION_MAXIMA_H
@@ -0,0 +1,141 @@
+#ifndef MAXIMA_LATENCY_HISTOGRAM_H
+#define MAXIMA_LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+/*********************************LATENCY_HISTOGRAM*********************************/
+
+/**
+ * HDR-style histogram of latencies in nanoseconds.
+ * Values below 2 * subBuckets are recorded exactly, every larger power of two range
+ * is split into subBuckets equal buckets, so the relative error of any reported value
+ * is below 1 / subBuckets (about 3%) while the whole 64 bit range takes less than 2000 counters.
+ * Recording is a few shifts and one increment, no allocation.
+ */
+class LatencyHistogram {
+public:
+    static constexpr unsigned subBucketBits = 5;
+    static constexpr std::uint64_t subBuckets = 1u << subBucketBits;
+
+    LatencyHistogram() : counts((64 - subBucketBits + 1) * subBuckets) {}
+
+    void record(std::uint64_t nanoseconds) noexcept {
+        counts[indexOf(nanoseconds)]++;
+        total++;
+
+        if (maximum < nanoseconds) {
+            maximum = nanoseconds;
+        }
+    }
+
+    std::uint64_t count() const noexcept {
+        return total;
+    }
+
+    std::uint64_t max() const noexcept {
+        return maximum;
+    }
+
+    /**
+     * @param quantile - number from [0, 1], e.g. 0.99 for p99
+     * @return         - highest value equivalent (within precision of the histogram) to the
+     *                   smallest recorded value such that at least quantile of all values are not greater,
+     *                   or 0 if nothing was recorded.
+     */
+    std::uint64_t percentile(double quantile) const noexcept {
+        if (total == 0) {
+            return 0;
+        }
+
+        auto rank = static_cast<std::uint64_t>(quantile * static_cast<double>(total) + 0.5);
+        rank = rank == 0 ? 1 : (rank > total ? total : rank);
+        std::uint64_t seen = 0;
+
+        for (std::size_t i = 0; i < counts.size(); i++) {
+            seen += counts[i];
+
+            if (seen >= rank) {
+                std::uint64_t highest = lowerBound(i + 1) - 1;
+
+                return highest < maximum ? highest : maximum;
+            }
+        }
+
+        return maximum;
+    }
+
+    void merge(const LatencyHistogram &other) noexcept {
+        for (std::size_t i = 0; i < counts.size(); i++) {
+            counts[i] += other.counts[i];
+        }
+
+        total += other.total;
+        maximum = maximum < other.maximum ? other.maximum : maximum;
+    }
+
+    void reset() noexcept {
+        std::fill(counts.begin(), counts.end(), 0);
+        total = 0;
+        maximum = 0;
+    }
+
+    /**
+     * Prints one line with the number of samples, p50, p99, p99.9 and max (in nanoseconds).
+     */
+    void dump(std::FILE *out, const char *name) const {
+        std::fprintf(out, "%-12s count: %10llu  p50: %10llu  p99: %10llu  p99.9: %10llu  max: %10llu\n", name,
+                     static_cast<unsigned long long>(total),
+                     static_cast<unsigned long long>(percentile(0.5)),
+                     static_cast<unsigned long long>(percentile(0.99)),
+                     static_cast<unsigned long long>(percentile(0.999)),
+                     static_cast<unsigned long long>(maximum));
+    }
+
+private:
+    static unsigned highestBit(std::uint64_t v) noexcept {
+#if defined(__GNUC__)
+        return 63 - static_cast<unsigned>(__builtin_clzll(v));
+#else
+        unsigned bit = 0;
+
+        while (v >>= 1) {
+            bit++;
+        }
+
+        return bit;
+#endif
+    }
+
+    static std::size_t indexOf(std::uint64_t v) noexcept {
+        if (v < 2 * subBuckets) {
+            return static_cast<std::size_t>(v);
+        }
+
+        unsigned shift = highestBit(v) - subBucketBits;
+
+        return static_cast<std::size_t>((shift + 1) * subBuckets + ((v >> shift) - subBuckets));
+    }
+
+    /**
+     * @return - smallest value recorded in bucket i (for the bucket past the last one: 2^64, wrapped to 0).
+     */
+    static std::uint64_t lowerBound(std::size_t i) noexcept {
+        if (i < 2 * subBuckets) {
+            return i;
+        }
+
+        std::uint64_t shift = i / subBuckets - 1;
+
+        return (subBuckets + i % subBuckets) << shift;
+    }
+
+    std::vector<std::uint64_t> counts;
+    std::uint64_t total = 0;
+    std::uint64_t maximum = 0;
+};
+
+#endif //MAXIMA_LATENCY_HISTOGRAM_H
@@ -0,0 +1,579 @@
+#ifndef MAXIMA_LSM_FUNCTION_MAXIMA_H
+#define MAXIMA_LSM_FUNCTION_MAXIMA_H
+
+#include "function_maxima.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*********************************LSM_FUNCTION_MAXIMA*********************************/
+
+/**
+ * Write-optimized variant of FunctionMaxima for workloads dominated by set_value() and erase().
+ * Writes go to a small sorted write buffer and do not touch maxima at all. A full buffer is flushed
+ * as an immutable sorted run; a new run is merged with the runs before it while they are
+ * at most lsmRunRatio times larger, so there are O(log n) runs and every point is copied O(log n) times.
+ * Erased arguments are kept as tombstones until they reach the oldest run.
+ *
+ * value_at() and contains() consult the buffer and then the runs from the newest one.
+ * Maxima are recomputed in one pass whenever everything is merged into a single run.
+ * begin(), find(), mx_begin() and size() need that state, so they merge all runs first.
+ * That makes them amortized O(n) after writes, and O(1) or O(log n) while the function is only read.
+ * Because they compact, they are not const: const functions (value_at(), contains(), run_count())
+ * only read, so they may be called concurrently like those of FunctionMaxima.
+ *
+ * Like DenseFunctionMaxima::point_type, point_type refers to the storage of the function
+ * and iterators return it by value (input iterators to the standard library, bidirectional to C++20 ranges).
+ * It is valid, as are all iterators, only until the next modification or compaction.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values, its move constructor must not throw
+ */
+template<typename A, typename V>
+class LsmFunctionMaxima {
+    static_assert(std::is_nothrow_move_constructible<V>::value,
+                  "LsmFunctionMaxima requires a value type with a nothrow move constructor");
+
+public:
+    class point_type;
+
+    class iterator;
+
+    class mx_iterator;
+
+    using size_type = std::size_t;
+
+    /**
+     * Default capacity of the write buffer.
+     */
+    static constexpr size_type defaultBufferCapacity = 4096;
+
+    explicit LsmFunctionMaxima(size_type bufferCapacity = defaultBufferCapacity)
+            : bufferCapacity(std::max<size_type>(bufferCapacity, 1)) {}
+
+    V const &value_at(A const &a) const;
+
+    bool contains(A const &a) const;
+
+    void set_value(A const &a, V const &v);
+
+    void erase(A const &a);
+
+    iterator begin();
+
+    iterator end();
+
+    iterator find(A const &a);
+
+    mx_iterator mx_begin();
+
+    mx_iterator mx_end();
+
+    size_type size();
+
+    /**
+     * Merges the buffer and all runs into one run and recomputes maxima.
+     */
+    void compact() {
+        compactAll();
+    }
+
+    /**
+     * @return number of sorted runs, not counting the write buffer.
+     */
+    size_type run_count() const noexcept {
+        return runs.size();
+    }
+
+private:
+    /**
+     * Point of a run, a tombstone if value is empty.
+     */
+    struct Entry {
+        A argument;
+        std::optional<V> value;
+    };
+
+    using run_type = std::vector<Entry>;
+
+    /**
+     * A new run is merged with the previous one while the previous one is at most lsmRunRatio times larger.
+     */
+    static constexpr size_type lsmRunRatio = 2;
+
+    static bool argLess(const Entry &e, const A &a) {
+        return e.argument < a;
+    }
+
+    /**
+     * @return the newest entry of a in the buffer or the runs, or nullptr if a was never written.
+     */
+    const std::optional<V> *lookup(const A &a) const {
+        auto it = buffer.find(a);
+
+        if (it != buffer.end()) {
+            return &it->second;
+        }
+
+        for (auto run = runs.rbegin(); run != runs.rend(); ++run) {
+            auto found = std::lower_bound(run->begin(), run->end(), a, argLess);
+
+            if (found != run->end() && !(a < found->argument)) {
+                return &found->value;
+            }
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * Writes value (a tombstone if empty) to the buffer. A full buffer is flushed first,
+     * so a failed flush leaves everything unchanged.
+     * Function has strong guarantee: the copy of the value is made before the buffer is touched
+     * and it is moved in without throwing.
+     */
+    void write(const A &a, std::optional<V> value) {
+        auto it = buffer.find(a);
+
+        if (it != buffer.end()) {
+            it->second.reset();
+
+            if (value) {
+                it->second.emplace(std::move(*value));
+            }
+
+            return;
+        }
+
+        if (buffer.size() >= bufferCapacity) {
+            flush();
+        }
+
+        buffer.emplace(a, std::move(value));
+    }
+
+    run_type bufferRun() const {
+        run_type run;
+        run.reserve(buffer.size());
+
+        for (const auto &entry : buffer) {
+            run.push_back({entry.first, entry.second});
+        }
+
+        return run;
+    }
+
+    /**
+     * Merges two runs, entries of newer win. If maxima is not nullptr, the result becomes the only run:
+     * tombstones are dropped and every point is classified as soon as its right neighbour is known,
+     * so maxima are recomputed during the merge. They are stored in maxima as positions
+     * in the order of mx_iterator.
+     * Function has strong guarantee: it only reads older and newer.
+     */
+    static run_type mergeRuns(const run_type &older, const run_type &newer, std::vector<size_type> *maxima) {
+        run_type result;
+        result.reserve(older.size() + newer.size());
+        auto o = older.begin(), n = newer.begin();
+
+        auto classify = [&](size_type i) {
+            const V *left = i > 0 ? &*result[i - 1].value : nullptr;
+            const V *right = i + 1 < result.size() ? &*result[i + 1].value : nullptr;
+
+            if (MaximaValueOrder<V>::isMaximum(left, *result[i].value, right)) {
+                maxima->push_back(i);
+            }
+        };
+
+        auto emit = [&](const Entry &entry) {
+            if (maxima == nullptr) {
+                result.push_back(entry);
+            } else if (entry.value) {
+                result.push_back(entry);
+
+                if (result.size() >= 2) {
+                    classify(result.size() - 2);
+                }
+            }
+        };
+
+        while (o != older.end() || n != newer.end()) {
+            if (n == newer.end() || (o != older.end() && o->argument < n->argument)) {
+                emit(*o++);
+            } else {
+                if (o != older.end() && !(n->argument < o->argument)) {
+                    ++o;
+                }
+
+                emit(*n++);
+            }
+        }
+
+        if (maxima != nullptr && !result.empty()) {
+            classify(result.size() - 1);
+            std::sort(maxima->begin(), maxima->end(), [&result](size_type i, size_type j) {
+                return MaximaValueOrder<V>::maximumBefore(*result[i].value, result[i].argument,
+                                                          *result[j].value, result[j].argument);
+            });
+        }
+
+        return result;
+    }
+
+    /**
+     * Turns the buffer into a run and merges it with the newest runs while they are at most
+     * lsmRunRatio times larger. Everything is built aside and committed without throwing,
+     * so the function has strong guarantee.
+     */
+    void flush() {
+        if (buffer.empty()) {
+            return;
+        }
+
+        run_type merged = bufferRun();
+        std::vector<size_type> newMaxima;
+        size_type keep = runs.size();
+
+        if (runs.empty()) {
+            merged = mergeRuns(run_type(), merged, &newMaxima);
+        }
+
+        while (keep > 0 && runs[keep - 1].size() <= lsmRunRatio * merged.size()) {
+            merged = mergeRuns(runs[keep - 1], merged, keep == 1 ? &newMaxima : nullptr);
+            keep--;
+        }
+
+        commit(keep, std::move(merged), std::move(newMaxima));
+    }
+
+    /**
+     * Merges the buffer and all runs into a single run, see flush().
+     */
+    void compactAll() {
+        if (buffer.empty() && runs.size() <= 1) {
+            return;
+        }
+
+        run_type merged = bufferRun();
+        std::vector<size_type> newMaxima;
+
+        if (runs.empty()) {
+            merged = mergeRuns(run_type(), merged, &newMaxima);
+        }
+
+        for (size_type keep = runs.size(); keep > 0; keep--) {
+            merged = mergeRuns(runs[keep - 1], merged, keep == 1 ? &newMaxima : nullptr);
+        }
+
+        commit(0, std::move(merged), std::move(newMaxima));
+    }
+
+    /**
+     * Replaces runs from position keep on with merged and empties the buffer.
+     * If keep is 0, merged is the whole function and newMaxima are its maxima.
+     * Only the reservation may throw, and it happens before anything changes.
+     */
+    void commit(size_type keep, run_type &&merged, std::vector<size_type> &&newMaxima) {
+        if (runs.capacity() < keep + 1) {
+            runs.reserve(keep + 1);
+        }
+
+        runs.erase(runs.begin() + static_cast<std::ptrdiff_t>(keep), runs.end());
+        runs.push_back(std::move(merged));
+        buffer.clear();
+
+        if (keep == 0) {
+            maxima.swap(newMaxima);
+        }
+    }
+
+    size_type bufferCapacity;
+
+    std::map<A, std::optional<V>> buffer;
+    std::vector<run_type> runs;
+
+    /**
+     * Positions of maxima in runs[0], valid iff it is the only run and the buffer is empty.
+     */
+    std::vector<size_type> maxima;
+};
+
+/*********************************LSM_POINT_TYPE*********************************/
+
+template<typename A, typename V>
+class LsmFunctionMaxima<A, V>::point_type {
+public:
+    A const &arg() const noexcept {
+        return entry->argument;
+    }
+
+    V const &value() const noexcept {
+        return *entry->value;
+    }
+
+private:
+    friend class LsmFunctionMaxima<A, V>;
+
+    explicit point_type(const Entry *entry) noexcept : entry(entry) {}
+
+    const Entry *entry;
+};
+
+/*********************************LSM_ITERATORS*********************************/
+
+template<typename A, typename V>
+class LsmFunctionMaxima<A, V>::iterator {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using iterator_concept = std::bidirectional_iterator_tag;
+    using value_type = point_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = MaximaArrowProxy<point_type>;
+    using reference = point_type;
+
+    iterator() noexcept : entry(nullptr) {}
+
+    reference operator*() const noexcept {
+        return point_type(entry);
+    }
+
+    pointer operator->() const noexcept {
+        return pointer(**this);
+    }
+
+    iterator &operator++() noexcept {
+        ++entry;
+
+        return *this;
+    }
+
+    iterator operator++(int) noexcept {
+        iterator result = *this;
+        ++entry;
+
+        return result;
+    }
+
+    iterator &operator--() noexcept {
+        --entry;
+
+        return *this;
+    }
+
+    iterator operator--(int) noexcept {
+        iterator result = *this;
+        --entry;
+
+        return result;
+    }
+
+    bool operator==(const iterator &rhs) const noexcept {
+        return entry == rhs.entry;
+    }
+
+    bool operator!=(const iterator &rhs) const noexcept {
+        return !(*this == rhs);
+    }
+
+private:
+    friend class LsmFunctionMaxima<A, V>;
+
+    explicit iterator(const Entry *entry) noexcept : entry(entry) {}
+
+    const Entry *entry;
+};
+
+template<typename A, typename V>
+class LsmFunctionMaxima<A, V>::mx_iterator {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using iterator_concept = std::bidirectional_iterator_tag;
+    using value_type = point_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = MaximaArrowProxy<point_type>;
+    using reference = point_type;
+
+    mx_iterator() noexcept : run(nullptr), position(nullptr) {}
+
+    reference operator*() const noexcept {
+        return point_type(run + *position);
+    }
+
+    pointer operator->() const noexcept {
+        return pointer(**this);
+    }
+
+    mx_iterator &operator++() noexcept {
+        ++position;
+
+        return *this;
+    }
+
+    mx_iterator operator++(int) noexcept {
+        mx_iterator result = *this;
+        ++position;
+
+        return result;
+    }
+
+    mx_iterator &operator--() noexcept {
+        --position;
+
+        return *this;
+    }
+
+    mx_iterator operator--(int) noexcept {
+        mx_iterator result = *this;
+        --position;
+
+        return result;
+    }
+
+    bool operator==(const mx_iterator &rhs) const noexcept {
+        return position == rhs.position;
+    }
+
+    bool operator!=(const mx_iterator &rhs) const noexcept {
+        return position != rhs.position;
+    }
+
+private:
+    friend class LsmFunctionMaxima<A, V>;
+
+    mx_iterator(const Entry *run, const size_type *position) noexcept
+            : run(run), position(position) {}
+
+    const Entry *run;
+    const size_type *position;
+};
+
+/*********************************LSM_FUNCTION_MAXIMA_DEFINITIONS*********************************/
+
+/**
+ * Looks a up in the buffer and then in the runs from the newest one, O(log n) per run.
+ * Throws InvalidArg if a has no value.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ * @param a - argument to be searched
+ * @return the value of the found argument, valid until the next modification or compaction
+ */
+template<typename A, typename V>
+V const &LsmFunctionMaxima<A, V>::value_at(const A &a) const {
+    const std::optional<V> *value = lookup(a);
+
+    if (value == nullptr || !*value) {
+        throw InvalidArg("invalid argument value");
+    }
+
+    return **value;
+}
+
+/**
+ * @return true if a has a value, see value_at().
+ */
+template<typename A, typename V>
+bool LsmFunctionMaxima<A, V>::contains(const A &a) const {
+    const std::optional<V> *value = lookup(a);
+
+    return value != nullptr && value->has_value();
+}
+
+/**
+ * Writes the value to the buffer, O(log bufferCapacity) unless the buffer is full and has to be flushed.
+ * Function has strong guarantee.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ * @param a - argument to be updated
+ * @param v - value to be assigned
+ */
+template<typename A, typename V>
+void LsmFunctionMaxima<A, V>::set_value(const A &a, const V &v) {
+    write(a, std::optional<V>(v));
+}
+
+/**
+ * Writes a tombstone of a to the buffer, see set_value(). Erasing a missing argument is not an error.
+ * Function has strong guarantee.
+ */
+template<typename A, typename V>
+void LsmFunctionMaxima<A, V>::erase(const A &a) {
+    write(a, std::nullopt);
+}
+
+/**
+ * Compacts the function first, see LsmFunctionMaxima.
+ *
+ * @return an iterator to the point with the smallest argument.
+ */
+template<typename A, typename V>
+typename LsmFunctionMaxima<A, V>::iterator LsmFunctionMaxima<A, V>::begin() {
+    compactAll();
+
+    return iterator(runs.empty() ? nullptr : runs[0].data());
+}
+
+template<typename A, typename V>
+typename LsmFunctionMaxima<A, V>::iterator LsmFunctionMaxima<A, V>::end() {
+    compactAll();
+
+    return iterator(runs.empty() ? nullptr : runs[0].data() + runs[0].size());
+}
+
+/**
+ * Compacts the function first and binary searches the only run.
+ *
+ * @return an iterator to the point of a or end() if a has no value.
+ */
+template<typename A, typename V>
+typename LsmFunctionMaxima<A, V>::iterator LsmFunctionMaxima<A, V>::find(const A &a) {
+    compactAll();
+
+    if (runs.empty()) {
+        return iterator(nullptr);
+    }
+
+    auto found = std::lower_bound(runs[0].begin(), runs[0].end(), a, argLess);
+
+    if (found != runs[0].end() && !(a < found->argument)) {
+        return iterator(&*found);
+    }
+
+    return end();
+}
+
+/**
+ * Compacts the function first, which recomputes maxima if there were any writes.
+ * Iteration is done in descending order according to the values, ties in ascending order of arguments.
+ */
+template<typename A, typename V>
+typename LsmFunctionMaxima<A, V>::mx_iterator LsmFunctionMaxima<A, V>::mx_begin() {
+    compactAll();
+
+    return mx_iterator(runs.empty() ? nullptr : runs[0].data(), maxima.data());
+}
+
+template<typename A, typename V>
+typename LsmFunctionMaxima<A, V>::mx_iterator LsmFunctionMaxima<A, V>::mx_end() {
+    compactAll();
+
+    return mx_iterator(runs.empty() ? nullptr : runs[0].data(), maxima.data() + maxima.size());
+}
+
+/**
+ * Overwrites and tombstones are resolved only by merging, so the function is compacted first.
+ */
+template<typename A, typename V>
+typename LsmFunctionMaxima<A, V>::size_type LsmFunctionMaxima<A, V>::size() {
+    compactAll();
+
+    return runs.empty() ? 0 : runs[0].size();
+}
+
+#endif //MAXIMA_LSM_FUNCTION_MAXIMA_H
@@ -0,0 +1,382 @@
+#ifndef MAXIMA_MAXIMA_KERNEL_H
+#define MAXIMA_MAXIMA_KERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#if __cplusplus > 201703L && defined(__has_include)
+#if __has_include(<compare>)
+#include <compare>
+#endif
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MAXIMA_KERNEL_X86
+
+#include <immintrin.h>
+
+#endif
+
+/*********************************MAXIMA_VALUE_ORDER*********************************/
+
+/**
+ * Three-way comparison of values, used instead of two calls of operator< where both outcomes matter.
+ * It is enabled for types with operator<=> when compiled as C++20,
+ * other types can opt in by specializing this struct with enabled = true and
+ * static int compare(const V &, const V &) returning a negative number, zero or a positive number
+ * (consistent with operator<).
+ *
+ * @tparam V - type of the values
+ */
+template<typename V, typename = void>
+struct MaximaThreeWay {
+    static constexpr bool enabled = false;
+};
+
+#if defined(__cpp_lib_three_way_comparison)
+
+template<typename V>
+struct MaximaThreeWay<V, std::enable_if_t<std::three_way_comparable<V>>> {
+    static constexpr bool enabled = true;
+
+    static int compare(const V &v1, const V &v2) {
+        auto order = v1 <=> v2;
+
+        return order < 0 ? -1 : (order > 0 ? 1 : 0);
+    }
+};
+
+#endif
+
+/**
+ * Comparisons of values shared by FunctionMaxima, DenseFunctionMaxima and MaximaKernel.
+ * Each answer takes one comparison if V has a three-way comparison (see MaximaThreeWay),
+ * otherwise as few calls of operator< as possible.
+ * All functions have strong guarantee: they only compare values.
+ *
+ * @tparam V - type of the values
+ */
+template<typename V>
+class MaximaValueOrder {
+public:
+    /**
+     * @return - negative number if v1 < v2, positive if v2 < v1, otherwise 0.
+     */
+    static int compare(const V &v1, const V &v2) {
+        if constexpr (MaximaThreeWay<V>::enabled) {
+            return MaximaThreeWay<V>::compare(v1, v2);
+        } else {
+            return v1 < v2 ? -1 : (v2 < v1 ? 1 : 0);
+        }
+    }
+
+    static bool same(const V &v1, const V &v2) {
+        return compare(v1, v2) == 0;
+    }
+
+    /**
+     * A point is a maximum iff no neighbour is greater: "neighbour < value or the same value"
+     * is exactly !(value < neighbour), so one comparison per neighbour suffices.
+     *
+     * @param left  - value of the left neighbour or nullptr if there is none
+     * @param value - value of the point
+     * @param right - value of the right neighbour or nullptr if there is none
+     * @return      - true if the point is a local maximum.
+     */
+    static bool isMaximum(const V *left, const V &value, const V *right) {
+        return (left == nullptr || !(value < *left)) && (right == nullptr || !(value < *right));
+    }
+
+    /**
+     * Order of maxima: descending values, ties are broken by ascending arguments.
+     *
+     * @return - true if the point (v1, a1) goes before the point (v2, a2).
+     */
+    template<typename A>
+    static bool maximumBefore(const V &v1, const A &a1, const V &v2, const A &a2) {
+        if constexpr (MaximaThreeWay<V>::enabled) {
+            int order = MaximaThreeWay<V>::compare(v1, v2);
+
+            return order > 0 || (order == 0 && a1 < a2);
+        } else {
+            return v2 < v1 || (!(v1 < v2) && a1 < a2);
+        }
+    }
+};
+
+/*********************************MAXIMA_ARROW_PROXY*********************************/
+
+/**
+ * Result of operator-> of the iterators whose operator* returns a point by value
+ * (DenseFunctionMaxima, SmallFunctionMaxima, LsmFunctionMaxima, FrozenFunctionMaxima):
+ * it holds the point for the duration of the member access.
+ *
+ * @tparam P - type of the points
+ */
+template<typename P>
+class MaximaArrowProxy {
+public:
+    explicit MaximaArrowProxy(P point) noexcept(std::is_nothrow_move_constructible<P>::value)
+            : point(std::move(point)) {}
+
+    const P *operator->() const noexcept {
+        return &point;
+    }
+
+private:
+    P point;
+};
+
+/*********************************MAXIMA_KERNEL*********************************/
+
+/**
+ * Bulk detection of local maxima in a contiguous array of values sorted by their arguments.
+ * Point i is a maximum iff none of its neighbours is greater than it, which is exactly
+ * what FunctionMaxima::Impl::shouldBeMaximum() checks (equal neighbours form a plateau of maxima).
+ *
+ * For 32 and 64 bit integers, float and double the interior of the array is processed
+ * with AVX2 or SSE4.2, chosen at runtime; all other types use the scalar loop.
+ */
+class MaximaKernel {
+public:
+    /**
+     * Fills mask[i] with 1 if values[i] is a local maximum, otherwise with 0.
+     * Function has strong guarantee: it only writes to mask, and only comparisons of V may throw.
+     *
+     * @tparam V     - type of the values
+     * @param values - values sorted by their arguments
+     * @param n      - number of values
+     * @param mask   - output array of n bytes
+     * @param before - left neighbour of values[0] or nullptr if there is none
+     * @param after  - right neighbour of values[n - 1] or nullptr if there is none
+     */
+    template<typename V>
+    static void maxima_mask(const V *values, std::size_t n, unsigned char *mask,
+                            const V *before = nullptr, const V *after = nullptr) {
+        if (n == 0) {
+            return;
+        }
+
+        std::size_t done = 1;
+
+        if (n > 2) {
+            done = interiorMask(values, n, mask);
+        }
+
+        mask[0] = isMaximum(before, values[0], n > 1 ? &values[1] : after);
+
+        for (std::size_t i = done; i + 1 < n; i++) {
+            mask[i] = isMaximum(&values[i - 1], values[i], &values[i + 1]);
+        }
+
+        if (n > 1) {
+            mask[n - 1] = isMaximum(&values[n - 2], values[n - 1], after);
+        }
+    }
+
+    /**
+     * Same as maxima_mask(), but never uses vector instructions.
+     */
+    template<typename V>
+    static void maxima_mask_scalar(const V *values, std::size_t n, unsigned char *mask,
+                                   const V *before = nullptr, const V *after = nullptr) {
+        for (std::size_t i = 0; i < n; i++) {
+            mask[i] = isMaximum(i > 0 ? &values[i - 1] : before, values[i], i + 1 < n ? &values[i + 1] : after);
+        }
+    }
+
+private:
+    template<typename V>
+    static bool isMaximum(const V *left, const V &value, const V *right) {
+        return MaximaValueOrder<V>::isMaximum(left, value, right);
+    }
+
+    /**
+     * Kind of vector lanes that can hold values of type V.
+     */
+    enum class Lanes {
+        none,
+        int32,
+        int64,
+        float32,
+        float64
+    };
+
+    template<typename V>
+    static constexpr Lanes lanesFor() {
+        if constexpr (std::is_same<V, float>::value) {
+            return Lanes::float32;
+        } else if constexpr (std::is_same<V, double>::value) {
+            return Lanes::float64;
+        } else if constexpr (std::is_integral<V>::value && !std::is_same<V, bool>::value && sizeof(V) == 4) {
+            return Lanes::int32;
+        } else if constexpr (std::is_integral<V>::value && !std::is_same<V, bool>::value && sizeof(V) == 8) {
+            return Lanes::int64;
+        } else {
+            return Lanes::none;
+        }
+    }
+
+    /**
+     * Computes mask of values[1 .. k) with vector instructions.
+     *
+     * @return - k, the first interior position that was not processed.
+     */
+    template<typename V>
+    static std::size_t interiorMask(const V *values, std::size_t n, unsigned char *mask) noexcept {
+#ifdef MAXIMA_KERNEL_X86
+        constexpr Lanes lanes = lanesFor<V>();
+
+        if constexpr (lanes != Lanes::none) {
+            static const bool avx2 = __builtin_cpu_supports("avx2");
+            static const bool sse42 = __builtin_cpu_supports("sse4.2");
+
+            if (avx2) {
+                return interiorMaskAvx2(values, n, mask);
+            }
+
+            if (sse42) {
+                return interiorMaskSse(values, n, mask);
+            }
+        }
+#endif
+        (void) values;
+        (void) n;
+        (void) mask;
+
+        return 1;
+    }
+
+#ifdef MAXIMA_KERNEL_X86
+
+    /**
+     * Expands the lowest `count` bits of bits into bytes 0 / 1 of mask.
+     */
+    static void storeBits(unsigned bits, std::size_t count, unsigned char *mask) noexcept {
+        for (std::size_t i = 0; i < count; i++) {
+            mask[i] = (bits >> i) & 1u;
+        }
+    }
+
+    /**
+     * Flips the sign bit of unsigned integers so they can be compared with signed instructions.
+     */
+    template<typename V>
+    static constexpr long long signFlip() {
+        if constexpr (std::is_unsigned<V>::value) {
+            return static_cast<long long>(std::uint64_t(1) << (sizeof(V) * 8 - 1));
+        } else {
+            return 0;
+        }
+    }
+
+    template<typename V>
+    __attribute__((target("avx2")))
+    static __m256i loadAvx2(const V *p, __m256i flip) noexcept {
+        return _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), flip);
+    }
+
+    template<typename V>
+    __attribute__((target("sse4.2")))
+    static __m128i loadSse(const V *p, __m128i flip) noexcept {
+        return _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), flip);
+    }
+
+    template<typename V>
+    __attribute__((target("avx2")))
+    static unsigned notLessAvx2(const V *p) noexcept {
+        constexpr Lanes lanes = lanesFor<V>();
+
+        if constexpr (lanes == Lanes::float32) {
+            __m256 v = _mm256_loadu_ps(p);
+            __m256 less = _mm256_or_ps(_mm256_cmp_ps(v, _mm256_loadu_ps(p - 1), _CMP_LT_OQ),
+                                       _mm256_cmp_ps(v, _mm256_loadu_ps(p + 1), _CMP_LT_OQ));
+
+            return ~static_cast<unsigned>(_mm256_movemask_ps(less)) & 0xffu;
+        } else if constexpr (lanes == Lanes::float64) {
+            __m256d v = _mm256_loadu_pd(p);
+            __m256d less = _mm256_or_pd(_mm256_cmp_pd(v, _mm256_loadu_pd(p - 1), _CMP_LT_OQ),
+                                        _mm256_cmp_pd(v, _mm256_loadu_pd(p + 1), _CMP_LT_OQ));
+
+            return ~static_cast<unsigned>(_mm256_movemask_pd(less)) & 0xfu;
+        } else if constexpr (lanes == Lanes::int32) {
+            const __m256i flip = _mm256_set1_epi32(static_cast<int>(signFlip<V>()));
+            __m256i v = loadAvx2(p, flip);
+            __m256i less = _mm256_or_si256(_mm256_cmpgt_epi32(loadAvx2(p - 1, flip), v),
+                                           _mm256_cmpgt_epi32(loadAvx2(p + 1, flip), v));
+
+            return ~static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(less))) & 0xffu;
+        } else {
+            const __m256i flip = _mm256_set1_epi64x(signFlip<V>());
+            __m256i v = loadAvx2(p, flip);
+            __m256i less = _mm256_or_si256(_mm256_cmpgt_epi64(loadAvx2(p - 1, flip), v),
+                                           _mm256_cmpgt_epi64(loadAvx2(p + 1, flip), v));
+
+            return ~static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(less))) & 0xfu;
+        }
+    }
+
+    template<typename V>
+    __attribute__((target("sse4.2")))
+    static unsigned notLessSse(const V *p) noexcept {
+        constexpr Lanes lanes = lanesFor<V>();
+
+        if constexpr (lanes == Lanes::float32) {
+            __m128 v = _mm_loadu_ps(p);
+            __m128 less = _mm_or_ps(_mm_cmplt_ps(v, _mm_loadu_ps(p - 1)), _mm_cmplt_ps(v, _mm_loadu_ps(p + 1)));
+
+            return ~static_cast<unsigned>(_mm_movemask_ps(less)) & 0xfu;
+        } else if constexpr (lanes == Lanes::float64) {
+            __m128d v = _mm_loadu_pd(p);
+            __m128d less = _mm_or_pd(_mm_cmplt_pd(v, _mm_loadu_pd(p - 1)), _mm_cmplt_pd(v, _mm_loadu_pd(p + 1)));
+
+            return ~static_cast<unsigned>(_mm_movemask_pd(less)) & 0x3u;
+        } else if constexpr (lanes == Lanes::int32) {
+            const __m128i flip = _mm_set1_epi32(static_cast<int>(signFlip<V>()));
+            __m128i v = loadSse(p, flip);
+            __m128i less = _mm_or_si128(_mm_cmpgt_epi32(loadSse(p - 1, flip), v),
+                                        _mm_cmpgt_epi32(loadSse(p + 1, flip), v));
+
+            return ~static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(less))) & 0xfu;
+        } else {
+            const __m128i flip = _mm_set1_epi64x(signFlip<V>());
+            __m128i v = loadSse(p, flip);
+            __m128i less = _mm_or_si128(_mm_cmpgt_epi64(loadSse(p - 1, flip), v),
+                                        _mm_cmpgt_epi64(loadSse(p + 1, flip), v));
+
+            return ~static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(less))) & 0x3u;
+        }
+    }
+
+    template<typename V>
+    __attribute__((target("avx2")))
+    static std::size_t interiorMaskAvx2(const V *values, std::size_t n, unsigned char *mask) noexcept {
+        constexpr std::size_t width = 32 / sizeof(V);
+        std::size_t i = 1;
+
+        for (; i + width < n; i += width) {
+            storeBits(notLessAvx2(values + i), width, mask + i);
+        }
+
+        return i;
+    }
+
+    template<typename V>
+    __attribute__((target("sse4.2")))
+    static std::size_t interiorMaskSse(const V *values, std::size_t n, unsigned char *mask) noexcept {
+        constexpr std::size_t width = 16 / sizeof(V);
+        std::size_t i = 1;
+
+        for (; i + width < n; i += width) {
+            storeBits(notLessSse(values + i), width, mask + i);
+        }
+
+        return i;
+    }
+
+#endif
+};
+
+#endif //MAXIMA_MAXIMA_KERNEL_H
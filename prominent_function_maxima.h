@@ -0,0 +1,718 @@
+#ifndef MAXIMA_PROMINENT_FUNCTION_MAXIMA_H
+#define MAXIMA_PROMINENT_FUNCTION_MAXIMA_H
+
+#include "function_maxima.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <set>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*********************************PROMINENT_FUNCTION_MAXIMA*********************************/
+
+/**
+ * FunctionMaxima with an index of its significant maxima: those whose topographic prominence
+ * exceeds a threshold. Iterating them costs O(1) per significant maximum, however many small bumps
+ * the function has.
+ *
+ * The prominence of a maximum p is value(p) - col. L and R are the nearest points on each side
+ * that are strictly higher than p, or the borders of the function if there are none. col is the higher
+ * of the minima of the values strictly between L and p and strictly between p and R. A side without
+ * points is ignored, and a single point has prominence 0. All points of a plateau are maxima
+ * with the same prominence.
+ *
+ * The index is a treap of copies of the points in argument order. Each subtree keeps its minimum value,
+ * its maximum value and its highest maximum. So the nearest higher point, the minimum of a range and
+ * the nearest maximum of at least a given value each take O(log n).
+ *
+ * A write at a can change the prominence only of maxima that have no strictly higher point between
+ * themselves and a, and only until a lower col than the written values separates them from a.
+ * They are found from a outwards: each one is the nearest maximum not lower than the previous one,
+ * skipping slopes. So set_value() and erase() take O((k + 1) log n), where k is the number of such
+ * maxima. k is small unless the write lands in a long staircase of nested maxima or a long plateau.
+ * Still, the treap is updated by every write, so writes cost about ten times as much as those
+ * of a plain FunctionMaxima (see ProminenceBenchmark): the index pays off when significant maxima
+ * are read far more often than the function is written.
+ *
+ * Writes have strong guarantee, because they write to the FunctionMaxima first. If the update
+ * of the index throws afterwards, the index is rebuilt in O(n log n) by the next access to it.
+ * The rebuild can happen in a const function, so it is done under an internal lock:
+ * const functions may still be called concurrently, as with FunctionMaxima.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - arithmetic type of the range values, prominence is their difference
+ */
+template<typename A, typename V>
+class ProminentFunctionMaxima {
+    static_assert(std::is_arithmetic<V>::value, "ProminentFunctionMaxima requires an arithmetic value type");
+
+public:
+    class peak_type;
+
+    using function_type = FunctionMaxima<A, V>;
+    using point_type = typename function_type::point_type;
+    using size_type = typename function_type::size_type;
+    using iterator = typename function_type::iterator;
+    using mx_iterator = typename function_type::mx_iterator;
+
+private:
+    /**
+     * Orders significant maxima like mx_iterator: descending values, ties by ascending arguments.
+     */
+    struct peakCmp {
+        bool operator()(const peak_type &p1, const peak_type &p2) const {
+            return MaximaValueOrder<V>::maximumBefore(p1.value(), p1.arg(), p2.value(), p2.arg());
+        }
+    };
+
+    using peak_set = std::set<peak_type, peakCmp>;
+
+public:
+    using peak_iterator = typename peak_set::const_iterator;
+
+    explicit ProminentFunctionMaxima(V threshold) : prominenceThreshold(threshold) {}
+
+    ProminentFunctionMaxima(const ProminentFunctionMaxima &rhs)
+            : prominenceThreshold(rhs.prominenceThreshold), function(rhs.function) {
+        rebuildIndex();
+    }
+
+    /**
+     * Copy and swap provides strong guarantee.
+     */
+    ProminentFunctionMaxima &operator=(const ProminentFunctionMaxima &rhs) {
+        ProminentFunctionMaxima copy(rhs);
+        swap(copy);
+
+        return *this;
+    }
+
+    ProminentFunctionMaxima(ProminentFunctionMaxima &&rhs) noexcept
+            : prominenceThreshold(rhs.prominenceThreshold), function(std::move(rhs.function)), root(rhs.root),
+              indexLost(rhs.indexLost.load(std::memory_order_relaxed)), priorities(rhs.priorities) {
+        rhs.root = nullptr;
+        peaks.swap(rhs.peaks);
+    }
+
+    ProminentFunctionMaxima &operator=(ProminentFunctionMaxima &&rhs) noexcept {
+        ProminentFunctionMaxima moved(std::move(rhs));
+        swap(moved);
+
+        return *this;
+    }
+
+    ~ProminentFunctionMaxima() {
+        destroy(root);
+    }
+
+    V const &value_at(A const &a) const {
+        return function.value_at(a);
+    }
+
+    /**
+     * Function has strong guarantee, see ProminentFunctionMaxima.
+     */
+    void set_value(A const &a, V const &v) {
+        function.set_value(a, v);
+        updateIndex(a, &v);
+    }
+
+    /**
+     * Function has strong guarantee, see ProminentFunctionMaxima.
+     */
+    void erase(A const &a) {
+        function.erase(a);
+        updateIndex(a, nullptr);
+    }
+
+    iterator find(A const &a) const {
+        return function.find(a);
+    }
+
+    iterator begin() const noexcept {
+        return function.begin();
+    }
+
+    iterator end() const noexcept {
+        return function.end();
+    }
+
+    mx_iterator mx_begin() const {
+        return function.mx_begin();
+    }
+
+    mx_iterator mx_end() const {
+        return function.mx_end();
+    }
+
+    size_type size() const noexcept {
+        return function.size();
+    }
+
+    const function_type &unwrap() const noexcept {
+        return function;
+    }
+
+    /**
+     * Iteration over maxima with prominence greater than threshold(), in the order of mx_iterator.
+     */
+    peak_iterator prominent_begin() const {
+        repairIndex();
+
+        return peaks.begin();
+    }
+
+    peak_iterator prominent_end() const {
+        repairIndex();
+
+        return peaks.end();
+    }
+
+    size_type prominent_size() const {
+        repairIndex();
+
+        return peaks.size();
+    }
+
+    /**
+     * O(log n). Throws InvalidArg if a is not a maximum of the function.
+     *
+     * @return the prominence of the maximum at a.
+     */
+    V prominence(A const &a) const {
+        repairIndex();
+        const Node *node = findNode(root, a);
+
+        if (node == nullptr || !node->peak) {
+            throw InvalidArg("argument is not a maximum");
+        }
+
+        return prominenceOf(node);
+    }
+
+    V threshold() const noexcept {
+        return prominenceThreshold;
+    }
+
+    /**
+     * Recomputes the index in O(n log n). Function has strong guarantee.
+     */
+    void set_threshold(V threshold) {
+        ProminentFunctionMaxima changed(threshold);
+        changed.function = function;
+        changed.rebuildIndex();
+        swap(changed);
+    }
+
+    void swap(ProminentFunctionMaxima &rhs) noexcept {
+        using std::swap;
+        swap(prominenceThreshold, rhs.prominenceThreshold);
+        swap(function, rhs.function);
+        swap(root, rhs.root);
+        peaks.swap(rhs.peaks);
+        bool lost = indexLost.load(std::memory_order_relaxed);
+        indexLost.store(rhs.indexLost.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        rhs.indexLost.store(lost, std::memory_order_relaxed);
+        swap(priorities, rhs.priorities);
+    }
+
+private:
+    /**
+     * Copy of a point in the treap, ordered by arguments as a search tree and by priorities as a heap.
+     */
+    struct Node {
+        Node(const A &argument, V value, unsigned priority) : argument(argument), value(value),
+                                                              priority(priority), minValue(value),
+                                                              maxValue(value) {}
+
+        A argument;
+        V value;
+        unsigned priority;
+        bool peak = false;
+        bool significant = false;
+        typename peak_set::iterator entry;
+
+        V minValue;
+        V maxValue;
+        const Node *maxPeak = nullptr;
+        Node *left = nullptr;
+        Node *right = nullptr;
+    };
+
+    static void destroy(Node *t) noexcept {
+        if (t != nullptr) {
+            destroy(t->left);
+            destroy(t->right);
+            delete t;
+        }
+    }
+
+    static void pull(Node *t) noexcept {
+        t->minValue = t->maxValue = t->value;
+        t->maxPeak = t->peak ? t : nullptr;
+
+        for (const Node *child : {t->left, t->right}) {
+            if (child != nullptr) {
+                t->minValue = std::min(t->minValue, child->minValue);
+                t->maxValue = std::max(t->maxValue, child->maxValue);
+
+                if (child->maxPeak != nullptr && (t->maxPeak == nullptr || t->maxPeak->value < child->maxPeak->value)) {
+                    t->maxPeak = child->maxPeak;
+                }
+            }
+        }
+    }
+
+    /**
+     * Splits t into arguments less than a and the others. If a comparison throws,
+     * no pointer has been changed yet, so t stays intact.
+     */
+    static void split(Node *t, const A &a, Node *&less, Node *&rest) {
+        if (t == nullptr) {
+            less = rest = nullptr;
+
+            return;
+        }
+
+        if (t->argument < a) {
+            split(t->right, a, t->right, rest);
+            less = t;
+        } else {
+            split(t->left, a, less, t->left);
+            rest = t;
+        }
+
+        pull(t);
+    }
+
+    static Node *merge(Node *less, Node *greater) noexcept {
+        if (less == nullptr || greater == nullptr) {
+            return less == nullptr ? greater : less;
+        }
+
+        if (less->priority > greater->priority) {
+            less->right = merge(less->right, greater);
+            pull(less);
+
+            return less;
+        }
+
+        greater->left = merge(less, greater->left);
+        pull(greater);
+
+        return greater;
+    }
+
+    static Node *eraseLeftmost(Node *t) noexcept {
+        if (t->left == nullptr) {
+            Node *right = t->right;
+            delete t;
+
+            return right;
+        }
+
+        t->left = eraseLeftmost(t->left);
+        pull(t);
+
+        return t;
+    }
+
+    static Node *findNode(Node *t, const A &a) {
+        while (t != nullptr) {
+            if (a < t->argument) {
+                t = t->left;
+            } else if (t->argument < a) {
+                t = t->right;
+            } else {
+                return t;
+            }
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * Calls change(node) on the node of a and updates the subtrees on the path to it.
+     */
+    template<typename Change>
+    static void updateNode(Node *t, const A &a, Change change) {
+        if (a < t->argument) {
+            updateNode(t->left, a, change);
+        } else if (t->argument < a) {
+            updateNode(t->right, a, change);
+        } else {
+            change(t);
+        }
+
+        pull(t);
+    }
+
+    /**
+     * @return the node with the greatest argument less than *bound (any argument if bound is nullptr)
+     *         satisfying ok, subtrees failing may are skipped.
+     */
+    template<typename May, typename Ok>
+    static Node *lastBefore(Node *t, const A *bound, May may, Ok ok) {
+        if (t == nullptr || !may(t)) {
+            return nullptr;
+        }
+
+        if (bound != nullptr && !(t->argument < *bound)) {
+            return lastBefore(t->left, bound, may, ok);
+        }
+
+        if (Node *found = lastBefore(t->right, bound, may, ok)) {
+            return found;
+        }
+
+        return ok(t) ? t : lastBefore(t->left, nullptr, may, ok);
+    }
+
+    /**
+     * Mirror image of lastBefore().
+     */
+    template<typename May, typename Ok>
+    static Node *firstAfter(Node *t, const A *bound, May may, Ok ok) {
+        if (t == nullptr || !may(t)) {
+            return nullptr;
+        }
+
+        if (bound != nullptr && !(*bound < t->argument)) {
+            return firstAfter(t->right, bound, may, ok);
+        }
+
+        if (Node *found = firstAfter(t->left, bound, may, ok)) {
+            return found;
+        }
+
+        return ok(t) ? t : firstAfter(t->right, nullptr, may, ok);
+    }
+
+    /**
+     * Minimum of values with arguments strictly between *lo and *hi (unbounded if nullptr).
+     *
+     * @return false if there are no such arguments.
+     */
+    static bool minBetween(const Node *t, const A *lo, const A *hi, V &result) {
+        if (t == nullptr) {
+            return false;
+        }
+
+        if (lo == nullptr && hi == nullptr) {
+            result = t->minValue;
+
+            return true;
+        }
+
+        if (lo != nullptr && !(*lo < t->argument)) {
+            return minBetween(t->right, lo, hi, result);
+        }
+
+        if (hi != nullptr && !(t->argument < *hi)) {
+            return minBetween(t->left, lo, hi, result);
+        }
+
+        V side;
+        result = t->value;
+
+        if (minBetween(t->left, lo, nullptr, side)) {
+            result = std::min(result, side);
+        }
+
+        if (minBetween(t->right, nullptr, hi, side)) {
+            result = std::min(result, side);
+        }
+
+        return true;
+    }
+
+    static bool anyNode(const Node *) noexcept {
+        return true;
+    }
+
+    Node *predecessor(const A &a) const {
+        return lastBefore(root, &a, anyNode, anyNode);
+    }
+
+    Node *successor(const A &a) const {
+        return firstAfter(root, &a, anyNode, anyNode);
+    }
+
+    bool isPeak(const Node *node) const {
+        const Node *left = predecessor(node->argument), *right = successor(node->argument);
+
+        return MaximaValueOrder<V>::isMaximum(left == nullptr ? nullptr : &left->value, node->value,
+                                              right == nullptr ? nullptr : &right->value);
+    }
+
+    V prominenceOf(const Node *node) const {
+        const V value = node->value;
+        auto mayBeHigher = [value](const Node *t) {
+            return value < t->maxValue;
+        };
+        auto higher = [value](const Node *t) {
+            return value < t->value;
+        };
+
+        const Node *left = lastBefore(root, &node->argument, mayBeHigher, higher);
+        const Node *right = firstAfter(root, &node->argument, mayBeHigher, higher);
+        V col = value, side;
+        bool found = false;
+
+        if (minBetween(root, left == nullptr ? nullptr : &left->argument, &node->argument, side)) {
+            col = side;
+            found = true;
+        }
+
+        if (minBetween(root, &node->argument, right == nullptr ? nullptr : &right->argument, side)) {
+            col = found ? std::max(col, side) : side;
+        }
+
+        return value - col;
+    }
+
+    /**
+     * Appends the maxima whose prominence may depend on the point of a, which changes between values
+     * in [lo, hi]: the maximum at a and, on each side, the maxima with no strictly higher point between
+     * them and a. The first one on a side is the nearest maximum not lower than the neighbour of a
+     * (anything lower is behind that neighbour), each next one is the nearest maximum not lower than
+     * the previous one. The walk stops at a maximum p not lower than hi with a value of at most lo
+     * between p and a: the point of a never becomes p's nearest higher point nor the minimum
+     * on its side. The same then holds for all maxima further away.
+     */
+    void collectAffected(const A &a, V lo, V hi, std::vector<Node *> &affected) const {
+        if (Node *node = findNode(root, a); node != nullptr && node->peak) {
+            affected.push_back(node);
+        }
+
+        for (bool leftSide : {true, false}) {
+            Node *neighbour = leftSide ? predecessor(a) : successor(a);
+
+            const A *bound = &a;
+
+            for (Node *peak = neighbour; peak != nullptr;) {
+                const V atLeast = peak->value;
+                auto mayHold = [atLeast](const Node *t) {
+                    return t->maxPeak != nullptr && !(t->maxPeak->value < atLeast);
+                };
+                auto holds = [atLeast](const Node *t) {
+                    return t->peak && !(t->value < atLeast);
+                };
+
+                peak = leftSide ? lastBefore(root, bound, mayHold, holds) : firstAfter(root, bound, mayHold, holds);
+
+                if (peak != nullptr) {
+                    V between;
+
+                    if (!(peak->value < hi) &&
+                        minBetween(root, leftSide ? &peak->argument : &a, leftSide ? &a : &peak->argument, between) &&
+                        !(lo < between)) {
+                        break;
+                    }
+
+                    affected.push_back(peak);
+                    bound = &peak->argument;
+                }
+            }
+        }
+    }
+
+    void unmark(Node *node) noexcept {
+        if (node->significant) {
+            peaks.erase(node->entry);
+            node->significant = false;
+        }
+    }
+
+    void mark(Node *node) {
+        V nodeProminence = prominenceOf(node);
+
+        if (prominenceThreshold < nodeProminence) {
+            node->entry = peaks.insert(peak_type(node->argument, node->value, nodeProminence)).first;
+            node->significant = true;
+        }
+    }
+
+    /**
+     * Sets the peak flag of node from its neighbours.
+     */
+    void refreshPeak(Node *node) {
+        bool peak = isPeak(node);
+
+        if (peak != node->peak) {
+            updateNode(root, node->argument, [peak](Node *t) {
+                t->peak = peak;
+            });
+        }
+    }
+
+    /**
+     * Brings the index up to date after the function has been written at a (erased if v is nullptr).
+     * Maxima which may be affected are collected and unmarked before the change and marked again after it.
+     */
+    void updateIndex(const A &a, const V *v) noexcept {
+        if (indexLost.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        try {
+            Node *node = findNode(root, a);
+
+            if ((node == nullptr && v == nullptr) || (node != nullptr && v != nullptr && node->value == *v)) {
+                return;
+            }
+
+            V lo = v != nullptr ? *v : node->value, hi = lo;
+
+            if (node != nullptr && v != nullptr) {
+                lo = std::min(*v, node->value);
+                hi = std::max(*v, node->value);
+            }
+
+            std::vector<Node *> affected;
+            collectAffected(a, lo, hi, affected);
+
+            for (Node *peak : affected) {
+                unmark(peak);
+            }
+
+            if (node != nullptr) {
+                unmark(node);
+                affected.erase(std::remove(affected.begin(), affected.end(), node), affected.end());
+            }
+
+            if (v == nullptr) {
+                Node *less, *rest;
+                split(root, a, less, rest);
+                root = merge(less, eraseLeftmost(rest));
+            } else if (node != nullptr) {
+                updateNode(root, a, [v](Node *t) {
+                    t->value = *v;
+                });
+            } else {
+                Node *inserted = new Node(a, *v, priorities());
+                Node *less, *rest;
+
+                try {
+                    split(root, a, less, rest);
+                }
+                catch (...) {
+                    delete inserted;
+                    throw;
+                }
+
+                root = merge(merge(less, inserted), rest);
+            }
+
+            // Only the point of a and its neighbours can become or stop being maxima, so the maxima
+            // with no strictly higher point between them and a are the same as before, plus these three.
+            for (Node *changed : {predecessor(a), successor(a), v == nullptr ? nullptr : findNode(root, a)}) {
+                if (changed != nullptr) {
+                    refreshPeak(changed);
+                    affected.push_back(changed);
+                }
+            }
+
+            std::sort(affected.begin(), affected.end(), std::less<Node *>());
+            affected.erase(std::unique(affected.begin(), affected.end()), affected.end());
+
+            for (Node *peak : affected) {
+                unmark(peak);
+
+                if (peak->peak) {
+                    mark(peak);
+                }
+            }
+        }
+        catch (...) {
+            indexLost.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Builds the index of the function aside and swaps it in, so the function has strong guarantee.
+     */
+    void rebuildIndex() const {
+        ProminentFunctionMaxima rebuilt(prominenceThreshold);
+        rebuilt.priorities = priorities;
+
+        for (const point_type &p : function) {
+            rebuilt.root = merge(rebuilt.root, new Node(p.arg(), p.value(), rebuilt.priorities()));
+        }
+
+        for (auto it = function.mx_begin(); it != function.mx_end(); ++it) {
+            updateNode(rebuilt.root, it->arg(), [](Node *t) {
+                t->peak = true;
+            });
+        }
+
+        for (auto it = function.mx_begin(); it != function.mx_end(); ++it) {
+            rebuilt.mark(findNode(rebuilt.root, it->arg()));
+        }
+
+        std::swap(root, rebuilt.root);
+        peaks.swap(rebuilt.peaks);
+        priorities = rebuilt.priorities;
+        indexLost.store(false, std::memory_order_release);
+    }
+
+    /**
+     * Rebuilds a lost index for const functions, which may run concurrently: the first of them
+     * rebuilds it under rebuildLock, the others wait and find it rebuilt. An intact index costs one atomic load.
+     */
+    void repairIndex() const {
+        if (indexLost.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> guard(rebuildLock);
+
+            if (indexLost.load(std::memory_order_relaxed)) {
+                rebuildIndex();
+            }
+        }
+    }
+
+    V prominenceThreshold;
+    function_type function;
+
+    // The index is rebuilt in const functions (under rebuildLock) if an update of it has failed.
+    mutable Node *root = nullptr;
+    mutable peak_set peaks;
+    mutable std::atomic<bool> indexLost{false};
+    mutable std::minstd_rand priorities;
+    mutable std::mutex rebuildLock;
+};
+
+/*********************************PROMINENT_PEAK_TYPE*********************************/
+
+template<typename A, typename V>
+class ProminentFunctionMaxima<A, V>::peak_type {
+public:
+    A const &arg() const noexcept {
+        return argument;
+    }
+
+    V const &value() const noexcept {
+        return point;
+    }
+
+    V const &prominence() const noexcept {
+        return peakProminence;
+    }
+
+private:
+    friend class ProminentFunctionMaxima<A, V>;
+
+    peak_type(const A &argument, V point, V peakProminence)
+            : argument(argument), point(point), peakProminence(peakProminence) {}
+
+    A argument;
+    V point;
+    V peakProminence;
+};
+
+#endif //MAXIMA_PROMINENT_FUNCTION_MAXIMA_H
@@ -0,0 +1,652 @@
+#ifndef MAXIMA_SMALL_FUNCTION_MAXIMA_H
+#define MAXIMA_SMALL_FUNCTION_MAXIMA_H
+
+#include "function_maxima.h"
+#include "maxima_kernel.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*********************************SMALL_FUNCTION_MAXIMA*********************************/
+
+/**
+ * Variant of FunctionMaxima for programs that keep a great many functions, most of them tiny.
+ * Up to N points are stored inline, in an array sorted by arguments, together with the positions
+ * of maxima in their order; every change rescans the (at most N) points to classify maxima anew.
+ * An empty function allocates nothing and a small one allocates nothing either.
+ * When a function grows beyond N points, it is converted once into a FunctionMaxima
+ * and stays one (a size oscillating around N does not convert it back and forth).
+ *
+ * Unlike FunctionMaxima<A, V>::point_type, point_type of this class refers to the storage
+ * of the function, so it is valid only until the function is changed.
+ * Iterators return point_type by value, so like those of DenseFunctionMaxima they are input iterators
+ * to the standard library and bidirectional only to C++20 ranges.
+ *
+ * @tparam A - type of the domain values, its move constructor must not throw
+ * @tparam V - type of the range values, its move constructor must not throw
+ * @tparam N - number of points stored inline
+ */
+template<typename A, typename V, std::size_t N = 8>
+class SmallFunctionMaxima {
+    static_assert(N > 0 && N <= 64, "SmallFunctionMaxima stores between 1 and 64 points inline");
+    static_assert(std::is_nothrow_move_constructible<A>::value && std::is_nothrow_move_constructible<V>::value,
+                  "SmallFunctionMaxima requires argument and value types with nothrow move constructors");
+
+public:
+    class point_type;
+
+    class iterator;
+
+    class mx_iterator;
+
+    using size_type = std::size_t;
+
+    using function_type = FunctionMaxima<A, V>;
+
+    static constexpr size_type inline_capacity = N;
+
+    SmallFunctionMaxima() noexcept = default;
+
+    SmallFunctionMaxima(const SmallFunctionMaxima &rhs);
+
+    /**
+     * Copy and swap provides strong guarantee.
+     */
+    SmallFunctionMaxima &operator=(const SmallFunctionMaxima &rhs) {
+        SmallFunctionMaxima copy(rhs);
+        swap(copy);
+
+        return *this;
+    }
+
+    SmallFunctionMaxima(SmallFunctionMaxima &&rhs) noexcept {
+        moveFrom(rhs);
+    }
+
+    SmallFunctionMaxima &operator=(SmallFunctionMaxima &&rhs) noexcept {
+        if (&rhs != this) {
+            clear();
+            moveFrom(rhs);
+        }
+
+        return *this;
+    }
+
+    ~SmallFunctionMaxima() {
+        destroySlots();
+    }
+
+    V const &value_at(A const &a) const;
+
+    V const *try_value_at(A const &a) const;
+
+    bool contains(A const &a) const;
+
+    void set_value(A const &a, V const &v);
+
+    void erase(A const &a);
+
+    iterator begin() const noexcept;
+
+    iterator end() const noexcept;
+
+    iterator find(A const &a) const;
+
+    mx_iterator mx_begin() const;
+
+    mx_iterator mx_end() const;
+
+    size_type size() const noexcept;
+
+    /**
+     * @return true if the points are stored inline, false if the function was converted to FunctionMaxima.
+     */
+    bool is_small() const noexcept {
+        return !tree;
+    }
+
+    void swap(SmallFunctionMaxima &rhs) noexcept {
+        SmallFunctionMaxima moved(std::move(rhs));
+        rhs.moveFrom(*this);
+        moveFrom(moved);
+    }
+
+private:
+    struct Slot {
+        A argument;
+        V value;
+    };
+
+    using slot_type = typename std::aligned_storage<sizeof(Slot), alignof(Slot)>::type;
+    using order_type = unsigned char[N];
+
+    Slot &slot(size_type index) noexcept {
+        return *reinterpret_cast<Slot *>(&slots[index]);
+    }
+
+    const Slot &slot(size_type index) const noexcept {
+        return *reinterpret_cast<const Slot *>(&slots[index]);
+    }
+
+    /**
+     * @return - position of the first point with argument not less than a (count if there is none).
+     */
+    size_type lowerBound(const A &a) const {
+        size_type index = 0;
+
+        while (index < count && slot(index).argument < a) {
+            index++;
+        }
+
+        return index;
+    }
+
+    /**
+     * @return - position of the point with argument a or count if there is none.
+     */
+    size_type indexOf(const A &a) const {
+        size_type index = lowerBound(a);
+
+        return index < count && !(a < slot(index).argument) ? index : count;
+    }
+
+    /**
+     * Classifies maxima of the points view(0), ..., view(n - 1) in one scan and sorts them
+     * in the order of mx_begin() (insertion sort, there are at most N of them).
+     * Function has strong guarantee: it only compares values and arguments and writes to order.
+     *
+     * @param n     - number of points
+     * @param view  - function returning the point (const Slot &) at the given position
+     * @param order - positions of maxima in their order
+     * @return      - number of maxima.
+     */
+    template<typename View>
+    static size_type classify(size_type n, View view, order_type &order) {
+        size_type found = 0;
+
+        for (size_type i = 0; i < n; i++) {
+            const V *left = i > 0 ? &view(i - 1).value : nullptr;
+            const V *right = i + 1 < n ? &view(i + 1).value : nullptr;
+
+            if (!MaximaValueOrder<V>::isMaximum(left, view(i).value, right)) {
+                continue;
+            }
+
+            size_type j = found++;
+
+            while (j > 0 && MaximaValueOrder<V>::maximumBefore(view(i).value, view(i).argument,
+                                                               view(order[j - 1]).value,
+                                                               view(order[j - 1]).argument)) {
+                order[j] = order[j - 1];
+                j--;
+            }
+
+            order[j] = static_cast<unsigned char>(i);
+        }
+
+        return found;
+    }
+
+    void installOrder(const order_type &order, size_type found) noexcept {
+        std::copy(order, order + found, maximaOrder);
+        maximaCount = static_cast<unsigned char>(found);
+    }
+
+    /**
+     * Converts the function to FunctionMaxima with the inline points and added at position index.
+     * Function has strong guarantee: the tree is built aside and the inline points are destroyed
+     * only after it is complete.
+     */
+    void grow(size_type index, const Slot &added) {
+        std::vector<std::pair<A, V>> points;
+        points.reserve(count + 1);
+
+        for (size_type i = 0; i <= count; i++) {
+            const Slot &p = i < index ? slot(i) : (i == index ? added : slot(i - 1));
+            points.emplace_back(p.argument, p.value);
+        }
+
+        auto grown = std::make_unique<function_type>();
+        grown->assign(points.begin(), points.end());
+
+        destroySlots();
+        tree = std::move(grown);
+    }
+
+    void destroySlots() noexcept {
+        for (size_type i = 0; i < count; i++) {
+            slot(i).~Slot();
+        }
+
+        count = 0;
+        maximaCount = 0;
+    }
+
+    void clear() noexcept {
+        destroySlots();
+        tree.reset();
+    }
+
+    /**
+     * Moves the content of rhs to this function, which has to be empty, and leaves rhs empty.
+     * Function is nothrow: moves of arguments and values are nothrow.
+     */
+    void moveFrom(SmallFunctionMaxima &rhs) noexcept {
+        for (size_type i = 0; i < rhs.count; i++) {
+            new(&slots[i]) Slot(std::move(rhs.slot(i)));
+        }
+
+        count = rhs.count;
+        installOrder(rhs.maximaOrder, rhs.maximaCount);
+        tree = std::move(rhs.tree);
+        rhs.destroySlots();
+    }
+
+    slot_type slots[N];
+    std::unique_ptr<function_type> tree;
+    unsigned char count = 0;
+    unsigned char maximaCount = 0;
+    order_type maximaOrder = {};
+};
+
+/*********************************SMALL_POINT_TYPE*********************************/
+
+template<typename A, typename V, std::size_t N>
+class SmallFunctionMaxima<A, V, N>::point_type {
+public:
+    A const &arg() const noexcept {
+        return *argument;
+    }
+
+    V const &value() const noexcept {
+        return *point;
+    }
+
+    point_type(const point_type &rhs) = default;
+
+    point_type &operator=(const point_type &rhs) = default;
+
+private:
+    friend class SmallFunctionMaxima<A, V, N>;
+
+    point_type(const A *argument, const V *point) noexcept : argument(argument), point(point) {}
+
+    const A *argument;
+    const V *point;
+};
+
+/*********************************SMALL_ITERATORS*********************************/
+
+/**
+ * Position in the inline array or, once the function is converted, an iterator of FunctionMaxima.
+ */
+template<typename A, typename V, std::size_t N>
+class SmallFunctionMaxima<A, V, N>::iterator {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using iterator_concept = std::bidirectional_iterator_tag;
+    using value_type = point_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = MaximaArrowProxy<point_type>;
+    using reference = point_type;
+
+    iterator() noexcept : fun(nullptr), index(0), it() {}
+
+    reference operator*() const noexcept {
+        if (fun->tree) {
+            return point_type(&it->arg(), &it->value());
+        }
+
+        return point_type(&fun->slot(index).argument, &fun->slot(index).value);
+    }
+
+    pointer operator->() const noexcept {
+        return pointer(**this);
+    }
+
+    iterator &operator++() noexcept {
+        if (fun->tree) {
+            ++it;
+        } else {
+            index++;
+        }
+
+        return *this;
+    }
+
+    iterator operator++(int) noexcept {
+        iterator result = *this;
+        ++*this;
+
+        return result;
+    }
+
+    iterator &operator--() noexcept {
+        if (fun->tree) {
+            --it;
+        } else {
+            index--;
+        }
+
+        return *this;
+    }
+
+    iterator operator--(int) noexcept {
+        iterator result = *this;
+        --*this;
+
+        return result;
+    }
+
+    bool operator==(const iterator &rhs) const noexcept {
+        return fun == rhs.fun && index == rhs.index && it == rhs.it;
+    }
+
+    bool operator!=(const iterator &rhs) const noexcept {
+        return !(*this == rhs);
+    }
+
+private:
+    friend class SmallFunctionMaxima<A, V, N>;
+
+    iterator(const SmallFunctionMaxima *fun, size_type index, typename function_type::iterator it) noexcept
+            : fun(fun), index(index), it(it) {}
+
+    const SmallFunctionMaxima *fun;
+    size_type index;
+    typename function_type::iterator it;
+};
+
+/**
+ * Rank in the inline order of maxima or, once the function is converted, an mx_iterator of FunctionMaxima.
+ */
+template<typename A, typename V, std::size_t N>
+class SmallFunctionMaxima<A, V, N>::mx_iterator {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using iterator_concept = std::bidirectional_iterator_tag;
+    using value_type = point_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = MaximaArrowProxy<point_type>;
+    using reference = point_type;
+
+    mx_iterator() noexcept : fun(nullptr), rank(0), it() {}
+
+    reference operator*() const noexcept {
+        if (fun->tree) {
+            return point_type(&it->arg(), &it->value());
+        }
+
+        const Slot &p = fun->slot(fun->maximaOrder[rank]);
+
+        return point_type(&p.argument, &p.value);
+    }
+
+    pointer operator->() const noexcept {
+        return pointer(**this);
+    }
+
+    mx_iterator &operator++() noexcept {
+        if (fun->tree) {
+            ++it;
+        } else {
+            rank++;
+        }
+
+        return *this;
+    }
+
+    mx_iterator operator++(int) noexcept {
+        mx_iterator result = *this;
+        ++*this;
+
+        return result;
+    }
+
+    mx_iterator &operator--() noexcept {
+        if (fun->tree) {
+            --it;
+        } else {
+            rank--;
+        }
+
+        return *this;
+    }
+
+    mx_iterator operator--(int) noexcept {
+        mx_iterator result = *this;
+        --*this;
+
+        return result;
+    }
+
+    bool operator==(const mx_iterator &rhs) const noexcept {
+        return fun == rhs.fun && rank == rhs.rank && it == rhs.it;
+    }
+
+    bool operator!=(const mx_iterator &rhs) const noexcept {
+        return !(*this == rhs);
+    }
+
+private:
+    friend class SmallFunctionMaxima<A, V, N>;
+
+    mx_iterator(const SmallFunctionMaxima *fun, size_type rank, typename function_type::mx_iterator it) noexcept
+            : fun(fun), rank(rank), it(it) {}
+
+    const SmallFunctionMaxima *fun;
+    size_type rank;
+    typename function_type::mx_iterator it;
+};
+
+/*********************************SMALL_FUNCTION_MAXIMA_DEFINITIONS*********************************/
+
+/**
+ * Copy constructor has strong guarantee: if copying a point throws,
+ * already copied points are destroyed and the exception is propagated.
+ */
+template<typename A, typename V, std::size_t N>
+SmallFunctionMaxima<A, V, N>::SmallFunctionMaxima(const SmallFunctionMaxima &rhs) {
+    if (rhs.tree) {
+        tree = std::make_unique<function_type>(*rhs.tree);
+
+        return;
+    }
+
+    try {
+        for (size_type i = 0; i < rhs.count; i++) {
+            new(&slots[i]) Slot(rhs.slot(i));
+            count++;
+        }
+    }
+    catch (...) {
+        destroySlots();
+
+        throw;
+    }
+
+    installOrder(rhs.maximaOrder, rhs.maximaCount);
+}
+
+/**
+ * Linear scan of at most N arguments, or a lookup in FunctionMaxima.
+ * Throws InvalidArg if a has no value.
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ * @tparam N - number of points stored inline
+ * @param a - argument to be searched
+ * @return the value of the found argument
+ */
+template<typename A, typename V, std::size_t N>
+V const &SmallFunctionMaxima<A, V, N>::value_at(const A &a) const {
+    const V *value = try_value_at(a);
+
+    if (value == nullptr) {
+        throw InvalidArg("invalid argument value");
+    }
+
+    return *value;
+}
+
+/**
+ * @return pointer to the value of a (valid until the function is changed) or nullptr if a has no value.
+ */
+template<typename A, typename V, std::size_t N>
+V const *SmallFunctionMaxima<A, V, N>::try_value_at(const A &a) const {
+    if (tree) {
+        return tree->try_value_at(a);
+    }
+
+    size_type index = indexOf(a);
+
+    return index == count ? nullptr : &slot(index).value;
+}
+
+template<typename A, typename V, std::size_t N>
+bool SmallFunctionMaxima<A, V, N>::contains(const A &a) const {
+    return try_value_at(a) != nullptr;
+}
+
+/**
+ * Sets the value of a. The changed sequence of points is classified before anything is modified
+ * (through a view that substitutes the new point), so the function has strong guarantee:
+ * after the copies of a and v and all comparisons, only nothrow moves remain.
+ * Adding the (N + 1)-th point converts the function to FunctionMaxima, see grow().
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ * @tparam N - number of points stored inline
+ * @param a - argument to be updated
+ * @param v - value to be assigned
+ */
+template<typename A, typename V, std::size_t N>
+void SmallFunctionMaxima<A, V, N>::set_value(const A &a, const V &v) {
+    if (tree) {
+        return tree->set_value(a, v);
+    }
+
+    size_type index = lowerBound(a);
+    bool present = index < count && !(a < slot(index).argument);
+
+    if (present && MaximaValueOrder<V>::same(slot(index).value, v)) {
+        return;
+    }
+
+    Slot added{a, v};
+
+    if (!present && count == N) {
+        return grow(index, added);
+    }
+
+    order_type order;
+    size_type found;
+
+    if (present) {
+        found = classify(count, [this, index, &added](size_type i) -> const Slot & {
+            return i == index ? added : slot(i);
+        }, order);
+
+        slot(index).value.~V();
+        new(&slot(index).value) V(std::move(added.value));
+    } else {
+        found = classify(count + 1, [this, index, &added](size_type i) -> const Slot & {
+            return i < index ? slot(i) : (i == index ? added : slot(i - 1));
+        }, order);
+
+        for (size_type i = count; i > index; i--) {
+            new(&slots[i]) Slot(std::move(slot(i - 1)));
+            slot(i - 1).~Slot();
+        }
+
+        new(&slots[index]) Slot(std::move(added));
+        count++;
+    }
+
+    installOrder(order, found);
+}
+
+/**
+ * Erases the value of a, nothing happens if a has no value.
+ * Function has strong guarantee for the same reasons as set_value().
+ *
+ * @tparam A - type of the domain values
+ * @tparam V - type of the range values
+ * @tparam N - number of points stored inline
+ * @param a - argument to be erased
+ */
+template<typename A, typename V, std::size_t N>
+void SmallFunctionMaxima<A, V, N>::erase(const A &a) {
+    if (tree) {
+        return tree->erase(a);
+    }
+
+    size_type index = indexOf(a);
+
+    if (index == count) {
+        return;
+    }
+
+    order_type order;
+    size_type found = classify(count - 1, [this, index](size_type i) -> const Slot & {
+        return slot(i < index ? i : i + 1);
+    }, order);
+
+    slot(index).~Slot();
+
+    for (size_type i = index + 1; i < count; i++) {
+        new(&slots[i - 1]) Slot(std::move(slot(i)));
+        slot(i).~Slot();
+    }
+
+    count--;
+    installOrder(order, found);
+}
+
+/**
+ * Iteration is done in ascending order according to the arguments.
+ */
+template<typename A, typename V, std::size_t N>
+typename SmallFunctionMaxima<A, V, N>::iterator SmallFunctionMaxima<A, V, N>::begin() const noexcept {
+    return tree ? iterator(this, 0, tree->begin()) : iterator(this, 0, {});
+}
+
+template<typename A, typename V, std::size_t N>
+typename SmallFunctionMaxima<A, V, N>::iterator SmallFunctionMaxima<A, V, N>::end() const noexcept {
+    return tree ? iterator(this, 0, tree->end()) : iterator(this, count, {});
+}
+
+/**
+ * @return iterator pointing to the point with argument a, or end() if there is none.
+ */
+template<typename A, typename V, std::size_t N>
+typename SmallFunctionMaxima<A, V, N>::iterator SmallFunctionMaxima<A, V, N>::find(const A &a) const {
+    return tree ? iterator(this, 0, tree->find(a)) : iterator(this, indexOf(a), {});
+}
+
+/**
+ * Iteration is done in descending order according to the values.
+ */
+template<typename A, typename V, std::size_t N>
+typename SmallFunctionMaxima<A, V, N>::mx_iterator SmallFunctionMaxima<A, V, N>::mx_begin() const {
+    return tree ? mx_iterator(this, 0, tree->mx_begin()) : mx_iterator(this, 0, {});
+}
+
+template<typename A, typename V, std::size_t N>
+typename SmallFunctionMaxima<A, V, N>::mx_iterator SmallFunctionMaxima<A, V, N>::mx_end() const {
+    return tree ? mx_iterator(this, 0, tree->mx_end()) : mx_iterator(this, maximaCount, {});
+}
+
+template<typename A, typename V, std::size_t N>
+typename SmallFunctionMaxima<A, V, N>::size_type SmallFunctionMaxima<A, V, N>::size() const noexcept {
+    return tree ? tree->size() : count;
+}
+
+#endif //MAXIMA_SMALL_FUNCTION_MAXIMA_H
@@ -0,0 +1,155 @@
+/**
+ * Reports exact numbers of allocations and allocated bytes per operation of FunctionMaxima
+ * (set_value() of a new key, of an existing key and of the same value, erase(), value_at(), find(),
+ * copy and move), counted by the shared counting allocator of allocationCounter.h.
+ * Only allocations made inside the measured call are counted, setup and cleanup between calls are not.
+ *
+ * With --check the averages are compared with the budgets below and the program fails
+ * if any of them is exceeded, so a new allocation on a hot path is caught by ctest.
+ *
+ * Usage: AllocationBenchmark [--check] [number of points]
+ */
+
+#include "../../function_maxima.h"
+#include "allocationCounter.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+
+struct Measurement {
+    double allocations;
+    double bytes;
+    double nanoseconds;
+};
+
+/**
+ * Runs prepare(i) and then operation(i) for i = 0, ..., repetitions - 1 and averages
+ * allocations, bytes and time of operation(i) only.
+ */
+template<typename Prepare, typename Operation>
+Measurement measure(std::size_t repetitions, Prepare prepare, Operation operation) {
+    std::size_t totalAllocations = 0, totalBytes = 0;
+    std::chrono::steady_clock::duration elapsed{};
+
+    for (std::size_t i = 0; i < repetitions; i++) {
+        prepare(i);
+
+        HeapUsage before = heapUsage();
+        auto start = std::chrono::steady_clock::now();
+        operation(i);
+        elapsed += std::chrono::steady_clock::now() - start;
+        HeapUsage after = heapUsage();
+        totalAllocations += after.allocations - before.allocations;
+        totalBytes += after.bytes - before.bytes;
+    }
+
+    return {static_cast<double>(totalAllocations) / repetitions, static_cast<double>(totalBytes) / repetitions,
+            std::chrono::duration<double, std::nano>(elapsed).count() / repetitions};
+}
+
+static bool failed = false;
+
+/**
+ * Prints a measurement and, if budget is not negative, checks its allocations against it.
+ */
+void report(bool check, const char *type, const char *operation, Measurement m, double budget) {
+    bool over = check && budget >= 0 && m.allocations > budget;
+    failed |= over;
+
+    std::printf("%-18s %-24s %8.2f allocations %10.1f bytes %10.1f ns%s\n",
+                type, operation, m.allocations, m.bytes, m.nanoseconds,
+                over ? "  OVER BUDGET" : "");
+}
+
+/**
+ * Allocation budgets per operation, -1 for operations whose allocations grow with the size of the function.
+ */
+struct Budgets {
+    double newKey, existingKey, sameValue, erase, lookup, move;
+};
+
+template<typename A, typename V, typename Key, typename Value>
+void run(bool check, const char *type, std::size_t n, Key key, Value value, Budgets budgets) {
+    using F = FunctionMaxima<A, V>;
+
+    // Even keys are present, odd ones are inserted and erased by the measurements.
+    F fun;
+    for (std::size_t i = 0; i < n; i++) {
+        fun.set_value(key(2 * i), value(i));
+    }
+
+    const std::size_t repetitions = n;
+    auto nothing = [](std::size_t) {};
+
+    report(check, type, "set_value new key", measure(repetitions, nothing, [&](std::size_t i) {
+        fun.set_value(key(2 * i + 1), value(i));
+    }), budgets.newKey);
+    for (std::size_t i = 0; i < repetitions; i++) {
+        fun.erase(key(2 * i + 1));
+    }
+
+    report(check, type, "set_value existing key", measure(repetitions, nothing, [&](std::size_t i) {
+        fun.set_value(key(2 * i), value(i + 1));
+    }), budgets.existingKey);
+
+    report(check, type, "set_value same value", measure(repetitions, nothing, [&](std::size_t i) {
+        fun.set_value(key(2 * i), value(i + 1));
+    }), budgets.sameValue);
+
+    report(check, type, "erase", measure(repetitions, [&](std::size_t i) {
+        fun.set_value(key(2 * i + 1), value(i));
+    }, [&](std::size_t i) {
+        fun.erase(key(2 * i + 1));
+    }), budgets.erase);
+
+    long long checksum = 0;
+    report(check, type, "value_at", measure(repetitions, nothing, [&](std::size_t i) {
+        checksum += fun.value_at(key(2 * i)) == value(i + 1);
+    }), budgets.lookup);
+
+    report(check, type, "find", measure(repetitions, nothing, [&](std::size_t i) {
+        checksum += fun.find(key(2 * i)) != fun.end();
+    }), budgets.lookup);
+
+    const std::size_t copies = 20;
+    Measurement copy = measure(copies, nothing, [&](std::size_t) {
+        F copied(fun);
+        checksum += static_cast<long long>(copied.size());
+    });
+    report(check, type, "copy (per copy)", copy, -1);
+    report(check, type, "copy (per point)",
+           {copy.allocations / n, copy.bytes / n, copy.nanoseconds / n}, -1);
+
+    report(check, type, "move construct + back", measure(repetitions, nothing, [&](std::size_t) {
+        F moved(std::move(fun));
+        fun = std::move(moved);
+    }), budgets.move);
+
+    std::printf("%-18s points: %zu  checksum: %lld\n", type, fun.size(), checksum);
+}
+
+int main(int argc, char **argv) {
+    bool check = argc > 1 && std::strcmp(argv[1], "--check") == 0;
+    int first = check ? 2 : 1;
+    const std::size_t n = argc > first ? std::strtoul(argv[first], nullptr, 10) : 100000;
+
+    run<int, int>(check, "<int, int>", n, [](std::size_t i) {
+        return static_cast<int>(i);
+    }, [](std::size_t i) {
+        return static_cast<int>(i % 1000);
+    }, {2, 2, 0, 0, 0, 0});
+
+    run<std::string, std::string>(check, "<string, string>", n, [](std::size_t i) {
+        char key[16];
+        std::snprintf(key, sizeof(key), "k%09zu", i);
+        return std::string(key);
+    }, [](std::size_t i) {
+        return std::to_string(i % 1000);
+    }, {7, 7, 5, 3, 0, 0});
+
+    return failed ? 1 : 0;
+}
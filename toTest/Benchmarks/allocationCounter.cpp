@@ -0,0 +1,90 @@
+/**
+ * Counting allocator shared by the benchmarks that report memory, see allocationCounter.h.
+ * Sizes of freed blocks are taken from malloc_usable_size(), so nothing is stored next to the blocks.
+ */
+
+#include "allocationCounter.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <malloc.h>
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+extern "C" void *__libc_memalign(size_t alignment, size_t size);
+extern "C" void __libc_free(void *p);
+
+static std::atomic<std::size_t> allocations{0};
+static std::atomic<std::size_t> requestedBytes{0};
+static std::atomic<std::size_t> liveBytes{0};
+
+static void *counted(void *p, std::size_t size) noexcept {
+    if (p != nullptr) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        requestedBytes.fetch_add(size, std::memory_order_relaxed);
+        liveBytes.fetch_add(malloc_usable_size(p), std::memory_order_relaxed);
+    }
+
+    return p;
+}
+
+static void released(std::size_t usableSize) noexcept {
+    liveBytes.fetch_sub(usableSize, std::memory_order_relaxed);
+}
+
+void *malloc(size_t size) {
+    return counted(__libc_malloc(size), size);
+}
+
+void *calloc(size_t count, size_t size) {
+    return counted(__libc_calloc(count, size), count * size);
+}
+
+void *realloc(void *p, size_t size) {
+    std::size_t old = p == nullptr ? 0 : malloc_usable_size(p);
+    void *moved = __libc_realloc(p, size);
+
+    if (moved != nullptr || size == 0) {
+        released(old);
+    }
+
+    return counted(moved, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    return counted(__libc_memalign(alignment, size), size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **out, size_t alignment, size_t size) {
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+
+    void *p = memalign(alignment, size);
+
+    if (p == nullptr) {
+        return ENOMEM;
+    }
+
+    *out = p;
+
+    return 0;
+}
+
+void free(void *p) {
+    if (p != nullptr) {
+        released(malloc_usable_size(p));
+        __libc_free(p);
+    }
+}
+
+HeapUsage heapUsage() noexcept {
+    return {allocations.load(std::memory_order_relaxed), requestedBytes.load(std::memory_order_relaxed),
+            liveBytes.load(std::memory_order_relaxed)};
+}
@@ -0,0 +1,21 @@
+#ifndef MAXIMA_ALLOCATION_COUNTER_H
+#define MAXIMA_ALLOCATION_COUNTER_H
+
+#include <cstddef>
+
+/**
+ * Heap usage of the whole program, counted by allocationCounter.cpp, which interposes malloc(), calloc(),
+ * realloc(), the aligned allocation functions and free() over glibc as toTest/CursedAllocator.cpp does.
+ * The global operator new allocates with malloc(), so allocations of containers are counted too.
+ * Benchmarks built with the AllocationCounter objects measure an operation by the difference
+ * of two snapshots taken around it.
+ */
+struct HeapUsage {
+    std::size_t allocations; // allocations made so far
+    std::size_t bytes;       // bytes requested by them
+    std::size_t liveBytes;   // usable size of the blocks allocated and not freed yet
+};
+
+HeapUsage heapUsage() noexcept;
+
+#endif //MAXIMA_ALLOCATION_COUNTER_H
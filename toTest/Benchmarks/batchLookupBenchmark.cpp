@@ -0,0 +1,83 @@
+/**
+ * Measures lookups per second of random keys done one by one with try_value_at()
+ * against batches of values_at_unsorted(), without and with the hash index. Only with the hash index
+ * does a batch prefetch the slots of a group of lookups before the first of them; without it the batch
+ * is a baseline that should match lookups one by one.
+ * The default tree is larger than the last level cache.
+ *
+ * Usage: BatchLookupBenchmark [number of points] [number of lookups]
+ */
+
+#include "../../function_maxima.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+template<typename F>
+double lookupsPerSecond(std::size_t lookups, F &&f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto stop = std::chrono::steady_clock::now();
+
+    return static_cast<double>(lookups) / std::chrono::duration<double>(stop - start).count();
+}
+
+int main(int argc, char **argv) {
+    const std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4000000;
+    const std::size_t lookups = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1 << 20;
+
+    std::mt19937 gen(2021);
+    std::vector<std::pair<int, int>> input(n);
+    for (std::size_t i = 0; i < n; i++) {
+        input[i] = {static_cast<int>(2 * i), static_cast<int>(gen() % 1000)};
+    }
+
+    FunctionMaxima<int, int> fun;
+    fun.assign(input.begin(), input.end());
+
+    std::vector<int> keys(lookups);
+    for (int &k : keys) {
+        k = static_cast<int>(gen() % (2 * n));
+    }
+
+    std::vector<const int *> found(lookups);
+    long long checksum = 0;
+    std::printf("points: %zu  lookups: %zu\n", n, lookups);
+
+    for (bool indexed : {false, true}) {
+        if (indexed) {
+            fun.enable_hash_index();
+        }
+
+        double single = lookupsPerSecond(lookups, [&]() {
+            for (std::size_t i = 0; i < lookups; i++) {
+                found[i] = fun.try_value_at(keys[i]);
+            }
+        });
+        std::printf("%s one by one    %8.2f M lookups/s\n", indexed ? "hash" : "tree", single / 1e6);
+
+        for (std::size_t batch = 16; batch <= 1024; batch *= 4) {
+            double batched = lookupsPerSecond(lookups, [&]() {
+                for (std::size_t i = 0; i < lookups; i += batch) {
+                    std::size_t end = std::min(lookups, i + batch);
+                    fun.values_at_unsorted(keys.begin() + i, keys.begin() + end, found.begin() + i);
+                }
+            });
+
+            for (const int *v : found) {
+                checksum += v != nullptr;
+            }
+
+            std::printf("%s batch %4zu     %8.2f M lookups/s  (%.2fx)\n", indexed ? "hash" : "tree", batch,
+                        batched / 1e6, batched / single);
+        }
+    }
+
+    std::printf("checksum: %lld\n", checksum);
+
+    return 0;
+}
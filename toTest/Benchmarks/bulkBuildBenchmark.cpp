@@ -0,0 +1,70 @@
+/**
+ * Compares building FunctionMaxima point by point with set_value()
+ * against the bulk assign() path, and the SIMD maxima kernel against its scalar version.
+ *
+ * Usage: BulkBuildBenchmark [number of points]
+ */
+
+#include "../../function_maxima.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+template<typename F>
+double measure(F &&f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto stop = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+int main(int argc, char **argv) {
+    const std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    std::mt19937 gen(2021);
+    std::vector<std::pair<int, int>> input(n);
+    for (std::size_t i = 0; i < n; i++) {
+        input[i] = {static_cast<int>(i), static_cast<int>(gen() % 1000)};
+    }
+    std::shuffle(input.begin(), input.end(), gen);
+
+    FunctionMaxima<int, int> sequential, bulk;
+    double sequentialTime = measure([&] {
+        for (auto &p : input) {
+            sequential.set_value(p.first, p.second);
+        }
+    });
+    double bulkTime = measure([&] {
+        bulk.assign(input.begin(), input.end());
+    });
+
+    std::vector<int> values(n);
+    for (std::size_t i = 0; i < n; i++) {
+        values[i] = static_cast<int>(gen() % 1000);
+    }
+    std::vector<unsigned char> mask(n);
+    const int rounds = 20;
+    double simdTime = measure([&] {
+        for (int r = 0; r < rounds; r++) {
+            MaximaKernel::maxima_mask(values.data(), n, mask.data());
+        }
+    }) / rounds;
+    double scalarTime = measure([&] {
+        for (int r = 0; r < rounds; r++) {
+            MaximaKernel::maxima_mask_scalar(values.data(), n, mask.data());
+        }
+    }) / rounds;
+
+    std::printf("points: %zu (maxima: %zu)\n", n, static_cast<std::size_t>(std::distance(bulk.mx_begin(), bulk.mx_end())));
+    std::printf("set_value per point: %10.2f ms\n", sequentialTime);
+    std::printf("assign():            %10.2f ms\n", bulkTime);
+    std::printf("kernel, SIMD:        %10.3f ms\n", simdTime);
+    std::printf("kernel, scalar:      %10.3f ms\n", scalarTime);
+
+    return sequential.size() == bulk.size() ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+/**
+ * Compares throughput of set_value() and erase() published by several threads into one function:
+ * FunctionMaxima guarded by a mutex against ConcurrentFunctionMaxima, whose writers only push to a lock-free
+ * queue and whose applier coalesces the updates of each batch. The time of ConcurrentFunctionMaxima includes
+ * the final flush(), so it counts only updates which were really applied.
+ *
+ * Usage: ConcurrentBenchmark [operations] [number of distinct arguments]
+ */
+
+#include "../../concurrent_function_maxima.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+/**
+ * Runs count operations of threads threads, split evenly, each calling operation(gen) with its own generator.
+ */
+template<typename Operation>
+double run(std::size_t count, unsigned threads, Operation operation) {
+    std::vector<std::thread> producers;
+    auto start = std::chrono::steady_clock::now();
+
+    for (unsigned t = 0; t < threads; t++) {
+        producers.emplace_back([&, t]() {
+            std::mt19937 gen(t);
+            for (std::size_t i = 0; i < count / threads; i++) {
+                operation(gen);
+            }
+        });
+    }
+    for (std::thread &producer : producers) {
+        producer.join();
+    }
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+    const std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+    const unsigned range = argc > 2 ? static_cast<unsigned>(std::strtoul(argv[2], nullptr, 10)) : 100000;
+
+    for (unsigned threads : {1u, 2u, 4u, 8u}) {
+        FunctionMaxima<int, int> plain;
+        std::mutex lock;
+        double seconds = run(n, threads, [&](std::mt19937 &gen) {
+            int arg = static_cast<int>(gen() % range), value = static_cast<int>(gen() % 1000);
+            bool erase = gen() % 4 == 0;
+            std::lock_guard<std::mutex> guard(lock);
+            if (erase) {
+                plain.erase(arg);
+            } else {
+                plain.set_value(arg, value);
+            }
+        });
+        std::printf("mutex       %u threads %12.0f ops/s\n", threads, n / seconds);
+
+        ConcurrentFunctionMaxima<int, int> concurrent;
+        auto start = std::chrono::steady_clock::now();
+        run(n, threads, [&](std::mt19937 &gen) {
+            int arg = static_cast<int>(gen() % range), value = static_cast<int>(gen() % 1000);
+            if (gen() % 4 == 0) {
+                concurrent.erase(arg);
+            } else {
+                concurrent.set_value(arg, value);
+            }
+        });
+        concurrent.flush();
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("concurrent  %u threads %12.0f ops/s  (coalesced: %llu, points: %zu/%zu)\n",
+                    threads, n / seconds, static_cast<unsigned long long>(concurrent.coalesced()),
+                    concurrent.read([](const FunctionMaxima<int, int> &f) { return f.size(); }), plain.size());
+    }
+
+    return 0;
+}
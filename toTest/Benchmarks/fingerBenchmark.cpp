@@ -0,0 +1,64 @@
+/**
+ * Compares set_value() and find() on a locality-heavy trace (every argument close to the previous one)
+ * against a trace of uniformly random arguments. Both traces touch the same range of arguments.
+ * Writes and lookups alternate, because only writes move the finger: each find() starts
+ * from the point of the set_value() before it.
+ *
+ * Usage: FingerBenchmark [number of points] [number of operations] [maximal step of the local trace]
+ */
+
+#include "../../function_maxima.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+int main(int argc, char **argv) {
+    const std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    const std::size_t operations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2000000;
+    const int step = argc > 3 ? std::atoi(argv[3]) : 4;
+    const int range = static_cast<int>(2 * n);
+
+    std::mt19937 gen(2021);
+    std::vector<int> local(operations), random(operations);
+    int position = range / 2;
+    for (std::size_t i = 0; i < operations; i++) {
+        position += static_cast<int>(gen() % (2 * step + 1)) - step;
+        position = position < 0 ? 0 : (position >= range ? range - 1 : position);
+        local[i] = position;
+        random[i] = static_cast<int>(gen() % range);
+    }
+
+    std::vector<std::pair<int, int>> input(n);
+    for (std::size_t i = 0; i < n; i++) {
+        input[i] = {static_cast<int>(2 * i), static_cast<int>(gen() % 1000)};
+    }
+
+    std::printf("points: %zu  operations: %zu  step: %d\n", n, operations, step);
+    long long checksum = 0;
+
+    for (auto *trace : {&local, &random}) {
+        FunctionMaxima<int, int> fun;
+        fun.assign(input.begin(), input.end());
+
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < operations; i++) {
+            int a = (*trace)[i];
+            if (i % 2 == 0) {
+                fun.set_value(a, a % 1000);
+            } else {
+                checksum += fun.find(a) != fun.end();
+            }
+        }
+        auto stop = std::chrono::steady_clock::now();
+
+        std::printf("%-6s  %8.1f ns/op\n", trace == &local ? "local" : "random",
+                    std::chrono::duration<double, std::nano>(stop - start).count() / static_cast<double>(operations));
+    }
+
+    std::printf("checksum: %lld\n", checksum);
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+/**
+ * Compares memory per point and value_at() speed of FunctionMaxima and its frozen form,
+ * and measures freeze() and thaw().
+ * Memory is measured as live heap bytes counted by the shared allocator of allocationCounter.h.
+ *
+ * Usage: FrozenBenchmark [number of points] [average gap between arguments]
+ */
+
+#include "../../frozen_function_maxima.h"
+#include "allocationCounter.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+template<typename Clock = std::chrono::steady_clock>
+double millisecondsSince(typename Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+template<typename V, typename Generator>
+void run(const char *name, std::size_t n, long long gap, Generator value) {
+    std::mt19937_64 gen(2021);
+    std::vector<std::pair<long long, V>> input(n);
+    long long argument = 0;
+
+    for (auto &p : input) {
+        argument += 1 + static_cast<long long>(gen() % static_cast<unsigned long long>(2 * gap - 1));
+        p = {argument, value(gen)};
+    }
+
+    std::vector<long long> probes(n);
+    for (auto &probe : probes) {
+        probe = input[gen() % n].first;
+    }
+
+    std::size_t before = heapUsage().liveBytes;
+    FunctionMaxima<long long, V> fun;
+    fun.assign(input.begin(), input.end());
+    std::size_t mutableBytes = heapUsage().liveBytes - before;
+
+    before = heapUsage().liveBytes;
+    auto start = std::chrono::steady_clock::now();
+    FrozenFunctionMaxima<long long, V> frozen = freeze(fun);
+    double freezeTime = millisecondsSince(start);
+    std::size_t frozenBytes = heapUsage().liveBytes - before + sizeof(frozen);
+
+    V checksum = V();
+    start = std::chrono::steady_clock::now();
+    for (long long probe : probes) {
+        checksum += fun.value_at(probe);
+    }
+    double mutableLookup = millisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (long long probe : probes) {
+        checksum -= frozen.value_at(probe);
+    }
+    double frozenLookup = millisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    FunctionMaxima<long long, V> thawed = frozen.thaw();
+    double thawTime = millisecondsSince(start);
+
+    std::printf("%-22s points: %zu  maxima: %zu\n", name, fun.size(),
+                static_cast<std::size_t>(std::distance(fun.mx_begin(), fun.mx_end())));
+    std::printf("  mutable: %8.2f B/point  value_at: %6.1f ns\n",
+                static_cast<double>(mutableBytes) / n, mutableLookup * 1e6 / n);
+    std::printf("  frozen:  %8.2f B/point  value_at: %6.1f ns  (memory_usage: %.2f B/point)\n",
+                static_cast<double>(frozenBytes) / n, frozenLookup * 1e6 / n,
+                static_cast<double>(frozen.memory_usage()) / n);
+    std::printf("  freeze: %.2f ms  thaw: %.2f ms  thawed points: %zu  checksum: %g\n",
+                freezeTime, thawTime, thawed.size(), static_cast<double>(checksum));
+}
+
+int main(int argc, char **argv) {
+    const std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    const long long gap = argc > 2 ? std::atoll(argv[2]) : 10;
+
+    run<long long>("<long long, long long>", n, gap, [](std::mt19937_64 &gen) {
+        return static_cast<long long>(gen() % 1000);
+    });
+    run<double>("<long long, double>", n, gap, [](std::mt19937_64 &gen) {
+        return static_cast<double>(gen() % 1000) / 10;
+    });
+
+    return 0;
+}
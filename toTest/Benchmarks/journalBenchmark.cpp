@@ -0,0 +1,71 @@
+/**
+ * Compares throughput of set_value() and erase() of FunctionMaxima with and without a journal,
+ * for several sizes of the group written and synced together.
+ * Small groups pay one fsync() per few operations, so they run on a prefix of the workload only.
+ *
+ * Usage: JournalBenchmark [operations] [path prefix of the journal files]
+ */
+
+#include "../../journaled_function_maxima.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Operation {
+    int arg;
+    int value;
+    bool erase;
+};
+
+template<typename F>
+double run(F &fun, const std::vector<Operation> &operations, std::size_t count) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (std::size_t i = 0; i < count; i++) {
+        if (operations[i].erase) {
+            fun.erase(operations[i].arg);
+        } else {
+            fun.set_value(operations[i].arg, operations[i].value);
+        }
+    }
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+    const std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    const std::string path = argc > 2 ? argv[2] : "/tmp/maxima_journal_benchmark";
+
+    std::mt19937 gen(2021);
+    std::vector<Operation> operations(n);
+    for (Operation &operation : operations) {
+        operation = {static_cast<int>(gen() % 100000), static_cast<int>(gen() % 1000), gen() % 4 == 0};
+    }
+
+    FunctionMaxima<int, int> plain;
+    double seconds = run(plain, operations, n);
+    std::printf("%-16s %10zu ops  %12.0f ops/s\n", "no journal", n, n / seconds);
+
+    for (std::size_t groupSize : {1, 16, 256, 4096}) {
+        std::remove((path + ".log").c_str());
+        std::remove((path + ".snapshot").c_str());
+
+        std::size_t count = std::min(n, 2000 * groupSize);
+        JournaledFunctionMaxima<int, int> journaled(path, groupSize);
+        auto start = std::chrono::steady_clock::now();
+        run(journaled, operations, count);
+        journaled.sync();
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::printf("group %-10zu %10zu ops  %12.0f ops/s\n", groupSize, count, count / seconds);
+    }
+
+    std::remove((path + ".log").c_str());
+    std::remove((path + ".snapshot").c_str());
+
+    return 0;
+}
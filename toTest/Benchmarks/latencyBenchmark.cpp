@@ -0,0 +1,79 @@
+/**
+ * Prints latency percentiles (p50, p99, p99.9, max) of FunctionMaxima operations
+ * under a random workload mix.
+ *
+ * Usage: LatencyBenchmark [operations] [argument range] [mix]
+ * where mix is set_value:erase:value_at:find:copy, weights of the operations (default 50:20:20:10:0).
+ * Copies (and copy assignments, which alternate with them) are of the whole function, so keep their weight low.
+ */
+
+#include "../../instrumented_function_maxima.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+int main(int argc, char **argv) {
+    const std::size_t operations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+    const int range = argc > 2 ? std::atoi(argv[2]) : 100000;
+    const char *mix = argc > 3 ? argv[3] : "50:20:20:10:0";
+
+    std::vector<double> weights;
+    for (const char *p = mix; *p != '\0';) {
+        char *end;
+        weights.push_back(std::strtod(p, &end));
+        p = *end == ':' ? end + 1 : end;
+        if (end == p && *p != '\0') {
+            std::printf("invalid mix: %s\n", mix);
+            return 1;
+        }
+    }
+    weights.resize(5, 0);
+
+    std::mt19937 gen(2021);
+    std::uniform_int_distribution<int> arg(0, range - 1), value(0, 999);
+    std::discrete_distribution<int> pick(weights.begin(), weights.end());
+
+    InstrumentedFunctionMaxima<int, int> fun;
+    for (int i = 0; i < range / 2; i++) {
+        fun.set_value(arg(gen), value(gen));
+    }
+    fun.reset_latencies();
+
+    long long checksum = 0;
+    bool assign = false;
+
+    for (std::size_t i = 0; i < operations; i++) {
+        switch (pick(gen)) {
+            case 0:
+                fun.set_value(arg(gen), value(gen));
+                break;
+            case 1:
+                fun.erase(arg(gen));
+                break;
+            case 2:
+                try {
+                    checksum += fun.value_at(arg(gen));
+                } catch (InvalidArg &) {}
+                break;
+            case 3:
+                checksum += fun.find(arg(gen)) == fun.end();
+                break;
+            default: {
+                InstrumentedFunctionMaxima<int, int> copy(fun);
+                if (assign) {
+                    fun = copy;
+                }
+                assign = !assign;
+                checksum += static_cast<long long>(copy.size());
+            }
+        }
+    }
+
+    std::printf("operations: %zu  range: %d  mix: %s  points: %zu  checksum: %lld\n",
+                operations, range, mix, fun.size(), checksum);
+    fun.dump(stdout);
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+/**
+ * Compares latency of hits and misses of the throwing value_at()
+ * against the non-throwing try_value_at() and contains(),
+ * independent lookups of sorted keys against one values_at() pass,
+ * and tree lookups against the hash index.
+ *
+ * Usage: LookupBenchmark [number of points] [number of lookups]
+ */
+
+#include "../../function_maxima.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+template<typename F>
+double nanosPerLookup(std::size_t lookups, F &&f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto stop = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(stop - start).count() / static_cast<double>(lookups);
+}
+
+int main(int argc, char **argv) {
+    const std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    const std::size_t lookups = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+
+    std::vector<std::pair<int, int>> input(n);
+    for (std::size_t i = 0; i < n; i++) {
+        input[i] = {static_cast<int>(2 * i), static_cast<int>(i % 1000)};
+    }
+
+    FunctionMaxima<int, int> fun;
+    fun.assign(input.begin(), input.end());
+
+    std::mt19937 gen(2021);
+    std::vector<int> hits(lookups), misses(lookups);
+    for (std::size_t i = 0; i < lookups; i++) {
+        hits[i] = static_cast<int>(2 * (gen() % n));
+        misses[i] = hits[i] + 1;
+    }
+
+    long long checksum = 0;
+    std::printf("points: %zu  lookups: %zu\n", n, lookups);
+
+    for (auto *keys : {&hits, &misses}) {
+        const char *name = keys == &hits ? "hit " : "miss";
+
+        double throwing = nanosPerLookup(lookups, [&]() {
+            for (int a : *keys) {
+                try {
+                    checksum += fun.value_at(a);
+                } catch (InvalidArg &) {
+                    checksum--;
+                }
+            }
+        });
+
+        double pointer = nanosPerLookup(lookups, [&]() {
+            for (int a : *keys) {
+                const int *v = fun.try_value_at(a);
+                checksum += v ? *v : -1;
+            }
+        });
+
+        double contains = nanosPerLookup(lookups, [&]() {
+            for (int a : *keys) {
+                checksum += fun.contains(a) ? 1 : -1;
+            }
+        });
+
+        std::printf("%s  value_at: %8.1f ns  try_value_at: %8.1f ns  contains: %8.1f ns\n",
+                    name, throwing, pointer, contains);
+    }
+
+    std::vector<int> sorted(hits);
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<const int *> found(lookups);
+
+    double independent = nanosPerLookup(lookups, [&]() {
+        for (std::size_t i = 0; i < lookups; i++) {
+            found[i] = fun.try_value_at(sorted[i]);
+        }
+    });
+
+    double batch = nanosPerLookup(lookups, [&]() {
+        fun.values_at(sorted.begin(), sorted.end(), found.begin());
+    });
+
+    for (const int *v : found) {
+        checksum += v ? *v : -1;
+    }
+
+    std::printf("sorted  try_value_at: %8.1f ns  values_at: %8.1f ns\n", independent, batch);
+    FunctionMaxima<int, int> indexed = fun;
+    indexed.enable_hash_index();
+
+    for (auto *keys : {&hits, &misses}) {
+        double hashed = nanosPerLookup(lookups, [&]() {
+            for (int a : *keys) {
+                const int *v = indexed.try_value_at(a);
+                checksum += v ? *v : -1;
+            }
+        });
+
+        std::printf("%s  hash index try_value_at: %8.1f ns\n", keys == &hits ? "hit " : "miss", hashed);
+    }
+
+    std::printf("checksum: %lld\n", checksum);
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+/**
+ * Compares FunctionMaxima and LsmFunctionMaxima on a write-dominated workload:
+ * a function of n points receives mostly overwrites of existing arguments (and some erases),
+ * then its maxima are read once (which compacts LsmFunctionMaxima) and values are looked up.
+ *
+ * Usage: LsmBenchmark [points] [writes] [capacity of the write buffer]
+ */
+
+#include "../../lsm_function_maxima.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+struct Operation {
+    int arg;
+    int value;
+    bool erase;
+};
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template<typename F>
+void run(const char *name, F &fun, std::size_t n, const std::vector<Operation> &operations) {
+    for (std::size_t i = 0; i < n; i++) {
+        fun.set_value(static_cast<int>(i), static_cast<int>(i % 1000));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (const Operation &operation : operations) {
+        if (operation.erase) {
+            fun.erase(operation.arg);
+        } else {
+            fun.set_value(operation.arg, operation.value);
+        }
+    }
+    double writes = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    long long checksum = fun.mx_begin() == fun.mx_end() ? 0 : fun.mx_begin()->value();
+    double maxima = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (const Operation &operation : operations) {
+        checksum += fun.contains(operation.arg);
+    }
+    double lookups = secondsSince(start);
+
+    std::printf("%-20s writes: %12.0f ops/s  first mx_begin: %8.2f ms  lookups: %12.0f ops/s  (checksum: %lld)\n",
+                name, operations.size() / writes, maxima * 1000, operations.size() / lookups, checksum);
+}
+
+int main(int argc, char **argv) {
+    const std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    const std::size_t m = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4000000;
+    const std::size_t capacity = argc > 3 ? std::strtoul(argv[3], nullptr, 10) :
+                                 LsmFunctionMaxima<int, int>::defaultBufferCapacity;
+
+    std::mt19937 gen(2021);
+    std::vector<Operation> operations(m);
+    for (Operation &operation : operations) {
+        operation = {static_cast<int>(gen() % n), static_cast<int>(gen() % 1000), gen() % 10 == 0};
+    }
+
+    FunctionMaxima<int, int> tree;
+    run("FunctionMaxima", tree, n, operations);
+
+    LsmFunctionMaxima<int, int> lsm(capacity);
+    run("LsmFunctionMaxima", lsm, n, operations);
+
+    return 0;
+}
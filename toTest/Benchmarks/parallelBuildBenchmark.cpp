@@ -0,0 +1,51 @@
+/**
+ * Measures how the parallel assign() scales with the number of threads.
+ *
+ * Usage: ParallelBuildBenchmark [number of points] [maximal number of threads]
+ */
+
+#include "../../function_maxima.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+int main(int argc, char **argv) {
+    const std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000;
+    const std::size_t maxThreads = argc > 2 ? std::strtoul(argv[2], nullptr, 10)
+                                            : std::max(1u, std::thread::hardware_concurrency());
+
+    std::mt19937 gen(2021);
+    std::vector<std::pair<long long, long long>> input(n);
+    for (std::size_t i = 0; i < n; i++) {
+        input[i] = {static_cast<long long>(gen()), static_cast<long long>(gen() % 1000)};
+    }
+
+    std::printf("points: %zu\n", n);
+    double baseline = 0;
+    std::size_t size = 0;
+
+    for (std::size_t threads = 1; threads <= maxThreads; threads++) {
+        FunctionMaxima<long long, long long> fun;
+        auto start = std::chrono::steady_clock::now();
+        fun.assign(input.begin(), input.end(), threads);
+        auto stop = std::chrono::steady_clock::now();
+        double time = std::chrono::duration<double, std::milli>(stop - start).count();
+
+        if (threads == 1) {
+            baseline = time;
+            size = fun.size();
+        } else if (fun.size() != size) {
+            std::printf("size mismatch\n");
+            return 1;
+        }
+
+        std::printf("threads: %2zu  time: %10.2f ms  speedup: %5.2fx\n", threads, time, baseline / time);
+    }
+
+    return 0;
+}
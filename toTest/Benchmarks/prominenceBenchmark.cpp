@@ -0,0 +1,104 @@
+/**
+ * Measures ProminentFunctionMaxima on a noisy signal: a slow random walk plus small noise, so almost
+ * every other point is a maximum but only a few of them are significant peaks.
+ * Compares the cost of finding significant peaks by scanning all maxima with the index,
+ * and the cost of writes with and without the index.
+ *
+ * Usage: ProminenceBenchmark [points] [writes] [threshold]
+ */
+
+#include "../../prominent_function_maxima.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+    const std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    const std::size_t m = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200000;
+    const long long threshold = argc > 3 ? std::atoll(argv[3]) : 2000;
+
+    std::mt19937 gen(2021);
+    std::normal_distribution<double> step(0, 100), noise(0, 20);
+    std::vector<long long> trend(n);
+    double level = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        level += step(gen);
+        trend[i] = static_cast<long long>(level);
+    }
+    auto sample = [&](std::size_t i) {
+        return trend[i] + static_cast<long long>(noise(gen));
+    };
+
+    FunctionMaxima<int, long long> plain;
+    ProminentFunctionMaxima<int, long long> indexed(threshold);
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < n; i++) {
+        plain.set_value(static_cast<int>(i), sample(i));
+    }
+    double plainBuild = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (const auto &p : plain) {
+        indexed.set_value(p.arg(), p.value());
+    }
+    double indexedBuild = secondsSince(start);
+
+    std::size_t maxima = 0;
+    for (auto it = indexed.mx_begin(); it != indexed.mx_end(); ++it) {
+        maxima++;
+    }
+
+    // Without the index every maximum has to be inspected; here only counting, not even its prominence.
+    start = std::chrono::steady_clock::now();
+    long long checksum = 0;
+    for (int round = 0; round < 10; round++) {
+        for (auto it = indexed.mx_begin(); it != indexed.mx_end(); ++it) {
+            checksum += it->value();
+        }
+    }
+    double scanAll = secondsSince(start) / 10;
+
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < 10; round++) {
+        for (auto it = indexed.prominent_begin(); it != indexed.prominent_end(); ++it) {
+            checksum += it->value();
+        }
+    }
+    double scanProminent = secondsSince(start) / 10;
+
+    std::printf("points: %zu  maxima: %zu  prominent (> %lld): %zu\n", n, maxima, threshold, indexed.prominent_size());
+    std::printf("iterate all maxima:       %10.3f ms\n", scanAll * 1000);
+    std::printf("iterate prominent maxima: %10.3f ms\n", scanProminent * 1000);
+
+    std::vector<std::pair<int, long long>> writes(m);
+    for (auto &write : writes) {
+        std::size_t i = gen() % n;
+        write = {static_cast<int>(i), sample(i)};
+    }
+
+    start = std::chrono::steady_clock::now();
+    for (const auto &write : writes) {
+        plain.set_value(write.first, write.second);
+    }
+    double plainWrites = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (const auto &write : writes) {
+        indexed.set_value(write.first, write.second);
+    }
+    double indexedWrites = secondsSince(start);
+
+    std::printf("build:  FunctionMaxima %10.0f ops/s  ProminentFunctionMaxima %10.0f ops/s\n",
+                n / plainBuild, n / indexedBuild);
+    std::printf("writes: FunctionMaxima %10.0f ops/s  ProminentFunctionMaxima %10.0f ops/s  (checksum: %lld)\n",
+                m / plainWrites, m / indexedWrites, checksum);
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+/**
+ * Compares memory, number of allocations and build time of many tiny functions
+ * stored as FunctionMaxima and as SmallFunctionMaxima.
+ * Memory and allocations are counted by the shared allocator of allocationCounter.h.
+ *
+ * Usage: SmallBenchmark [number of functions] [maximal number of points per function]
+ */
+
+#include "../../small_function_maxima.h"
+#include "allocationCounter.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+template<typename F>
+void run(const char *name, std::size_t n, int maxPoints) {
+    std::mt19937 gen(2021);
+    HeapUsage before = heapUsage();
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<F> functions(n);
+    std::size_t points = 0;
+    for (F &fun : functions) {
+        for (int k = static_cast<int>(gen() % (maxPoints + 1)); k > 0; k--) {
+            fun.set_value(static_cast<int>(gen() % 64), static_cast<int>(gen() % 100));
+        }
+        points += fun.size();
+    }
+
+    double build = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    HeapUsage after = heapUsage();
+    std::size_t bytes = after.liveBytes - before.liveBytes;
+    std::size_t allocated = after.allocations - before.allocations;
+
+    long long checksum = 0;
+    start = std::chrono::steady_clock::now();
+    for (const F &fun : functions) {
+        if (fun.mx_begin() != fun.mx_end()) {
+            checksum += fun.mx_begin()->value();
+        }
+    }
+    double scan = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("%-28s %8.1f B/function  %6.2f allocations/function  build: %7.1f ms  top maxima: %6.1f ms"
+                "  (points: %zu, checksum: %lld)\n",
+                name, static_cast<double>(bytes) / n, static_cast<double>(allocated) / n, build, scan,
+                points, checksum);
+}
+
+int main(int argc, char **argv) {
+    const std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    const int maxPoints = argc > 2 ? std::atoi(argv[2]) : 7;
+
+    run<FunctionMaxima<int, int>>("FunctionMaxima", n, maxPoints);
+    run<SmallFunctionMaxima<int, int, 8>>("SmallFunctionMaxima<8>", n, maxPoints);
+    run<SmallFunctionMaxima<int, int, 4>>("SmallFunctionMaxima<4>", n, maxPoints);
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+// Counters are compiled in only with MAXIMA_STATS, which has to be defined the same way in every
+// translation unit of a program, so these tests run as a separate executable and the main suite
+// keeps testing the default configuration.
+#define MAXIMA_STATS
+
+#include "gtest/gtest.h"
+#include "../function_maxima.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+class ArmedThrow {
+public:
+    static bool armed;
+
+    explicit ArmedThrow(int v) : value(v) {}
+
+    bool operator<(const ArmedThrow &a) const {
+        if (armed && (value == 42 || a.value == 42)) {
+            throw std::string("BOOM");
+        }
+        return value < a.value;
+    }
+
+private:
+    int value;
+};
+
+bool ArmedThrow::armed = false;
+
+// STATS TESTS
+
+TEST(stats, countsHotPathEvents) {
+    using F = FunctionMaxima<int, int>;
+    F::reset_stats();
+    ASSERT_EQ(F::stats().pointComparisons, 0u);
+
+    F fun;
+    fun.set_value(1, 5);
+    fun.set_value(2, 7);
+    fun.erase(2);
+    MaximaStats stats = F::stats();
+    ASSERT_GT(stats.pointComparisons, 0u);
+    ASSERT_GT(stats.maximaComparisons, 0u);
+    ASSERT_GT(stats.neighbourWalks, 0u);
+    ASSERT_EQ(stats.maximaInsertions, 3u);
+    ASSERT_EQ(stats.maximaErasures, 2u);
+    ASSERT_EQ(stats.allocations, 0u);
+    ASSERT_EQ(stats.rollbacks, 0u);
+
+    using G = FunctionMaxima<ArmedThrow, ArmedThrow>;
+    G::reset_stats();
+    G generic;
+    generic.set_value(ArmedThrow(1), ArmedThrow(2));
+    ArmedThrow::armed = true;
+    ASSERT_THROW(generic.set_value(ArmedThrow(0), ArmedThrow(42)), std::string);
+    ArmedThrow::armed = false;
+    ASSERT_EQ(G::stats().rollbacks, 1u);
+    ASSERT_GT(G::stats().allocations, 0u);
+    ASSERT_EQ(F::stats().rollbacks, 0u);
+}
+
+// MAXIMUM FLAG TESTS
+
+TEST(maximumFlag, skipsLookupsOfNonMaxima) {
+    using F = FunctionMaxima<int, int>;
+    F fun;
+
+    for (int i = 0; i < 1000; i++) {
+        fun.set_value(i, i);
+    }
+
+    F::reset_stats();
+    fun.erase(500);
+    fun.set_value(600, 600);
+    ASSERT_EQ(F::stats().maximaComparisons, 0u);
+
+    std::vector<std::pair<int, int>> maxima;
+    for (auto it = fun.mx_begin(); it != fun.mx_end(); ++it) {
+        maxima.emplace_back(it->arg(), it->value());
+    }
+    ASSERT_EQ(maxima, (std::vector<std::pair<int, int>>{{999, 999}}));
+}
+
+TEST(maximumFlag, clearedWhenGenericWriteDemotes) {
+    using G = FunctionMaxima<ArmedThrow, ArmedThrow>;
+    G fun;
+    int values[] = {5, 3, 2, 1, 0, 9};
+    for (int i = 0; i < 6; i++) {
+        fun.set_value(ArmedThrow(i + 1), ArmedThrow(values[i]));
+    }
+    fun.set_value(ArmedThrow(0), ArmedThrow(7));
+
+    G::reset_stats();
+    fun.erase(ArmedThrow(2));
+    ASSERT_EQ(G::stats().maximaComparisons, 0u);
+
+    {
+        G::transaction group(fun);
+        fun.set_value(ArmedThrow(0), ArmedThrow(1));
+        group.rollback();
+    }
+
+    G::reset_stats();
+    fun.erase(ArmedThrow(3));
+    ASSERT_EQ(G::stats().maximaComparisons, 0u);
+    ASSERT_EQ(fun.size(), 5u);
+}
+
+TEST(maximumFlag, entriesReferToPointsOfTheirFunction) {
+    using G = FunctionMaxima<ArmedThrow, ArmedThrow>;
+    G fun;
+    int values[] = {1, 4, 2, 6, 3};
+    for (int i = 0; i < 5; i++) {
+        fun.set_value(ArmedThrow(i), ArmedThrow(values[i]));
+    }
+
+    G::reset_stats();
+    G copy(fun);
+    ASSERT_EQ(G::stats().allocations, 0u);
+
+    for (const G *f : {&fun, &copy}) {
+        size_t maxima = 0;
+        for (auto it = f->mx_begin(); it != f->mx_end(); ++it, maxima++) {
+            ASSERT_EQ(&*it, &*f->find(it->arg()));
+        }
+        ASSERT_EQ(maxima, 2u);
+    }
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
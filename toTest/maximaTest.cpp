@@ -1,5 +1,22 @@
 #include "gtest/gtest.h"
 #include "../function_maxima.h"
+#include "../dense_function_maxima.h"
+#include "../maxima_kernel.h"
+#include "../instrumented_function_maxima.h"
+#include "../frozen_function_maxima.h"
+#include "../journaled_function_maxima.h"
+#include "../small_function_maxima.h"
+#include "../concurrent_function_maxima.h"
+#include "../lsm_function_maxima.h"
+#include "../prominent_function_maxima.h"
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 // EXAMPLE TEST CLASSES.
@@ -354,6 +371,1898 @@ TEST(throwOnCompare, exceptionHandlingProperlySwapped
               1);
 }
 
+// DENSE FUNCTION MAXIMA TESTS
+
+template<typename F>
+std::vector<std::pair<int, int>> dump_points(F &&fun) {
+    std::vector<std::pair<int, int>> result;
+    for (auto it = fun.begin(); it != fun.end(); ++it) {
+        result.emplace_back(it->arg(), it->value());
+    }
+    return result;
+}
+
+template<typename F>
+std::vector<std::pair<int, int>> dump_maxima(F &&fun) {
+    std::vector<std::pair<int, int>> result;
+    for (auto it = fun.mx_begin(); it != fun.mx_end(); ++it) {
+        result.emplace_back(it->arg(), it->value());
+    }
+    return result;
+}
+
+TEST(denseFunctionMaxima, example) {
+    DenseFunctionMaxima<int, int> fun(-10, 10);
+    fun.set_value(0, 1);
+    fun.set_value(0, 0);
+    fun.set_value(1, 0);
+    fun.set_value(2, 0);
+    ASSERT_EQ(dump_maxima(fun), (std::vector<std::pair<int, int>>{{0, 0}, {1, 0}, {2, 0}}));
+
+    fun.set_value(1, 1);
+    fun.set_value(2, 2);
+    fun.set_value(0, 2);
+    fun.set_value(1, 3);
+    ASSERT_EQ(dump_maxima(fun), (std::vector<std::pair<int, int>>{{1, 3}}));
+    ASSERT_THROW(fun.value_at(4), InvalidArg);
+
+    fun.erase(1);
+    ASSERT_TRUE(fun.find(1) == fun.end());
+    fun.set_value(-2, 0);
+    fun.set_value(-1, -1);
+    ASSERT_EQ(dump_maxima(fun), (std::vector<std::pair<int, int>>{{0, 2}, {2, 2}, {-2, 0}}));
+    ASSERT_EQ(fun.size(), 4u);
+    ASSERT_EQ(fun.value_at(-2), 0);
+}
+
+TEST(denseFunctionMaxima, outOfRange) {
+    DenseFunctionMaxima<int, int> fun(5, 7);
+    ASSERT_THROW(fun.set_value(7, 1), InvalidArg);
+    ASSERT_THROW(fun.set_value(4, 1), InvalidArg);
+    ASSERT_THROW(fun.value_at(100), InvalidArg);
+    ASSERT_TRUE(fun.find(100) == fun.end());
+    fun.erase(100);
+    fun.set_value(6, 1);
+    ASSERT_EQ(fun.size(), 1u);
+    ASSERT_THROW((DenseFunctionMaxima<int, int>(3, 2)), InvalidArg);
+}
+
+TEST(denseFunctionMaxima, matchesFunctionMaxima) {
+    std::mt19937 gen(2021);
+    const int lo = -300, hi = 9000;
+    DenseFunctionMaxima<int, int> dense(lo, hi);
+    FunctionMaxima<int, int> reference;
+
+    for (int i = 0; i < 20000; i++) {
+        int a = lo + static_cast<int>(gen() % (hi - lo));
+        if (gen() % 4 == 0) {
+            dense.erase(a);
+            reference.erase(a);
+        } else {
+            int v = static_cast<int>(gen() % 10);
+            dense.set_value(a, v);
+            reference.set_value(a, v);
+        }
+        if (i % 1000 == 0) {
+            DenseFunctionMaxima<int, int> copy(dense);
+            ASSERT_EQ(dump_points(copy), dump_points(reference));
+            ASSERT_EQ(dump_maxima(copy), dump_maxima(reference));
+        }
+    }
+
+    ASSERT_EQ(dense.size(), reference.size());
+    ASSERT_EQ(dump_points(dense), dump_points(reference));
+    ASSERT_EQ(dump_maxima(dense), dump_maxima(reference));
+
+    std::vector<std::pair<int, int>> backwards;
+    for (auto it = dense.end(); it != dense.begin();) {
+        --it;
+        backwards.emplace_back(it->arg(), it->value());
+    }
+    std::reverse(backwards.begin(), backwards.end());
+    ASSERT_EQ(backwards, dump_points(reference));
+}
+
+// NOTHROW TYPES TESTS
+
+TEST(nothrowTypes, matchesGenericPath) {
+    std::mt19937 gen(2020);
+    FunctionMaxima<int, int> lean;
+    FunctionMaxima<Secret, Secret> generic;
+
+    for (int i = 0; i < 20000; i++) {
+        int a = static_cast<int>(gen() % 500);
+        if (gen() % 4 == 0) {
+            lean.erase(a);
+            generic.erase(Secret::create(a));
+        } else {
+            int v = static_cast<int>(gen() % 10);
+            lean.set_value(a, v);
+            generic.set_value(Secret::create(a), Secret::create(v));
+        }
+    }
+
+    ASSERT_EQ(lean.size(), generic.size());
+    std::vector<std::pair<int, int>> genericPoints, genericMaxima;
+    for (auto &p : generic) {
+        genericPoints.emplace_back(p.arg().get(), p.value().get());
+    }
+    for (auto it = generic.mx_begin(); it != generic.mx_end(); ++it) {
+        genericMaxima.emplace_back(it->arg().get(), it->value().get());
+    }
+    ASSERT_EQ(dump_points(lean), genericPoints);
+    ASSERT_EQ(dump_maxima(lean), genericMaxima);
+}
+
+TEST(nothrowTypes, valueReferenceOutlivesLookup) {
+    FunctionMaxima<long long, double> fun;
+    fun.set_value(1, 0.5);
+    fun.set_value(2, 1.5);
+    const double &value = fun.value_at(2);
+    fun.set_value(3, 2.5);
+    ASSERT_EQ(value, 1.5);
+    ASSERT_EQ(fun.mx_begin()->arg(), 3);
+}
+
+// BULK BUILD TESTS
+
+template<typename V>
+void check_kernel_matches_scalar(std::mt19937 &gen, int range) {
+    for (std::size_t n = 0; n < 200; n += (n < 40 ? 1 : 17)) {
+        std::vector<V> values(n);
+        for (auto &v : values) {
+            v = static_cast<V>(static_cast<int>(gen() % range) - range / 2);
+        }
+        V outside[2] = {static_cast<V>(0), static_cast<V>(range)};
+        for (int variant = 0; variant < 4; variant++) {
+            const V *before = (variant & 1) ? &outside[0] : nullptr;
+            const V *after = (variant & 2) ? &outside[1] : nullptr;
+            std::vector<unsigned char> fast(n), slow(n);
+            MaximaKernel::maxima_mask(values.data(), n, fast.data(), before, after);
+            MaximaKernel::maxima_mask_scalar(values.data(), n, slow.data(), before, after);
+            ASSERT_EQ(fast, slow);
+        }
+    }
+}
+
+TEST(maximaKernel, matchesScalar) {
+    std::mt19937 gen(7);
+    check_kernel_matches_scalar<int>(gen, 5);
+    check_kernel_matches_scalar<int>(gen, 1000);
+    check_kernel_matches_scalar<unsigned>(gen, 5);
+    check_kernel_matches_scalar<long long>(gen, 5);
+    check_kernel_matches_scalar<unsigned long long>(gen, 5);
+    check_kernel_matches_scalar<short>(gen, 5);
+    check_kernel_matches_scalar<float>(gen, 5);
+    check_kernel_matches_scalar<double>(gen, 5);
+}
+
+TEST(maximaKernel, unsignedAndNan) {
+    std::vector<unsigned> u = {1u, 0x80000000u, 5u, 7u, 7u, 0xffffffffu, 3u, 2u, 9u, 9u, 1u};
+    std::vector<unsigned char> fast(u.size()), slow(u.size());
+    MaximaKernel::maxima_mask(u.data(), u.size(), fast.data());
+    MaximaKernel::maxima_mask_scalar(u.data(), u.size(), slow.data());
+    ASSERT_EQ(fast, slow);
+
+    std::vector<double> d = {1, NAN, 2, 3, NAN, NAN, 1, 0, 4, 4, NAN, 5, 1};
+    std::vector<unsigned char> fastD(d.size()), slowD(d.size());
+    MaximaKernel::maxima_mask(d.data(), d.size(), fastD.data());
+    MaximaKernel::maxima_mask_scalar(d.data(), d.size(), slowD.data());
+    ASSERT_EQ(fastD, slowD);
+}
+
+TEST(bulkBuild, assignMatchesSetValue) {
+    std::mt19937 gen(11);
+    std::vector<std::pair<int, int>> input;
+    for (int i = 0; i < 5000; i++) {
+        input.emplace_back(static_cast<int>(gen() % 2000), static_cast<int>(gen() % 7));
+    }
+
+    FunctionMaxima<int, int> sequential;
+    for (auto &p : input) {
+        sequential.set_value(p.first, p.second);
+    }
+    FunctionMaxima<int, int> bulk;
+    bulk.set_value(-1, 100);
+    bulk.assign(input.begin(), input.end());
+
+    ASSERT_EQ(dump_points(bulk), dump_points(sequential));
+    ASSERT_EQ(dump_maxima(bulk), dump_maxima(sequential));
+
+    bulk.set_value(3000, 50);
+    sequential.set_value(3000, 50);
+    ASSERT_EQ(dump_maxima(bulk), dump_maxima(sequential));
+}
+
+TEST(bulkBuild, assignGenericTypes) {
+    std::vector<std::pair<Secret, Secret>> input;
+    for (int i = 0; i < 50; i++) {
+        input.emplace_back(Secret::create((i * 7) % 20), Secret::create(i % 5));
+    }
+
+    FunctionMaxima<Secret, Secret> sequential, bulk;
+    for (auto &p : input) {
+        sequential.set_value(p.first, p.second);
+    }
+    bulk.assign(input.begin(), input.end());
+
+    ASSERT_EQ(bulk.size(), sequential.size());
+    ASSERT_TRUE(std::equal(bulk.begin(), bulk.end(), sequential.begin(), [](auto &p, auto &q) {
+        return p.arg() == q.arg() && p.value() == q.value();
+    }));
+    ASSERT_TRUE(std::equal(bulk.mx_begin(), bulk.mx_end(), sequential.mx_begin(), sequential.mx_end(),
+                           [](auto &p, auto &q) {
+                               return p.arg() == q.arg() && p.value() == q.value();
+                           }));
+}
+
+TEST(bulkBuild, parallelAssignMatchesSetValue) {
+    std::mt19937 gen(13);
+    std::vector<std::pair<int, int>> input;
+    for (int i = 0; i < 80000; i++) {
+        input.emplace_back(static_cast<int>(gen() % 70000), static_cast<int>(gen() % 3));
+    }
+
+    FunctionMaxima<int, int> sequential;
+    for (auto &p : input) {
+        sequential.set_value(p.first, p.second);
+    }
+
+    for (std::size_t threads = 1; threads <= 4; threads++) {
+        FunctionMaxima<int, int> parallel;
+        parallel.assign(input.begin(), input.end(), threads);
+        ASSERT_EQ(dump_points(parallel), dump_points(sequential));
+        ASSERT_EQ(dump_maxima(parallel), dump_maxima(sequential));
+    }
+}
+
+TEST(bulkBuild, parallelAssignPropagatesExceptions) {
+    std::vector<std::pair<ThrowsOnCompare, int>> input;
+    for (int i = 0; i < 70000; i++) {
+        input.emplace_back(ThrowsOnCompare::create(i == 50000 ? SPECIAL_THROW_VALUE : 100 + i), i % 10);
+    }
+
+    FunctionMaxima<ThrowsOnCompare, int> fun;
+    fun.set_value(ThrowsOnCompare::create(1), 1);
+    ASSERT_THROW(fun.assign(input.begin(), input.end(), 4), std::string);
+    ASSERT_EQ(fun.size(), 1u);
+}
+
+// MERGE TESTS
+
+FunctionMaxima<int, int> random_function(std::mt19937 &gen, int points, int range, int values) {
+    FunctionMaxima<int, int> fun;
+    for (int i = 0; i < points; i++) {
+        fun.set_value(static_cast<int>(gen() % range), static_cast<int>(gen() % values));
+    }
+    return fun;
+}
+
+TEST(merge, matchesSetValue) {
+    std::mt19937 gen(17);
+    for (int round = 0; round < 60; round++) {
+        int range = 1 + static_cast<int>(gen() % 300);
+        FunctionMaxima<int, int> left = random_function(gen, static_cast<int>(gen() % 200), range, 4);
+        FunctionMaxima<int, int> right = random_function(gen, static_cast<int>(gen() % 200), range, 4);
+
+        for (MergePolicy policy : {MergePolicy::preferLeft, MergePolicy::preferRight, MergePolicy::takeMax}) {
+            FunctionMaxima<int, int> expected = left;
+            for (auto &p : right) {
+                auto it = expected.find(p.arg());
+                bool replace = it == expected.end() || policy == MergePolicy::preferRight ||
+                               (policy == MergePolicy::takeMax && it->value() < p.value());
+                if (replace) {
+                    expected.set_value(p.arg(), p.value());
+                }
+            }
+
+            FunctionMaxima<int, int> copied = left;
+            copied.merge(right, policy);
+            ASSERT_EQ(dump_points(copied), dump_points(expected));
+            ASSERT_EQ(dump_maxima(copied), dump_maxima(expected));
+
+            FunctionMaxima<int, int> moved = left, source = right;
+            moved.merge(std::move(source), policy);
+            ASSERT_EQ(dump_points(moved), dump_points(expected));
+            ASSERT_EQ(dump_maxima(moved), dump_maxima(expected));
+            ASSERT_EQ(source.size(), 0u);
+            ASSERT_TRUE(source.mx_begin() == source.mx_end());
+        }
+    }
+}
+
+class ArmedThrow {
+public:
+    static bool armed;
+
+    explicit ArmedThrow(int v) : value(v) {}
+
+    int get() const {
+        return value;
+    }
+
+    bool operator<(const ArmedThrow &a) const {
+        if (armed && (value == SPECIAL_THROW_VALUE || a.value == SPECIAL_THROW_VALUE)) {
+            throw std::string("BOOM");
+        }
+        return value < a.value;
+    }
+
+private:
+    int value;
+};
+
+bool ArmedThrow::armed = false;
+
+TEST(merge, strongGuarantee) {
+    FunctionMaxima<ArmedThrow, ArmedThrow> left, right;
+    left.set_value(ArmedThrow(1), ArmedThrow(10));
+    left.set_value(ArmedThrow(3), ArmedThrow(5));
+    right.set_value(ArmedThrow(2), ArmedThrow(7));
+    right.set_value(ArmedThrow(4), ArmedThrow(SPECIAL_THROW_VALUE));
+
+    ArmedThrow::armed = true;
+    ASSERT_THROW(left.merge(right, MergePolicy::preferRight), std::string);
+    ArmedThrow::armed = false;
+
+    ASSERT_EQ(left.size(), 2u);
+    ASSERT_EQ(left.value_at(ArmedThrow(3)).get(), 5);
+    ASSERT_EQ(std::distance(left.mx_begin(), left.mx_end()), 1);
+    ASSERT_EQ(right.size(), 2u);
+
+    left.merge(right, MergePolicy::preferRight);
+    ASSERT_EQ(left.size(), 4u);
+    ASSERT_EQ(left.mx_begin()->value().get(), SPECIAL_THROW_VALUE);
+}
+
+template<typename It>
+std::vector<std::pair<int, int>> dump_armed(It first, It last) {
+    std::vector<std::pair<int, int>> result;
+    for (auto it = first; it != last; ++it) {
+        result.emplace_back(it->arg().get(), it->value().get());
+    }
+    return result;
+}
+
+template<typename F>
+std::vector<std::pair<int, int>> dump_armed(const F &fun, bool maxima) {
+    return maxima ? dump_armed(fun.mx_begin(), fun.mx_end()) : dump_armed(fun.begin(), fun.end());
+}
+
+TEST(splitJoin, matchesSetValue) {
+    std::mt19937 gen(23);
+    for (int round = 0; round < 80; round++) {
+        int range = 1 + static_cast<int>(gen() % 100);
+        FunctionMaxima<int, int> whole = random_function(gen, static_cast<int>(gen() % 120), range, 3);
+        int a = static_cast<int>(gen() % (range + 2)) - 1;
+
+        FunctionMaxima<int, int> low, high;
+        for (auto &p : whole) {
+            (p.arg() < a ? low : high).set_value(p.arg(), p.value());
+        }
+
+        FunctionMaxima<int, int> split = whole;
+        FunctionMaxima<int, int> moved = split.split_at(a);
+        ASSERT_EQ(dump_points(split), dump_points(low));
+        ASSERT_EQ(dump_maxima(split), dump_maxima(low));
+        ASSERT_EQ(dump_points(moved), dump_points(high));
+        ASSERT_EQ(dump_maxima(moved), dump_maxima(high));
+
+        FunctionMaxima<int, int> appended = low;
+        appended.join(high);
+        ASSERT_EQ(dump_points(appended), dump_points(whole));
+        ASSERT_EQ(dump_maxima(appended), dump_maxima(whole));
+
+        FunctionMaxima<int, int> prepended = high, source = low;
+        prepended.join(std::move(source));
+        ASSERT_EQ(dump_points(prepended), dump_points(whole));
+        ASSERT_EQ(dump_maxima(prepended), dump_maxima(whole));
+        ASSERT_EQ(source.size(), 0u);
+    }
+}
+
+TEST(splitJoin, genericTypes) {
+    std::mt19937 gen(29);
+    for (int round = 0; round < 40; round++) {
+        FunctionMaxima<ArmedThrow, ArmedThrow> whole;
+        FunctionMaxima<int, int> reference;
+        for (int i = static_cast<int>(gen() % 60); i > 0; i--) {
+            int arg = static_cast<int>(gen() % 50), value = static_cast<int>(gen() % 3);
+            whole.set_value(ArmedThrow(arg), ArmedThrow(value));
+            reference.set_value(arg, value);
+        }
+        int a = static_cast<int>(gen() % 52) - 1;
+
+        FunctionMaxima<ArmedThrow, ArmedThrow> high = whole.split_at(ArmedThrow(a));
+        FunctionMaxima<int, int> expectedHigh = reference.split_at(a);
+        ASSERT_EQ(dump_armed(whole, false), dump_points(reference));
+        ASSERT_EQ(dump_armed(whole, true), dump_maxima(reference));
+        ASSERT_EQ(dump_armed(high, false), dump_points(expectedHigh));
+        ASSERT_EQ(dump_armed(high, true), dump_maxima(expectedHigh));
+
+        whole.join(std::move(high));
+        reference.join(std::move(expectedHigh));
+        ASSERT_EQ(dump_armed(whole, false), dump_points(reference));
+        ASSERT_EQ(dump_armed(whole, true), dump_maxima(reference));
+    }
+}
+
+TEST(splitJoin, overlappingAndStrongGuarantee) {
+    FunctionMaxima<int, int> left, right;
+    left.set_value(1, 1);
+    left.set_value(5, 2);
+    right.set_value(3, 7);
+    ASSERT_THROW(left.join(right), InvalidArg);
+    ASSERT_THROW(left.join(std::move(left)), InvalidArg);
+    ASSERT_EQ(left.size(), 2u);
+    ASSERT_EQ(right.size(), 1u);
+
+    FunctionMaxima<ArmedThrow, ArmedThrow> low, high;
+    low.set_value(ArmedThrow(1), ArmedThrow(10));
+    low.set_value(ArmedThrow(3), ArmedThrow(5));
+    high.set_value(ArmedThrow(4), ArmedThrow(7));
+    high.set_value(ArmedThrow(6), ArmedThrow(SPECIAL_THROW_VALUE));
+
+    ArmedThrow::armed = true;
+    ASSERT_THROW(low.join(high), std::string);
+    ArmedThrow::armed = false;
+    ASSERT_EQ(dump_armed(low, false), (std::vector<std::pair<int, int>>{{1, 10}, {3, 5}}));
+    ASSERT_EQ(dump_armed(low, true), (std::vector<std::pair<int, int>>{{1, 10}}));
+
+    low.join(high);
+    ASSERT_EQ(dump_armed(low, true), (std::vector<std::pair<int, int>>{{6, SPECIAL_THROW_VALUE}, {1, 10}}));
+}
+
+// STATS TESTS
+
+TEST(stats, disabledByDefault) {
+    using F = FunctionMaxima<int, int>;
+    F::reset_stats();
+
+    F fun;
+    fun.set_value(1, 5);
+    fun.erase(1);
+    ASSERT_FALSE(MaximaStatsRecorder<F>::enabled);
+    ASSERT_EQ(F::stats().pointComparisons, 0u);
+    ASSERT_EQ(F::stats().maximaInsertions, 0u);
+}
+
+// LATENCY TESTS
+
+TEST(latency, histogramPercentiles) {
+    LatencyHistogram histogram;
+    ASSERT_EQ(histogram.percentile(0.5), 0u);
+
+    for (std::uint64_t v = 1; v <= 100000; v++) {
+        histogram.record(v);
+    }
+    ASSERT_EQ(histogram.count(), 100000u);
+    ASSERT_EQ(histogram.max(), 100000u);
+    ASSERT_EQ(histogram.percentile(1.0), 100000u);
+
+    for (double q : {0.001, 0.5, 0.99, 0.999}) {
+        double expected = q * 100000;
+        double reported = static_cast<double>(histogram.percentile(q));
+        ASSERT_GE(reported, expected - 1);
+        ASSERT_LE(reported, expected * (1.0 + 1.0 / LatencyHistogram::subBuckets) + 1);
+    }
+
+    histogram.record(UINT64_MAX);
+    ASSERT_EQ(histogram.percentile(1.0), UINT64_MAX);
+    histogram.reset();
+    ASSERT_EQ(histogram.count(), 0u);
+}
+
+TEST(latency, instrumentedFunctionRecordsOperations) {
+    InstrumentedFunctionMaxima<int, int> fun;
+    fun.set_value(1, 2);
+    fun.set_value(2, 3);
+    fun.erase(1);
+    ASSERT_EQ(fun.value_at(2), 3);
+    ASSERT_THROW(fun.value_at(1), InvalidArg);
+    ASSERT_TRUE(fun.find(2) != fun.end());
+
+    InstrumentedFunctionMaxima<int, int> copy(fun);
+    copy.set_value(5, 5);
+    fun = copy;
+    ASSERT_EQ(fun.size(), 2u);
+    ASSERT_TRUE(fun_mx_equal(fun.unwrap(), {{5, 5}}));
+
+    ASSERT_EQ(fun.histogram(MaximaOperation::setValue).count(), 3u);
+    ASSERT_EQ(fun.histogram(MaximaOperation::erase).count(), 1u);
+    ASSERT_EQ(fun.histogram(MaximaOperation::valueAt).count(), 2u);
+    ASSERT_EQ(fun.histogram(MaximaOperation::find).count(), 1u);
+    ASSERT_EQ(fun.histogram(MaximaOperation::copy).count(), 1u);
+    ASSERT_EQ(fun.histogram(MaximaOperation::assignment).count(), 1u);
+
+    fun.reset_latencies();
+    ASSERT_EQ(copy.histogram(MaximaOperation::setValue).count(), 0u);
+}
+
+// NON-THROWING LOOKUP TESTS
+
+TEST(lookup, tryValueAtAndContains) {
+    FunctionMaxima<int, int> fun;
+    fun.set_value(1, 10);
+    fun.set_value(3, 30);
+    static_assert(noexcept(fun.try_value_at(1)) && noexcept(fun.contains(1)), "int lookups should be nothrow");
+
+    ASSERT_EQ(*fun.try_value_at(3), 30);
+    ASSERT_EQ(fun.try_value_at(2), nullptr);
+    ASSERT_TRUE(fun.contains(1));
+    ASSERT_FALSE(fun.contains(2));
+    ASSERT_EQ(fun.try_value_at(1), &fun.value_at(1));
+
+    FunctionMaxima<Secret, Secret> secret;
+    secret.set_value(Secret::create(4), Secret::create(5));
+    ASSERT_EQ(secret.try_value_at(Secret::create(4))->get(), 5);
+    ASSERT_EQ(secret.try_value_at(Secret::create(5)), nullptr);
+    ASSERT_FALSE(secret.contains(Secret::create(5)));
+
+    DenseFunctionMaxima<int, int> dense(0, 10);
+    dense.set_value(7, 70);
+    ASSERT_EQ(*dense.try_value_at(7), 70);
+    ASSERT_EQ(dense.try_value_at(6), nullptr);
+    ASSERT_EQ(dense.try_value_at(-5), nullptr);
+    ASSERT_EQ(dense.try_value_at(10), nullptr);
+    ASSERT_TRUE(dense.contains(7));
+    ASSERT_FALSE(dense.contains(100));
+}
+
+// HINTED INSERTION TESTS
+
+TEST(hintedInsertion, appendMatchesBulkBuild) {
+    std::mt19937 gen(31);
+    for (int round = 0; round < 40; round++) {
+        std::vector<std::pair<int, int>> input;
+        FunctionMaxima<int, int> appended, hinted;
+        FunctionMaxima<ArmedThrow, ArmedThrow> generic;
+        int arg = 0;
+        for (int i = static_cast<int>(gen() % 200); i > 0; i--) {
+            arg += gen() % 4 == 0 ? -static_cast<int>(gen() % 10) : 1 + static_cast<int>(gen() % 3);
+            int value = static_cast<int>(gen() % 5);
+            input.emplace_back(arg, value);
+            appended.set_value(arg, value);
+            hinted.set_value(gen() % 2 ? hinted.end() : hinted.find(arg), arg, value);
+            generic.set_value(ArmedThrow(arg), ArmedThrow(value));
+        }
+
+        FunctionMaxima<int, int> expected;
+        expected.assign(input.begin(), input.end());
+        ASSERT_EQ(dump_points(appended), dump_points(expected));
+        ASSERT_EQ(dump_maxima(appended), dump_maxima(expected));
+        ASSERT_EQ(dump_points(hinted), dump_points(expected));
+        ASSERT_EQ(dump_maxima(hinted), dump_maxima(expected));
+        ASSERT_EQ(dump_armed(generic, false), dump_points(expected));
+        ASSERT_EQ(dump_armed(generic, true), dump_maxima(expected));
+    }
+}
+
+TEST(hintedInsertion, hintsBeforeEveryPosition) {
+    FunctionMaxima<int, int> fun;
+    for (int a : {10, 20, 30}) {
+        fun.set_value(a, a);
+    }
+
+    fun.set_value(fun.find(20), 15, 40);
+    fun.set_value(fun.begin(), 5, 50);
+    fun.set_value(fun.find(30), 30, 1);
+    fun.set_value(fun.begin(), 25, 2);
+    ASSERT_TRUE(fun_equal(fun, {{5, 50}, {10, 10}, {15, 40}, {20, 20}, {25, 2}, {30, 1}}));
+    ASSERT_TRUE(fun_mx_equal(fun, {{5, 50}, {15, 40}}));
+}
+
+TEST(hintedInsertion, appendStrongGuarantee) {
+    FunctionMaxima<ArmedThrow, ArmedThrow> fun;
+    fun.set_value(ArmedThrow(1), ArmedThrow(3));
+    fun.set_value(ArmedThrow(2), ArmedThrow(5));
+
+    ArmedThrow::armed = true;
+    ASSERT_THROW(fun.set_value(fun.end(), ArmedThrow(3), ArmedThrow(SPECIAL_THROW_VALUE)), std::string);
+    ArmedThrow::armed = false;
+    ASSERT_EQ(dump_armed(fun, false), (std::vector<std::pair<int, int>>{{1, 3}, {2, 5}}));
+    ASSERT_EQ(dump_armed(fun, true), (std::vector<std::pair<int, int>>{{2, 5}}));
+}
+
+// FINGER SEARCH TESTS
+
+TEST(finger, localAndFarAccessesMatchMap) {
+    std::mt19937 gen(37);
+    FunctionMaxima<int, int> fun;
+    std::map<int, int> reference;
+    int position = 0;
+
+    for (int i = 0; i < 20000; i++) {
+        position += gen() % 10 == 0 ? static_cast<int>(gen() % 2001) - 1000 : static_cast<int>(gen() % 7) - 3;
+        int arg = position;
+
+        switch (gen() % 4) {
+            case 0:
+            case 1:
+                fun.set_value(arg, static_cast<int>(gen() % 5));
+                reference[arg] = fun.value_at(arg);
+                break;
+            case 2:
+                fun.erase(arg);
+                reference.erase(arg);
+                break;
+            default:
+                ASSERT_EQ(fun.find(arg) != fun.end(), reference.count(arg) == 1);
+                ASSERT_EQ(fun.contains(arg + 1), reference.count(arg + 1) == 1);
+        }
+
+        if (i % 5000 == 0) {
+            FunctionMaxima<int, int> copy = fun;
+            FunctionMaxima<int, int> high = copy.split_at(position);
+            copy.join(std::move(high));
+            fun = copy;
+        }
+    }
+
+    ASSERT_EQ(fun.size(), reference.size());
+    ASSERT_TRUE(std::equal(fun.begin(), fun.end(), reference.begin(), [](auto &p, auto &q) {
+        return p.arg() == q.first && p.value() == q.second;
+    }));
+
+    std::vector<std::pair<int, int>> input(reference.begin(), reference.end());
+    FunctionMaxima<int, int> expected;
+    expected.assign(input.begin(), input.end());
+    ASSERT_EQ(dump_maxima(fun), dump_maxima(expected));
+}
+
+// BATCH LOOKUP TESTS
+
+TEST(batchLookup, sortedMatchesTryValueAt) {
+    std::mt19937 gen(41);
+    for (int round = 0; round < 30; round++) {
+        int range = 1 + static_cast<int>(gen() % 5000);
+        FunctionMaxima<int, int> fun = random_function(gen, static_cast<int>(gen() % 2000), range, 100);
+
+        std::vector<int> keys(gen() % 500);
+        for (int &k : keys) {
+            k = static_cast<int>(gen() % (range + 20)) - 10;
+        }
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<const int *> found;
+        fun.values_at(keys.begin(), keys.end(), std::back_inserter(found));
+
+        ASSERT_EQ(found.size(), keys.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            ASSERT_EQ(found[i], fun.try_value_at(keys[i]));
+        }
+    }
+
+    FunctionMaxima<Secret, Secret> secret;
+    secret.set_value(Secret::create(2), Secret::create(20));
+    std::vector<Secret> keys = {Secret::create(1), Secret::create(2), Secret::create(2)};
+    const Secret *found[3];
+    ASSERT_EQ(secret.values_at(keys.begin(), keys.end(), found), found + 3);
+    ASSERT_EQ(found[0], nullptr);
+    ASSERT_EQ(found[1]->get(), 20);
+    ASSERT_EQ(found[2], found[1]);
+}
+
+TEST(batchLookup, unsortedMatchesTryValueAt) {
+    std::mt19937 gen(43);
+    for (int round = 0; round < 30; round++) {
+        int range = 1 + static_cast<int>(gen() % 5000);
+        FunctionMaxima<int, int> fun = random_function(gen, static_cast<int>(gen() % 2000), range, 100);
+
+        std::vector<int> keys(gen() % 100);
+        for (int &k : keys) {
+            k = static_cast<int>(gen() % (range + 20)) - 10;
+        }
+
+        if (round % 2 == 1) {
+            fun.enable_hash_index();
+        }
+
+        std::vector<const int *> found(keys.size());
+        ASSERT_TRUE(fun.values_at_unsorted(keys.begin(), keys.end(), found.begin()) == found.end());
+        for (size_t i = 0; i < keys.size(); i++) {
+            ASSERT_EQ(found[i], fun.try_value_at(keys[i]));
+        }
+    }
+
+    FunctionMaxima<Secret, Secret> secret;
+    std::vector<Secret> keys = {Secret::create(2), Secret::create(1)};
+    const Secret *found[2];
+    secret.values_at_unsorted(keys.begin(), keys.end(), found);
+    ASSERT_EQ(found[0], nullptr);
+    secret.set_value(Secret::create(2), Secret::create(20));
+    secret.values_at_unsorted(keys.begin(), keys.end(), found);
+    ASSERT_EQ(found[0]->get(), 20);
+    ASSERT_EQ(found[1], nullptr);
+}
+
+// HASH INDEX TESTS
+
+TEST(hashIndex, matchesUnindexedFunction) {
+    std::mt19937 gen(47);
+    FunctionMaxima<int, int> indexed, plain;
+    indexed.set_value(1, 1);
+    indexed.enable_hash_index();
+    plain.set_value(1, 1);
+
+    for (int i = 0; i < 20000; i++) {
+        int arg = static_cast<int>(gen() % 500);
+        if (gen() % 3 == 0) {
+            indexed.erase(arg);
+            plain.erase(arg);
+        } else {
+            int value = static_cast<int>(gen() % 10);
+            indexed.set_value(arg, value);
+            plain.set_value(arg, value);
+        }
+
+        int probe = static_cast<int>(gen() % 520);
+        ASSERT_EQ(indexed.contains(probe), plain.contains(probe));
+        ASSERT_EQ(indexed.find(probe) == indexed.end(), plain.find(probe) == plain.end());
+        if (plain.contains(probe)) {
+            ASSERT_EQ(indexed.value_at(probe), plain.value_at(probe));
+            ASSERT_EQ(indexed.find(probe)->arg(), probe);
+        } else {
+            ASSERT_THROW(indexed.value_at(probe), InvalidArg);
+        }
+    }
+
+    ASSERT_EQ(dump_points(indexed), dump_points(plain));
+    ASSERT_EQ(dump_maxima(indexed), dump_maxima(plain));
+    ASSERT_TRUE(indexed.has_hash_index());
+
+    FunctionMaxima<int, int> copy = indexed;
+    FunctionMaxima<int, int> high = copy.split_at(250);
+    ASSERT_TRUE(copy.has_hash_index() && high.has_hash_index());
+    ASSERT_EQ(copy.try_value_at(250), nullptr);
+    ASSERT_EQ(high.try_value_at(100), nullptr);
+    copy.join(std::move(high));
+    copy.merge(plain, MergePolicy::preferRight);
+    for (int probe = 0; probe < 520; probe++) {
+        ASSERT_EQ(copy.contains(probe), plain.contains(probe));
+    }
+
+    std::vector<std::pair<int, int>> input = {{7, 1}, {3, 2}};
+    copy.assign(input.begin(), input.end());
+    ASSERT_TRUE(copy.has_hash_index());
+    ASSERT_EQ(*copy.try_value_at(3), 2);
+    ASSERT_FALSE(copy.contains(100));
+
+    copy.disable_hash_index();
+    ASSERT_FALSE(copy.has_hash_index());
+    ASSERT_TRUE(copy.contains(7));
+}
+
+TEST(hashIndex, userHasherAndStrongGuarantee) {
+    FunctionMaxima<ArmedThrow, ArmedThrow> fun;
+    fun.enable_hash_index([](const ArmedThrow &a) {
+        return static_cast<std::size_t>(a.get() % 3);
+    });
+
+    for (int i = 0; i < 10; i++) {
+        fun.set_value(ArmedThrow(i), ArmedThrow(i % 4));
+    }
+
+    ArmedThrow::armed = true;
+    ASSERT_THROW(fun.set_value(ArmedThrow(-1), ArmedThrow(SPECIAL_THROW_VALUE)), std::string);
+    ASSERT_THROW(fun.set_value(ArmedThrow(4), ArmedThrow(SPECIAL_THROW_VALUE)), std::string);
+    ArmedThrow::armed = false;
+
+    ASSERT_EQ(fun.size(), 10u);
+    ASSERT_EQ(fun.try_value_at(ArmedThrow(-1)), nullptr);
+    ASSERT_EQ(fun.value_at(ArmedThrow(4)).get(), 0);
+    fun.erase(ArmedThrow(4));
+    ASSERT_FALSE(fun.contains(ArmedThrow(4)));
+    ASSERT_EQ(fun.value_at(ArmedThrow(7)).get(), 3);
+}
+
+TEST(hashIndex, splitAndJoinMoveEntries) {
+    std::mt19937 gen(53);
+    FunctionMaxima<int, int> fun;
+    FunctionMaxima<ArmedThrow, ArmedThrow> generic;
+    std::map<int, int> model;
+    fun.enable_hash_index();
+    generic.enable_hash_index([](const ArmedThrow &a) { return std::hash<int>()(a.get()); });
+
+    for (int i = 0; i < 300; i++) {
+        int arg = static_cast<int>(gen() % 400);
+        fun.set_value(arg, i % 7);
+        generic.set_value(ArmedThrow(arg), ArmedThrow(i % 7));
+        model[arg] = i % 7;
+    }
+
+    for (int round = 0; round < 200; round++) {
+        int boundary = static_cast<int>(gen() % 420) - 10;
+        FunctionMaxima<int, int> high = fun.split_at(boundary);
+        FunctionMaxima<ArmedThrow, ArmedThrow> genericHigh = generic.split_at(ArmedThrow(boundary));
+        ASSERT_TRUE(high.has_hash_index() && genericHigh.has_hash_index());
+
+        for (int probe = -5; probe < 405; probe += 3) {
+            bool present = model.count(probe) > 0;
+            ASSERT_EQ(fun.contains(probe), present && probe < boundary);
+            ASSERT_EQ(high.contains(probe), present && probe >= boundary);
+            ASSERT_EQ(generic.contains(ArmedThrow(probe)), present && probe < boundary);
+            ASSERT_EQ(genericHigh.contains(ArmedThrow(probe)), present && probe >= boundary);
+        }
+
+        if (round % 3 == 0) {
+            high.disable_hash_index();
+        }
+
+        if (round % 2 == 0) {
+            fun.join(std::move(high));
+            generic.join(std::move(genericHigh));
+        } else {
+            high.join(std::move(fun));
+            genericHigh.join(std::move(generic));
+            fun = std::move(high);
+            generic = std::move(genericHigh);
+        }
+
+        ASSERT_EQ(fun.size(), model.size());
+        ASSERT_EQ(generic.size(), model.size());
+
+        for (const auto &[arg, value] : model) {
+            ASSERT_EQ(*fun.try_value_at(arg), value);
+            ASSERT_EQ(generic.value_at(ArmedThrow(arg)).get(), value);
+        }
+
+        if (!fun.has_hash_index()) {
+            fun.enable_hash_index();
+        }
+    }
+}
+
+TEST(hashIndex, throwingHasherFallsBackToTree) {
+    FunctionMaxima<int, int> fun;
+    fun.set_value(1, 10);
+    fun.set_value(2, 20);
+    bool armed = false;
+    fun.enable_hash_index([&armed](const int &a) -> std::size_t {
+        if (armed && (a == 2 || a == 3)) {
+            throw std::string("BOOM");
+        }
+        return static_cast<std::size_t>(a);
+    });
+
+    armed = true;
+    ASSERT_TRUE(fun.contains(2));
+    ASSERT_FALSE(fun.contains(3));
+    ASSERT_EQ(*fun.try_value_at(2), 20);
+    ASSERT_EQ(fun.value_at(1), 10);
+
+    std::vector<int> keys = {3, 2, 1};
+    const int *found[3];
+    fun.values_at_unsorted(keys.begin(), keys.end(), found);
+    ASSERT_EQ(found[0], nullptr);
+    ASSERT_EQ(*found[1], 20);
+    ASSERT_EQ(*found[2], 10);
+}
+
+// MAXIMUM FLAG TESTS
+
+TEST(maximumFlag, randomOperationsMatchBulkBuild) {
+    std::mt19937 gen(41);
+    FunctionMaxima<int, int> fun;
+    FunctionMaxima<ArmedThrow, ArmedThrow> generic;
+
+    for (int i = 0; i < 4000; i++) {
+        int arg = static_cast<int>(gen() % 200), value = static_cast<int>(gen() % 4);
+
+        switch (gen() % 8) {
+            case 0:
+                fun.erase(arg);
+                generic.erase(ArmedThrow(arg));
+                break;
+            case 1: {
+                FunctionMaxima<int, int> high = fun.split_at(arg);
+                FunctionMaxima<ArmedThrow, ArmedThrow> genericHigh = generic.split_at(ArmedThrow(arg));
+                fun.join(std::move(high));
+                generic.join(std::move(genericHigh));
+                break;
+            }
+            case 2: {
+                FunctionMaxima<int, int> other;
+                FunctionMaxima<ArmedThrow, ArmedThrow> genericOther;
+                other.set_value(arg, value);
+                genericOther.set_value(ArmedThrow(arg), ArmedThrow(value));
+                fun.merge(std::move(other), MergePolicy::preferRight);
+                generic.merge(std::move(genericOther), MergePolicy::preferRight);
+                break;
+            }
+            default:
+                fun.set_value(arg, value);
+                generic.set_value(ArmedThrow(arg), ArmedThrow(value));
+        }
+
+        if (i % 250 == 0) {
+            std::vector<std::pair<int, int>> input = dump_points(fun);
+            FunctionMaxima<int, int> expected;
+            expected.assign(input.begin(), input.end());
+            ASSERT_EQ(dump_maxima(fun), dump_maxima(expected));
+            ASSERT_EQ(dump_armed(generic, true), dump_maxima(expected));
+        }
+    }
+}
+
+// FROZEN FUNCTION TESTS
+
+template<typename F, typename G>
+bool same_points(F first, F last, G other, G otherLast) {
+    for (; first != last && other != otherLast; ++first, ++other) {
+        if (first->arg() < other->arg() || other->arg() < first->arg() ||
+            first->value() < other->value() || other->value() < first->value()) {
+            return false;
+        }
+    }
+    return first == last && other == otherLast;
+}
+
+TEST(frozen, matchesFunction) {
+    std::mt19937_64 gen(43);
+    for (int round = 0; round < 30; round++) {
+        using F = FunctionMaxima<long long, long long>;
+        F fun;
+        int spread = round % 3 == 0 ? 60 : 10;
+        for (int i = static_cast<int>(gen() % 3000); i > 0; i--) {
+            long long arg = static_cast<long long>(gen() >> spread) - (1LL << (63 - spread));
+            long long value = round % 2 ? static_cast<long long>(gen() % 5) - 2 : static_cast<long long>(gen());
+            fun.set_value(arg, value);
+        }
+        if (round == 0) {
+            fun.set_value(std::numeric_limits<long long>::min(), 0);
+            fun.set_value(std::numeric_limits<long long>::max(), std::numeric_limits<long long>::min());
+        }
+
+        FrozenFunctionMaxima<long long, long long> frozen = freeze(fun);
+        ASSERT_EQ(frozen.size(), fun.size());
+        ASSERT_TRUE(same_points(frozen.begin(), frozen.end(), fun.begin(), fun.end()));
+        ASSERT_TRUE(same_points(frozen.mx_begin(), frozen.mx_end(), fun.mx_begin(), fun.mx_end()));
+
+        for (const auto &p : fun) {
+            ASSERT_EQ(frozen.value_at(p.arg()), p.value());
+            if (p.arg() != std::numeric_limits<long long>::min()) {
+                ASSERT_EQ(frozen.contains(p.arg() - 1), fun.contains(p.arg() - 1));
+            }
+        }
+        long long missing = 0;
+        while (fun.contains(missing)) {
+            missing++;
+        }
+        ASSERT_THROW(frozen.value_at(missing), InvalidArg);
+
+        F thawed = frozen.thaw();
+        ASSERT_TRUE(same_points(thawed.begin(), thawed.end(), fun.begin(), fun.end()));
+        ASSERT_TRUE(same_points(thawed.mx_begin(), thawed.mx_end(), fun.mx_begin(), fun.mx_end()));
+    }
+}
+
+TEST(frozen, genericTypes) {
+    FunctionMaxima<ArmedThrow, ArmedThrow> fun;
+    for (int i = 0; i < 100; i++) {
+        fun.set_value(ArmedThrow(i * 3), ArmedThrow(i % 7));
+    }
+
+    FrozenFunctionMaxima<ArmedThrow, ArmedThrow> frozen = freeze(fun);
+    ASSERT_TRUE(same_points(frozen.begin(), frozen.end(), fun.begin(), fun.end()));
+    ASSERT_TRUE(same_points(frozen.mx_begin(), frozen.mx_end(), fun.mx_begin(), fun.mx_end()));
+    ASSERT_EQ(frozen.value_at(ArmedThrow(30)).get(), 3);
+    ASSERT_FALSE(frozen.contains(ArmedThrow(31)));
+    ASSERT_THROW(frozen.value_at(ArmedThrow(31)), InvalidArg);
+    ASSERT_EQ(dump_armed(frozen.thaw(), true), dump_armed(fun, true));
+
+    FrozenFunctionMaxima<ArmedThrow, ArmedThrow> empty;
+    ASSERT_EQ(empty.begin(), empty.end());
+    ASSERT_EQ(empty.mx_begin(), empty.mx_end());
+    ASSERT_EQ(empty.thaw().size(), 0u);
+}
+
+// THREE-WAY COMPARISON TESTS
+
+template<bool ThreeWay>
+class CountedValue {
+public:
+    static long long comparisons;
+
+    explicit CountedValue(int v) : value(v) {}
+
+    int get() const {
+        return value;
+    }
+
+    bool operator<(const CountedValue &a) const {
+        comparisons++;
+        return value < a.value;
+    }
+
+private:
+    int value;
+};
+
+template<bool ThreeWay>
+long long CountedValue<ThreeWay>::comparisons = 0;
+
+template<>
+struct MaximaThreeWay<CountedValue<true>> {
+    static constexpr bool enabled = true;
+
+    static int compare(const CountedValue<true> &v1, const CountedValue<true> &v2) {
+        CountedValue<true>::comparisons++;
+        return v1.get() < v2.get() ? -1 : (v2.get() < v1.get() ? 1 : 0);
+    }
+};
+
+template<bool ThreeWay>
+long long run_counted(std::vector<std::pair<int, int>> &maxima) {
+    std::mt19937 gen(47);
+    FunctionMaxima<int, CountedValue<ThreeWay>> fun;
+    CountedValue<ThreeWay>::comparisons = 0;
+
+    for (int i = 0; i < 5000; i++) {
+        int arg = static_cast<int>(gen() % 300);
+        if (gen() % 4 == 0) {
+            fun.erase(arg);
+        } else {
+            fun.set_value(arg, CountedValue<ThreeWay>(static_cast<int>(gen() % 3)));
+        }
+    }
+
+    for (auto it = fun.mx_begin(); it != fun.mx_end(); ++it) {
+        maxima.emplace_back(it->arg(), it->value().get());
+    }
+    return CountedValue<ThreeWay>::comparisons;
+}
+
+TEST(threeWay, sameMaximaWithFewerComparisons) {
+    std::vector<std::pair<int, int>> lessOnly, threeWay;
+    long long lessComparisons = run_counted<false>(lessOnly);
+    long long threeWayComparisons = run_counted<true>(threeWay);
+
+    ASSERT_EQ(lessOnly, threeWay);
+    ASSERT_LT(threeWayComparisons, lessComparisons);
+}
+
+TEST(threeWay, valueOrder) {
+    using Order = MaximaValueOrder<int>;
+    ASSERT_LT(Order::compare(1, 2), 0);
+    ASSERT_GT(Order::compare(2, 1), 0);
+    ASSERT_TRUE(Order::same(2, 2));
+    int low = 1, high = 3;
+    ASSERT_TRUE(Order::isMaximum(&low, 2, nullptr));
+    ASSERT_TRUE(Order::isMaximum(&high, 3, &high));
+    ASSERT_FALSE(Order::isMaximum(&low, 2, &high));
+    ASSERT_TRUE(Order::maximumBefore(3, 10, 2, 0));
+    ASSERT_TRUE(Order::maximumBefore(2, 0, 2, 10));
+    ASSERT_FALSE(Order::maximumBefore(2, 10, 2, 10));
+}
+
+// LAZY MAXIMA TESTS
+
+TEST(lazyMaxima, matchesEagerFunction) {
+    std::mt19937 gen(53);
+    FunctionMaxima<int, int> eager, lazy;
+    FunctionMaxima<ArmedThrow, ArmedThrow> generic;
+    for (int i = 0; i < 2000; i++) {
+        int arg = static_cast<int>(gen() % 3000), value = static_cast<int>(gen() % 4);
+        eager.set_value(arg, value);
+        lazy.set_value(arg, value);
+        generic.set_value(ArmedThrow(arg), ArmedThrow(value));
+    }
+    lazy.enable_lazy_maxima();
+    generic.enable_lazy_maxima();
+    ASSERT_TRUE(lazy.has_lazy_maxima());
+
+    for (int round = 0; round < 200; round++) {
+        int writes = round % 10 == 0 ? 1000 : static_cast<int>(gen() % 40);
+        for (int i = 0; i < writes; i++) {
+            int arg = static_cast<int>(gen() % 3000), value = static_cast<int>(gen() % 4);
+            if (gen() % 3 == 0) {
+                eager.erase(arg);
+                lazy.erase(arg);
+                generic.erase(ArmedThrow(arg));
+            } else {
+                eager.set_value(arg, value);
+                lazy.set_value(lazy.find(arg), arg, value);
+                generic.set_value(ArmedThrow(arg), ArmedThrow(value));
+            }
+        }
+
+        switch (round % 4) {
+            case 0: {
+                FunctionMaxima<int, int> copy = lazy;
+                ASSERT_TRUE(copy.has_lazy_maxima());
+                ASSERT_EQ(dump_maxima(copy), dump_maxima(eager));
+                break;
+            }
+            case 1: {
+                int a = static_cast<int>(gen() % 3000);
+                FunctionMaxima<int, int> high = lazy.split_at(a);
+                FunctionMaxima<int, int> eagerHigh = eager.split_at(a);
+                ASSERT_TRUE(high.has_lazy_maxima());
+                ASSERT_EQ(dump_maxima(high), dump_maxima(eagerHigh));
+                lazy.join(std::move(high));
+                eager.join(std::move(eagerHigh));
+                break;
+            }
+            default:
+                break;
+        }
+
+        ASSERT_EQ(dump_points(lazy), dump_points(eager));
+        ASSERT_EQ(dump_maxima(lazy), dump_maxima(eager));
+        ASSERT_EQ(dump_armed(generic, true), dump_maxima(eager));
+    }
+
+    lazy.disable_lazy_maxima();
+    ASSERT_FALSE(lazy.has_lazy_maxima());
+    lazy.set_value(1, 100);
+    eager.set_value(1, 100);
+    ASSERT_EQ(dump_maxima(lazy), dump_maxima(eager));
+}
+
+TEST(lazyMaxima, strongGuarantee) {
+    FunctionMaxima<ArmedThrow, ArmedThrow> fun;
+    for (int i = 0; i < 100; i++) {
+        fun.set_value(ArmedThrow(i), ArmedThrow(i % 5));
+    }
+    fun.enable_lazy_maxima();
+    fun.erase(ArmedThrow(4));
+    fun.set_value(ArmedThrow(50), ArmedThrow(SPECIAL_THROW_VALUE));
+    fun.set_value(ArmedThrow(200), ArmedThrow(7));
+
+    ArmedThrow::armed = true;
+    ASSERT_THROW(fun.set_value(ArmedThrow(50), ArmedThrow(1)), std::string);
+    ASSERT_THROW(fun.mx_begin(), std::string);
+    ArmedThrow::armed = false;
+
+    FunctionMaxima<int, int> expected;
+    for (int i = 0; i < 100; i++) {
+        expected.set_value(i, i % 5);
+    }
+    expected.erase(4);
+    expected.set_value(50, SPECIAL_THROW_VALUE);
+    expected.set_value(200, 7);
+    ASSERT_EQ(dump_armed(fun, false), dump_points(expected));
+    ASSERT_EQ(dump_armed(fun, true), dump_maxima(expected));
+}
+
+TEST(lazyMaxima, stopsRecordingPastRebuildRatio) {
+    FunctionMaxima<ArmedThrow, ArmedThrow> fun;
+    FunctionMaxima<int, int> expected;
+    for (int i = 0; i < 100; i++) {
+        fun.set_value(ArmedThrow(i), ArmedThrow(i % 5));
+        expected.set_value(i, i % 5);
+    }
+    fun.enable_lazy_maxima();
+
+    for (int i = 0; i < 60; i++) {
+        fun.set_value(ArmedThrow(i * 3 % 100), ArmedThrow(i % 7));
+        expected.set_value(i * 3 % 100, i % 7);
+        if (i % 4 == 0) {
+            fun.erase(ArmedThrow(i * 7 % 100));
+            expected.erase(i * 7 % 100);
+        }
+    }
+
+    ArmedThrow::armed = true;
+    ASSERT_THROW(fun.set_value(ArmedThrow(42), ArmedThrow(1)), std::string);
+    ArmedThrow::armed = false;
+
+    FunctionMaxima<ArmedThrow, ArmedThrow> copy = fun;
+    ASSERT_EQ(dump_armed(copy, true), dump_maxima(expected));
+    ASSERT_EQ(dump_armed(fun, false), dump_points(expected));
+    ASSERT_EQ(dump_armed(fun, true), dump_maxima(expected));
+}
+
+TEST(lazyMaxima, concurrentReadersRepairOnce) {
+    std::mt19937 gen(83);
+    FunctionMaxima<int, int> fun, expected;
+    fun.enable_lazy_maxima();
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 200; i++) {
+            int arg = static_cast<int>(gen() % 1000), value = static_cast<int>(gen() % 20);
+            fun.set_value(arg, value);
+            expected.set_value(arg, value);
+        }
+
+        const FunctionMaxima<int, int> &shared = fun;
+        std::vector<std::vector<std::pair<int, int>>> seen(4);
+        std::vector<std::thread> readers;
+        for (size_t t = 0; t < seen.size(); t++) {
+            readers.emplace_back([&shared, &seen, t]() {
+                seen[t] = t % 2 == 0 ? dump_maxima(shared) : dump_maxima(FunctionMaxima<int, int>(shared));
+            });
+        }
+        for (std::thread &reader : readers) {
+            reader.join();
+        }
+        for (const auto &maxima : seen) {
+            ASSERT_EQ(maxima, dump_maxima(expected));
+        }
+    }
+}
+
+// TRANSACTION TESTS
+
+int unwrap(int v) {
+    return v;
+}
+
+int unwrap(const ArmedThrow &v) {
+    return v.get();
+}
+
+template<typename It>
+std::vector<std::pair<int, int>> dump_unwrapped(It first, It last) {
+    std::vector<std::pair<int, int>> result;
+    for (auto it = first; it != last; ++it) {
+        result.emplace_back(unwrap(it->arg()), unwrap(it->value()));
+    }
+    return result;
+}
+
+template<typename F>
+std::vector<std::pair<int, int>> dump_unwrapped(const F &fun, bool maxima) {
+    return maxima ? dump_unwrapped(fun.mx_begin(), fun.mx_end()) : dump_unwrapped(fun.begin(), fun.end());
+}
+
+template<typename T>
+void random_write(std::mt19937 &gen, int round, std::vector<FunctionMaxima<T, T> *> funs) {
+    int arg = gen() % 8 == 0 ? 1000 + round * 100 + static_cast<int>(gen() % 100) : static_cast<int>(gen() % 400);
+    int value = static_cast<int>(gen() % 4), op = static_cast<int>(gen() % 3);
+    for (FunctionMaxima<T, T> *fun : funs) {
+        if (op == 0) {
+            fun->erase(T(arg));
+        } else if (op == 1) {
+            fun->set_value(fun->find(T(arg)), T(arg), T(value));
+        } else {
+            fun->set_value(T(arg), T(value));
+        }
+    }
+}
+
+template<typename T>
+void check_transactions(bool hashed, bool lazy) {
+    using F = FunctionMaxima<T, T>;
+    std::mt19937 gen(59);
+    F fun, mirror;
+    if (hashed) {
+        fun.enable_hash_index([](const T &a) { return std::hash<int>()(unwrap(a)); });
+    }
+    if (lazy) {
+        fun.enable_lazy_maxima();
+    }
+    for (int i = 0; i < 300; i++) {
+        random_write<T>(gen, 0, {&fun, &mirror});
+    }
+
+    for (int round = 0; round < 150; round++) {
+        F saved = mirror;
+        {
+            typename F::transaction group(fun);
+            int writes = static_cast<int>(gen() % 30);
+            for (int i = 0; i < writes; i++) {
+                random_write<T>(gen, round, {&fun, &mirror});
+                if (i == writes / 2) {
+                    typename F::transaction nested(fun);
+                    F inner = fun;
+                    for (int j = static_cast<int>(gen() % 10); j > 0; j--) {
+                        random_write<T>(gen, round, {&fun, &inner});
+                    }
+                    ASSERT_EQ(dump_unwrapped(fun, true), dump_unwrapped(inner, true));
+                    if (round % 2 == 0) {
+                        nested.rollback();
+                    } else {
+                        nested.commit();
+                        mirror = inner;
+                    }
+                    ASSERT_EQ(dump_unwrapped(fun, false), dump_unwrapped(mirror, false));
+                }
+            }
+            ASSERT_EQ(dump_unwrapped(fun, true), dump_unwrapped(mirror, true));
+
+            if (round % 3 == 0) {
+                group.commit();
+            } else if (round % 3 == 1) {
+                group.rollback();
+            }
+        }
+        if (round % 3 != 0) {
+            mirror = saved;
+        }
+
+        ASSERT_EQ(dump_unwrapped(fun, false), dump_unwrapped(mirror, false));
+        ASSERT_EQ(dump_unwrapped(fun, true), dump_unwrapped(mirror, true));
+        ASSERT_EQ(fun.has_hash_index(), hashed);
+        for (auto &p : mirror) {
+            ASSERT_EQ(unwrap(fun.value_at(p.arg())), unwrap(p.value()));
+        }
+    }
+}
+
+TEST(transaction, rollbackRestoresFunction) {
+    for (bool hashed : {false, true}) {
+        for (bool lazy : {false, true}) {
+            check_transactions<int>(hashed, lazy);
+            check_transactions<ArmedThrow>(hashed, lazy);
+        }
+    }
+}
+
+TEST(transaction, rollbackKeepsHashIndex) {
+    FunctionMaxima<int, int> fun;
+    fun.enable_hash_index();
+    for (int i = 0; i < 200; i++) {
+        fun.set_value(i, i % 7);
+    }
+    FunctionMaxima<int, int> saved = fun;
+
+    for (int round = 0; round < 3; round++) {
+        FunctionMaxima<int, int>::transaction group(fun);
+        for (int i = 0; i < 200; i++) {
+            fun.erase(i);
+            fun.set_value(1000 + i, i);
+        }
+        for (int i = 0; i < 200; i++) {
+            fun.erase(1000 + i);
+        }
+        ASSERT_EQ(fun.size(), 0u);
+        group.rollback();
+
+        ASSERT_TRUE(fun.has_hash_index());
+        ASSERT_EQ(dump_points(fun), dump_points(saved));
+        for (int i = 0; i < 200; i++) {
+            ASSERT_EQ(*fun.try_value_at(i), i % 7);
+            ASSERT_FALSE(fun.contains(1000 + i));
+        }
+    }
+}
+
+TEST(transaction, failedWriteAndFailedRollback) {
+    FunctionMaxima<ArmedThrow, ArmedThrow> fun;
+    FunctionMaxima<int, int> expected;
+    for (int i = 0; i < 100; i++) {
+        fun.set_value(ArmedThrow(i), ArmedThrow(i % 5));
+        expected.set_value(i, i % 5);
+    }
+    fun.set_value(ArmedThrow(60), ArmedThrow(SPECIAL_THROW_VALUE));
+    expected.set_value(60, SPECIAL_THROW_VALUE);
+
+    {
+        FunctionMaxima<ArmedThrow, ArmedThrow>::transaction group(fun);
+        fun.erase(ArmedThrow(10));
+        fun.set_value(ArmedThrow(20), ArmedThrow(7));
+        ASSERT_THROW(fun.merge(FunctionMaxima<ArmedThrow, ArmedThrow>(), MergePolicy::preferLeft), InvalidArg);
+        ASSERT_THROW(fun.split_at(ArmedThrow(50)), InvalidArg);
+
+        ArmedThrow::armed = true;
+        ASSERT_THROW(fun.set_value(ArmedThrow(61), ArmedThrow(9)), std::string);
+        ArmedThrow::armed = false;
+        group.rollback();
+    }
+    ASSERT_EQ(dump_armed(fun, false), dump_points(expected));
+    ASSERT_EQ(dump_armed(fun, true), dump_maxima(expected));
+
+    {
+        FunctionMaxima<ArmedThrow, ArmedThrow>::transaction group(fun);
+        fun.erase(ArmedThrow(60));
+        fun.set_value(ArmedThrow(30), ArmedThrow(8));
+
+        ArmedThrow::armed = true;
+        ASSERT_THROW(group.rollback(), std::string);
+        ArmedThrow::armed = false;
+        group.rollback();
+    }
+    ASSERT_EQ(dump_armed(fun, false), dump_points(expected));
+    ASSERT_EQ(dump_armed(fun, true), dump_maxima(expected));
+
+    {
+        FunctionMaxima<ArmedThrow, ArmedThrow>::transaction group(fun);
+        fun.erase(ArmedThrow(60));
+        fun.set_value(ArmedThrow(30), ArmedThrow(8));
+        ArmedThrow::armed = true;
+    }
+    ArmedThrow::armed = false;
+    ASSERT_EQ(dump_armed(fun, false), dump_points(expected));
+    ASSERT_EQ(dump_armed(fun, true), dump_maxima(expected));
+}
+
+// JOURNAL TESTS
+
+std::string journal_path(const char *name) {
+    std::string path = testing::TempDir() + "maxima_" + name;
+    std::remove((path + ".log").c_str());
+    std::remove((path + ".snapshot").c_str());
+    return path;
+}
+
+TEST(journal, recoveryReplaysLogOnSnapshot) {
+    std::string path = journal_path("recovery");
+    std::mt19937 gen(61);
+    FunctionMaxima<int, int> expected;
+    {
+        JournaledFunctionMaxima<int, int> fun(path, 16);
+        for (int i = 0; i < 3000; i++) {
+            int arg = static_cast<int>(gen() % 500), value = static_cast<int>(gen() % 5);
+            if (gen() % 4 == 0) {
+                fun.erase(arg);
+                expected.erase(arg);
+            } else {
+                fun.set_value(arg, value);
+                expected.set_value(arg, value);
+            }
+            if (i == 1500) {
+                fun.checkpoint();
+                ASSERT_EQ(fun.pending(), 0u);
+            }
+        }
+        ASSERT_GT(fun.pending(), 0u);
+        ASSERT_LT(fun.pending(), 16u);
+    }
+
+    JournaledFunctionMaxima<int, int> recovered(path);
+    ASSERT_EQ(dump_points(recovered.unwrap()), dump_points(expected));
+    ASSERT_EQ(dump_maxima(recovered.unwrap()), dump_maxima(expected));
+
+    recovered.set_value(1000, 9);
+    expected.set_value(1000, 9);
+    recovered.checkpoint();
+    JournaledFunctionMaxima<int, int> again(path);
+    ASSERT_EQ(dump_maxima(again.unwrap()), dump_maxima(expected));
+}
+
+TEST(journal, tornRecordIsCutOff) {
+    std::string path = journal_path("torn");
+    {
+        JournaledFunctionMaxima<std::string, std::string> fun(path, 4);
+        fun.set_value("a", "x");
+        fun.set_value("b", "zz");
+        fun.set_value("c", "y");
+        fun.erase("a");
+        fun.sync();
+        fun.set_value("d", "zzz");
+        fun.sync();
+    }
+
+    {
+        std::FILE *log = std::fopen((path + ".log").c_str(), "r+b");
+        ASSERT_NE(log, nullptr);
+        std::fseek(log, 0, SEEK_END);
+        long size = std::ftell(log);
+        std::fclose(log);
+        ASSERT_EQ(truncate((path + ".log").c_str(), size - 3), 0);
+    }
+
+    {
+        JournaledFunctionMaxima<std::string, std::string> fun(path, 4);
+        ASSERT_EQ(fun.size(), 2u);
+        ASSERT_EQ(fun.mx_begin()->arg(), "b");
+        fun.set_value("e", "zzzz");
+    }
+
+    JournaledFunctionMaxima<std::string, std::string> fun(path);
+    ASSERT_EQ(fun.size(), 3u);
+    ASSERT_EQ(fun.value_at("e"), "zzzz");
+    ASSERT_EQ(fun.mx_begin()->arg(), "e");
+}
+
+TEST(journal, tornHeaderIsReinitialized) {
+    std::string path = journal_path("torn_header");
+    {
+        std::FILE *log = std::fopen((path + ".log").c_str(), "wb");
+        ASSERT_NE(log, nullptr);
+        std::fputs("MXJ", log);
+        std::fclose(log);
+    }
+
+    {
+        JournaledFunctionMaxima<int, int> fun(path, 2);
+        ASSERT_EQ(fun.size(), 0u);
+        fun.set_value(1, 4);
+        ASSERT_EQ(fun.pending(), 1u);
+        fun.set_value(2, 5);
+        ASSERT_EQ(fun.pending(), 0u);
+    }
+
+    {
+        JournaledFunctionMaxima<int, int> fun(path);
+        ASSERT_EQ(fun.size(), 2u);
+        ASSERT_EQ(fun.mx_begin()->arg(), 2);
+    }
+
+    {
+        std::FILE *log = std::fopen((path + ".log").c_str(), "wb");
+        ASSERT_NE(log, nullptr);
+        std::fputs("MXX", log);
+        std::fclose(log);
+    }
+    ASSERT_THROW((JournaledFunctionMaxima<int, int>(path)), std::runtime_error);
+}
+
+std::string journal_record(const std::string &payload) {
+    std::uint32_t length = static_cast<std::uint32_t>(payload.size()), sum = 2166136261u;
+    for (char c : payload) {
+        sum = (sum ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    std::string record(reinterpret_cast<const char *>(&length), sizeof(length));
+    record.append(reinterpret_cast<const char *>(&sum), sizeof(sum));
+    return record + payload;
+}
+
+void append_to_log(const std::string &path, const std::string &bytes) {
+    std::FILE *log = std::fopen((path + ".log").c_str(), "ab");
+    ASSERT_NE(log, nullptr);
+    std::fwrite(bytes.data(), 1, bytes.size(), log);
+    std::fclose(log);
+}
+
+TEST(journal, corruptedRecordsAreRejected) {
+    std::string path = journal_path("corrupted");
+    {
+        JournaledFunctionMaxima<std::string, int> fun(path, 1);
+        fun.set_value("a", 3);
+    }
+
+    append_to_log(path, journal_record("xjunk"));
+    {
+        JournaledFunctionMaxima<std::string, int> fun(path, 1);
+        ASSERT_EQ(fun.size(), 1u);
+        fun.set_value("b", 4);
+    }
+    {
+        JournaledFunctionMaxima<std::string, int> fun(path);
+        ASSERT_EQ(fun.size(), 2u);
+        ASSERT_EQ(fun.value_at("b"), 4);
+    }
+
+    std::string hugeLength("\xff\xff\xff\xff\xff\xff\xff\x7f", 8);
+    append_to_log(path, journal_record("s" + hugeLength + "c"));
+    ASSERT_THROW((JournaledFunctionMaxima<std::string, int>(path)), std::runtime_error);
+}
+
+// SMALL FUNCTION TESTS
+
+TEST(smallFunction, matchesFunctionAcrossGrowth) {
+    std::mt19937 gen(67);
+    int grown = 0;
+    for (int round = 0; round < 300; round++) {
+        int range = 2 + round % 12;
+        SmallFunctionMaxima<int, int, 6> small;
+        FunctionMaxima<int, int> expected;
+        for (int i = 0; i < 40; i++) {
+            int arg = static_cast<int>(gen() % range), value = static_cast<int>(gen() % 4);
+            if (gen() % 3 == 0) {
+                small.erase(arg);
+                expected.erase(arg);
+            } else {
+                small.set_value(arg, value);
+                expected.set_value(arg, value);
+            }
+            ASSERT_EQ(dump_points(small), dump_points(expected));
+            ASSERT_EQ(dump_maxima(small), dump_maxima(expected));
+            ASSERT_EQ(small.contains(arg), expected.contains(arg));
+        }
+        ASSERT_TRUE(small.is_small() || range > 6);
+        grown += !small.is_small();
+
+        SmallFunctionMaxima<int, int, 6> copy = small, moved;
+        moved = std::move(small);
+        ASSERT_EQ(small.size(), 0u);
+        ASSERT_TRUE(small.mx_begin() == small.mx_end());
+        copy.swap(small);
+        ASSERT_EQ(dump_maxima(small), dump_maxima(expected));
+        ASSERT_EQ(dump_points(moved), dump_points(expected));
+        ASSERT_EQ(copy.size(), 0u);
+    }
+    ASSERT_GT(grown, 0);
+}
+
+template<typename It>
+std::vector<std::pair<int, int>> dump_armed_range(It first, It last) {
+    std::vector<std::pair<int, int>> result;
+    for (; first != last; ++first) {
+        result.emplace_back(first->arg().get(), first->value().get());
+    }
+    return result;
+}
+
+TEST(smallFunction, strongGuarantee) {
+    SmallFunctionMaxima<ArmedThrow, ArmedThrow, 4> fun;
+    FunctionMaxima<int, int> expected;
+    for (int i : {1, 3, 5}) {
+        fun.set_value(ArmedThrow(i), ArmedThrow(i == 3 ? SPECIAL_THROW_VALUE : i));
+        expected.set_value(i, i == 3 ? SPECIAL_THROW_VALUE : i);
+    }
+
+    ArmedThrow::armed = true;
+    ASSERT_THROW(fun.set_value(ArmedThrow(4), ArmedThrow(7)), std::string);
+    ASSERT_THROW(fun.erase(ArmedThrow(5)), std::string);
+    ArmedThrow::armed = false;
+    fun.set_value(ArmedThrow(7), ArmedThrow(2));
+    expected.set_value(7, 2);
+    ASSERT_TRUE(fun.is_small());
+
+    ArmedThrow::armed = true;
+    ASSERT_THROW(fun.set_value(ArmedThrow(2), ArmedThrow(1)), std::string);
+    ArmedThrow::armed = false;
+    ASSERT_TRUE(fun.is_small());
+    ASSERT_EQ(dump_armed_range(fun.begin(), fun.end()), dump_points(expected));
+    ASSERT_EQ(dump_armed_range(fun.mx_begin(), fun.mx_end()), dump_maxima(expected));
+
+    fun.set_value(ArmedThrow(2), ArmedThrow(1));
+    expected.set_value(2, 1);
+    ASSERT_FALSE(fun.is_small());
+    ASSERT_EQ(dump_armed_range(fun.begin(), fun.end()), dump_points(expected));
+    ASSERT_EQ(dump_armed_range(fun.mx_begin(), fun.mx_end()), dump_maxima(expected));
+}
+
+// LSM FUNCTION TESTS
+
+TEST(lsmFunction, matchesFunction) {
+    std::mt19937 gen(71);
+    for (size_t capacity : {1, 4, 64}) {
+        LsmFunctionMaxima<int, int> lsm(capacity);
+        FunctionMaxima<int, int> expected;
+        for (int i = 0; i < 3000; i++) {
+            int arg = static_cast<int>(gen() % 200), value = static_cast<int>(gen() % 10);
+            if (gen() % 4 == 0) {
+                lsm.erase(arg);
+                expected.erase(arg);
+            } else {
+                lsm.set_value(arg, value);
+                expected.set_value(arg, value);
+            }
+            ASSERT_EQ(lsm.contains(arg), expected.contains(arg));
+            int probe = static_cast<int>(gen() % 200);
+            ASSERT_EQ(lsm.contains(probe), expected.contains(probe));
+            if (expected.contains(probe)) {
+                ASSERT_EQ(lsm.value_at(probe), expected.value_at(probe));
+            } else {
+                ASSERT_THROW(lsm.value_at(probe), InvalidArg);
+            }
+            ASSERT_LE(lsm.run_count(), 20u);
+            if (i % 97 == 0) {
+                ASSERT_EQ(dump_maxima(lsm), dump_maxima(expected));
+                ASSERT_LE(lsm.run_count(), 1u);
+            }
+        }
+        ASSERT_EQ(lsm.size(), expected.size());
+        ASSERT_EQ(dump_points(lsm), dump_points(expected));
+        ASSERT_EQ(dump_maxima(lsm), dump_maxima(expected));
+        ASSERT_TRUE(lsm.find(1000) == lsm.end());
+        for (const auto &p : expected) {
+            ASSERT_EQ(lsm.find(p.arg())->value(), p.value());
+        }
+    }
+}
+
+TEST(lsmFunction, strongGuarantee) {
+    LsmFunctionMaxima<ArmedThrow, ArmedThrow> lsm(2);
+    FunctionMaxima<int, int> expected;
+    for (auto [arg, value] : std::vector<std::pair<int, int>>{{1, SPECIAL_THROW_VALUE}, {3, 1}, {5, 2}, {7, 0}}) {
+        lsm.set_value(ArmedThrow(arg), ArmedThrow(value));
+        expected.set_value(arg, value);
+    }
+    ASSERT_EQ(lsm.run_count(), 1u);
+
+    // The buffer is full, so the write has to flush it and recompute maxima, which compares the poisoned value.
+    ArmedThrow::armed = true;
+    ASSERT_THROW(lsm.set_value(ArmedThrow(9), ArmedThrow(1)), std::string);
+    ASSERT_THROW(lsm.erase(ArmedThrow(SPECIAL_THROW_VALUE)), std::string);
+    ArmedThrow::armed = false;
+    ASSERT_EQ(lsm.run_count(), 1u);
+    ASSERT_EQ(lsm.value_at(ArmedThrow(5)).get(), 2);
+
+    ASSERT_EQ(dump_armed_range(lsm.begin(), lsm.end()), dump_points(expected));
+    ASSERT_EQ(dump_armed_range(lsm.mx_begin(), lsm.mx_end()), dump_maxima(expected));
+}
+
+// PROMINENT FUNCTION TESTS
+
+/**
+ * Prominences of all maxima of fun computed by definition, in O(n^2).
+ */
+std::vector<std::tuple<int, int, int>> brute_prominences(const FunctionMaxima<int, int> &fun) {
+    std::vector<std::pair<int, int>> points = dump_points(fun);
+    std::vector<std::tuple<int, int, int>> result;
+    for (auto it = fun.mx_begin(); it != fun.mx_end(); ++it) {
+        size_t i = 0;
+        while (points[i].first != it->arg()) {
+            i++;
+        }
+        int value = points[i].second, col = value;
+        bool found = false;
+        for (int step : {-1, 1}) {
+            bool any = false;
+            int lowest = 0;
+            for (long j = static_cast<long>(i) + step; j >= 0 && j < static_cast<long>(points.size()); j += step) {
+                if (points[j].second > value) {
+                    break;
+                }
+                lowest = any ? std::min(lowest, points[j].second) : points[j].second;
+                any = true;
+            }
+            if (any) {
+                col = found ? std::max(col, lowest) : lowest;
+                found = true;
+            }
+        }
+        result.emplace_back(it->arg(), value, value - col);
+    }
+    return result;
+}
+
+std::vector<std::pair<int, int>> dump_prominent(const ProminentFunctionMaxima<int, int> &fun) {
+    std::vector<std::pair<int, int>> result;
+    for (auto it = fun.prominent_begin(); it != fun.prominent_end(); ++it) {
+        result.emplace_back(it->arg(), it->value());
+    }
+    return result;
+}
+
+TEST(prominentFunction, matchesDefinition) {
+    std::mt19937 gen(73);
+    for (int threshold : {0, 3, 8}) {
+        ProminentFunctionMaxima<int, int> fun(threshold);
+        for (int i = 0; i < 2000; i++) {
+            int arg = static_cast<int>(gen() % 60), value = static_cast<int>(gen() % 20);
+            if (gen() % 4 == 0) {
+                fun.erase(arg);
+            } else {
+                fun.set_value(arg, value);
+            }
+
+            std::vector<std::pair<int, int>> expected;
+            for (auto [a, v, prominence] : brute_prominences(fun.unwrap())) {
+                ASSERT_EQ(fun.prominence(a), prominence);
+                if (prominence > threshold) {
+                    expected.emplace_back(a, v);
+                }
+            }
+            ASSERT_EQ(dump_prominent(fun), expected);
+            ASSERT_EQ(fun.prominent_size(), expected.size());
+        }
+        if (fun.size() > 0 && fun.find(fun.begin()->arg() + 1) == fun.end()) {
+            ASSERT_THROW(fun.prominence(fun.begin()->arg() + 1), InvalidArg);
+        }
+
+        ProminentFunctionMaxima<int, int> copy = fun;
+        copy.set_threshold(threshold + 2);
+        ASSERT_EQ(copy.threshold(), threshold + 2);
+        ASSERT_LE(copy.prominent_size(), fun.prominent_size());
+        fun = std::move(copy);
+        ASSERT_EQ(fun.threshold(), threshold + 2);
+    }
+}
+
+TEST(prominentFunction, staircaseAndPlateau) {
+    ProminentFunctionMaxima<int, int> fun(4);
+    // Nested maxima 10, 9, 8, ... separated by valleys of 1.
+    for (int i = 0; i < 8; i++) {
+        fun.set_value(2 * i, 10 - i);
+        fun.set_value(2 * i + 1, 1);
+    }
+    ASSERT_EQ(fun.prominence(0), 9);
+    ASSERT_EQ(fun.prominence(14), 2);
+    ASSERT_EQ(fun.prominent_size(), 5u);
+
+    // Lowering the valley at the end does not change the col of any maximum, raising it removes the last one.
+    fun.set_value(15, -100);
+    ASSERT_EQ(fun.prominence(14), 2);
+    fun.set_value(15, 4);
+    ASSERT_THROW(fun.prominence(14), InvalidArg);
+
+    // A plateau: both points are maxima with the same prominence.
+    fun.set_value(13, 20);
+    fun.set_value(12, 20);
+    ASSERT_EQ(fun.prominence(12), 17);
+    ASSERT_EQ(fun.prominence(13), 17);
+    ASSERT_EQ(fun.prominence(0), 9);
+    ASSERT_EQ(fun.prominent_begin()->arg(), 12);
+    ASSERT_EQ(fun.prominent_begin()->prominence(), 17);
+}
+
+// CONCURRENT FUNCTION TESTS
+
+TEST(concurrentFunction, lastWriterOfEachThreadWins) {
+    const int threads = 4, keysPerThread = 300;
+    FunctionMaxima<int, int> initial, expected;
+    for (int i = 0; i < threads * keysPerThread; i += 3) {
+        initial.set_value(i, -1);
+        expected.set_value(i, -1);
+    }
+
+    ConcurrentFunctionMaxima<int, int> fun(initial);
+    std::vector<std::thread> producers;
+    for (int t = 0; t < threads; t++) {
+        producers.emplace_back([&fun, t]() {
+            std::mt19937 gen(t);
+            for (int i = 0; i < 20 * keysPerThread; i++) {
+                int arg = t * keysPerThread + static_cast<int>(gen() % keysPerThread);
+                if (gen() % 5 == 0) {
+                    fun.erase(arg);
+                } else {
+                    fun.set_value(arg, static_cast<int>(gen() % 50));
+                }
+            }
+        });
+    }
+    for (std::thread &producer : producers) {
+        producer.join();
+    }
+
+    // Every thread owns its keys, so replaying the threads one after another gives the same function.
+    for (int t = 0; t < threads; t++) {
+        std::mt19937 gen(t);
+        for (int i = 0; i < 20 * keysPerThread; i++) {
+            int arg = t * keysPerThread + static_cast<int>(gen() % keysPerThread);
+            if (gen() % 5 == 0) {
+                expected.erase(arg);
+            } else {
+                expected.set_value(arg, static_cast<int>(gen() % 50));
+            }
+        }
+    }
+
+    fun.flush();
+    fun.read([&](const FunctionMaxima<int, int> &applied) {
+        ASSERT_EQ(dump_points(applied), dump_points(expected));
+        ASSERT_EQ(dump_maxima(applied), dump_maxima(expected));
+    });
+
+    fun.set_value(7, 100);
+    fun.set_value(7, 101);
+    fun.erase(8);
+    fun.flush();
+    ASSERT_EQ(fun.read([](const FunctionMaxima<int, int> &applied) {
+        return applied.value_at(7);
+    }), 101);
+    ASSERT_FALSE(fun.read([](const FunctionMaxima<int, int> &applied) {
+        return applied.contains(8);
+    }));
+}
+
+struct PoisonedArg {
+    int value;
+
+    bool operator<(const PoisonedArg &other) const {
+        if (value < 0 || other.value < 0) {
+            throw std::string("poisoned");
+        }
+        return value < other.value;
+    }
+};
+
+TEST(concurrentFunction, failureIsReportedByFlush) {
+    ConcurrentFunctionMaxima<PoisonedArg, int> fun;
+    fun.set_value(PoisonedArg{1}, 1);
+    fun.flush();
+
+    fun.set_value(PoisonedArg{-1}, 2);
+    ASSERT_THROW(fun.flush(), std::string);
+    ASSERT_NO_THROW(fun.flush());
+
+    fun.set_value(PoisonedArg{2}, 3);
+    fun.flush();
+    ASSERT_EQ(fun.read([](const FunctionMaxima<PoisonedArg, int> &applied) {
+        return applied.size();
+    }), 2u);
+}
+
+TEST(concurrentFunction, failedMergeFallsBackToSingleUpdates) {
+    ConcurrentFunctionMaxima<int, PoisonedArg> fun;
+    fun.set_value(1, PoisonedArg{5});
+    fun.set_value(2, PoisonedArg{-1});
+    fun.set_value(3, PoisonedArg{7});
+    ASSERT_THROW(fun.flush(), std::string);
+
+    fun.read([](const FunctionMaxima<int, PoisonedArg> &applied) {
+        ASSERT_EQ(applied.size(), 2u);
+        ASSERT_EQ(applied.value_at(1).value, 5);
+        ASSERT_EQ(applied.value_at(3).value, 7);
+    });
+}
+
 int main(int argc, char **argv) {
     testing::InitGoogleTest(&argc, argv);
 